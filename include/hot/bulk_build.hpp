@@ -0,0 +1,371 @@
+// bulk_build.hpp
+// building triangulations from large point sets: hinted insertion in
+// Hilbert order (hilbert_order.hpp), and for large Delaunay jobs a
+// parallel build in vertical strips merged at the seams
+#ifndef _BULK_BUILD_HPP_
+#define _BULK_BUILD_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <CGAL/Delaunay_triangulation_2.h>
+#include <CGAL/Triangulation_face_base_with_info_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+
+#include "cgal-kernel.h"
+#include "checkpoint.hpp"
+#include "hilbert_order.hpp"
+#include "indexed_triangulation.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+#include "point_io.hpp"
+
+struct bulk_build_params {
+  // Delaunay inputs with at least this many points are built in strips
+  std::size_t strip_min_points = 1000000;
+  // number of strips, 0 for one per thread
+  int strips = 0;
+};
+
+/* Builds tr from triangles over points (indices into points), which must
+ * triangulate the convex hull of the points they use with every face
+ * counterclockwise, e.g. the faces of a Delaunay triangulation. The data
+ * structure is assembled directly: the neighbors are found through the
+ * faces incident to each vertex, and infinite faces are added along the
+ * hull. tr is cleared first */
+template <typename Tr>
+void assemble_triangulation(Tr &tr, const point_set &points,
+                            const std::vector<std::array<int, 3>> &triangles) {
+  using Vertex_handle = typename Tr::Vertex_handle;
+  using Face_handle = typename Tr::Face_handle;
+  tr.clear();
+  if (triangles.empty()) {
+    return;
+  }
+  auto &tds = tr.tds();
+  tds.set_dimension(2);
+  const std::size_t n = points.size();
+  const std::size_t num_faces = triangles.size();
+
+  // the faces incident to each vertex, in compressed rows
+  std::vector<int> start(n + 1, 0);
+  for (const std::array<int, 3> &t : triangles) {
+    for (int v = 0; v < 3; v++) {
+      start[t[v] + 1]++;
+    }
+  }
+  std::vector<Vertex_handle> verts(n);
+  for (std::size_t i = 0; i < n; i++) {
+    if (start[i + 1] > 0) {
+      verts[i] = tds.create_vertex();
+      verts[i]->set_point(bulk_point<Tr>(points, i, bulk_weighted<Tr>()));
+    }
+    start[i + 1] += start[i];
+  }
+  std::vector<int> incident(start[n]);
+  {
+    std::vector<int> cursor(start.begin(), start.end() - 1);
+    for (std::size_t f = 0; f < num_faces; f++) {
+      for (int v = 0; v < 3; v++) {
+        incident[cursor[triangles[f][v]]++] = f;
+      }
+    }
+  }
+
+  std::vector<Face_handle> faces(num_faces);
+  for (std::size_t f = 0; f < num_faces; f++) {
+    const std::array<int, 3> &t = triangles[f];
+    faces[f] = tds.create_face(verts[t[0]], verts[t[1]], verts[t[2]]);
+    for (int v = 0; v < 3; v++) {
+      verts[t[v]]->set_face(faces[f]);
+    }
+  }
+
+  // Across the edge a b of a face is the face with the edge b a, which is
+  // among the faces incident to b. Each face only sets its own neighbors
+  std::vector<char> on_hull(3 * num_faces, 0);
+  parallel_for(num_faces, [&](int, std::size_t begin, std::size_t end) {
+    for (std::size_t f = begin; f < end; f++) {
+      for (int i = 0; i < 3; i++) {
+        const int a = triangles[f][(i + 1) % 3], b = triangles[f][(i + 2) % 3];
+        int neighbor = -1;
+        for (int k = start[b]; k < start[b + 1] && neighbor < 0; k++) {
+          const std::array<int, 3> &t = triangles[incident[k]];
+          for (int j = 0; j < 3; j++) {
+            if (t[(j + 1) % 3] == b && t[(j + 2) % 3] == a) {
+              neighbor = incident[k];
+            }
+          }
+        }
+        if (neighbor < 0) {
+          on_hull[3 * f + i] = 1;
+        } else {
+          faces[f]->set_neighbor(i, faces[neighbor]);
+        }
+      }
+    }
+  });
+
+  // The infinite face across the hull edge a b is (b, a, infinite), so the
+  // next one around the hull is the one starting with a
+  Vertex_handle infinite = tr.infinite_vertex();
+  std::vector<Face_handle> hull_from(n);
+  std::vector<std::pair<Face_handle, int>> hull;
+  for (std::size_t f = 0; f < num_faces; f++) {
+    for (int i = 0; i < 3; i++) {
+      if (!on_hull[3 * f + i]) {
+        continue;
+      }
+      const int a = triangles[f][(i + 1) % 3], b = triangles[f][(i + 2) % 3];
+      Face_handle g = tds.create_face(verts[b], verts[a], infinite);
+      g->set_neighbor(2, faces[f]);
+      faces[f]->set_neighbor(i, g);
+      hull_from[b] = g;
+      hull.push_back(std::make_pair(g, a));
+    }
+  }
+  for (const std::pair<Face_handle, int> &h : hull) {
+    Face_handle next = hull_from[h.second];
+    h.first->set_neighbor(0, next);
+    next->set_neighbor(1, h.first);
+  }
+  infinite->set_face(hull.front().first);
+}
+
+// Delaunay triangulation with the input index of each vertex, and a flag
+// for the faces which belong to the final triangulation
+using Strip_Gt = DT::Geom_traits;
+using Strip_DT = CGAL::Delaunay_triangulation_2<
+    Strip_Gt, CGAL::Triangulation_data_structure_2<
+                  CGAL::Triangulation_vertex_base_with_info_2<int, Strip_Gt>,
+                  CGAL::Triangulation_face_base_with_info_2<bool, Strip_Gt>>>;
+
+/* Whether the circumcircle of a finite face lies inside the slab
+ * lo < x < hi. Such a face is Delaunay for the points of every strip,
+ * since all the other points are outside the slab */
+inline bool strip_face_is_final(const Strip_DT &dt,
+                                const Strip_DT::Face_handle &f, double lo,
+                                double hi) {
+  const Strip_DT::Point c = dt.circumcenter(f);
+  const double r = std::sqrt(CGAL::to_double(
+      CGAL::squared_distance(c, f->vertex(0)->point())));
+  const double cx = CGAL::to_double(c.x());
+  const double margin = 1e-9 * r;
+  return cx - r - margin > lo && cx + r + margin < hi;
+}
+
+/* The faces of the Delaunay triangulation of the points, as input indices.
+ * The points are split into strips of equal count by x, each strip is
+ * triangulated on its own thread, and the faces whose circumcircles stay
+ * inside their strip are kept. The rest of the triangulation, around the
+ * seams and the hull, is made of the vertices of the other faces: it is
+ * their Delaunay triangulation, less the faces which land on faces already
+ * kept (found by locating each centroid in its strip's triangulation).
+ * Where the triangulation isn't unique (cocircular points) the strips and
+ * the seam must break ties the same way, as CGAL's symbolic perturbation
+ * does with exact predicates. With inexact ones (Cartesian<double>) nearly
+ * cocircular points can be decided one way in a strip and the other at the
+ * seam, so the faces may not fit together; bulk_build checks for that */
+inline std::vector<std::array<int, 3>>
+strip_delaunay_triangles(const point_set &points, int strips) {
+  const std::size_t n = points.size();
+  strips = static_cast<int>(
+      std::max<std::size_t>(1, std::min<std::size_t>(strips, n / 64)));
+
+  std::vector<std::pair<double, int>> by_x(n);
+  parallel_for(n, [&](int, std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++) {
+      by_x[i] = std::make_pair(points.x(i), static_cast<int>(i));
+    }
+  });
+  parallel_sort(by_x);
+  // strip s is by_x[first[s], first[s + 1]) inside the slab
+  // bound[s] < x < bound[s + 1], with bounds halfway between strips
+  std::vector<std::size_t> first(strips + 1);
+  std::vector<double> bound(strips + 1);
+  for (int s = 0; s <= strips; s++) {
+    first[s] = n * s / strips;
+  }
+  bound[0] = -std::numeric_limits<double>::infinity();
+  bound[strips] = std::numeric_limits<double>::infinity();
+  for (int s = 1; s < strips; s++) {
+    bound[s] = 0.5 * (by_x[first[s] - 1].first + by_x[first[s]].first);
+  }
+
+  std::vector<Strip_DT> local(strips);
+  std::vector<std::vector<std::array<int, 3>>> kept(2 * strips);
+  // points on a face which isn't final; each point is set by its own strip
+  std::vector<char> seam(n, 0);
+  parallel_for(strips,
+               [&](int, std::size_t begin, std::size_t end) {
+                 for (std::size_t s = begin; s < end; s++) {
+                   std::vector<std::pair<Strip_DT::Point, int>> strip_points;
+                   strip_points.reserve(first[s + 1] - first[s]);
+                   for (std::size_t k = first[s]; k < first[s + 1]; k++) {
+                     const int i = by_x[k].second;
+                     strip_points.push_back(std::make_pair(
+                         Strip_DT::Point(points.x(i), points.y(i)), i));
+                   }
+                   Strip_DT &dt = local[s];
+                   dt.insert(strip_points.begin(), strip_points.end());
+                   if (dt.dimension() < 2) {
+                     for (auto v_itr = dt.finite_vertices_begin();
+                          v_itr != dt.finite_vertices_end(); v_itr++) {
+                       seam[v_itr->info()] = 1;
+                     }
+                     continue;
+                   }
+                   for (auto f_itr = dt.all_faces_begin();
+                        f_itr != dt.all_faces_end(); f_itr++) {
+                     f_itr->info() =
+                         !dt.is_infinite(f_itr) &&
+                         strip_face_is_final(dt, f_itr, bound[s], bound[s + 1]);
+                     if (f_itr->info()) {
+                       kept[s].push_back({{f_itr->vertex(0)->info(),
+                                           f_itr->vertex(1)->info(),
+                                           f_itr->vertex(2)->info()}});
+                       continue;
+                     }
+                     for (int v = 0; v < 3; v++) {
+                       if (!dt.is_infinite(f_itr->vertex(v))) {
+                         seam[f_itr->vertex(v)->info()] = 1;
+                       }
+                     }
+                   }
+                 }
+               },
+               1);
+
+  std::vector<std::pair<Strip_DT::Point, int>> seam_points;
+  for (std::size_t i = 0; i < n; i++) {
+    if (seam[i]) {
+      seam_points.push_back(
+          std::make_pair(Strip_DT::Point(points.x(i), points.y(i)),
+                         static_cast<int>(i)));
+    }
+  }
+  Strip_DT seam_dt;
+  seam_dt.insert(seam_points.begin(), seam_points.end());
+
+  // Keep the seam faces which are not inside the kept faces of the strip
+  // containing their centroid
+  std::vector<std::vector<Strip_DT::Face_handle>> by_strip(strips);
+  for (auto f_itr = seam_dt.finite_faces_begin();
+       f_itr != seam_dt.finite_faces_end(); f_itr++) {
+    double cx = 0.0;
+    for (int v = 0; v < 3; v++) {
+      cx += CGAL::to_double(f_itr->vertex(v)->point().x()) / 3;
+    }
+    const int s = std::upper_bound(bound.begin() + 1, bound.end() - 1, cx) -
+                  (bound.begin() + 1);
+    by_strip[s].push_back(f_itr);
+  }
+  parallel_for(strips,
+               [&](int, std::size_t begin, std::size_t end) {
+                 for (std::size_t s = begin; s < end; s++) {
+                   const Strip_DT &dt = local[s];
+                   Strip_DT::Face_handle hint;
+                   for (const Strip_DT::Face_handle &f : by_strip[s]) {
+                     bool covered = false;
+                     if (dt.dimension() == 2) {
+                       const Strip_DT::Point c = CGAL::centroid(
+                           f->vertex(0)->point(), f->vertex(1)->point(),
+                           f->vertex(2)->point());
+                       hint = dt.locate(c, hint);
+                       covered = !dt.is_infinite(hint) && hint->info();
+                     }
+                     if (!covered) {
+                       kept[strips + s].push_back({{f->vertex(0)->info(),
+                                                    f->vertex(1)->info(),
+                                                    f->vertex(2)->info()}});
+                     }
+                   }
+                 }
+               },
+               1);
+
+  std::size_t total = 0;
+  for (const std::vector<std::array<int, 3>> &k : kept) {
+    total += k.size();
+  }
+  std::vector<std::array<int, 3>> triangles;
+  triangles.reserve(total);
+  for (const std::vector<std::array<int, 3>> &k : kept) {
+    triangles.insert(triangles.end(), k.begin(), k.end());
+  }
+  return triangles;
+}
+
+// Indexed triangulations index the vertices made by assemble_triangulation
+template <typename Tr> void index_bulk_vertices(Tr &) {}
+
+template <typename Tr>
+void index_bulk_vertices(Indexed_triangulation<Tr> &tr) {
+  tr.index_new_vertices();
+}
+
+/* Whether the predicates of Tr's kernel are exact, as those of the filtered
+ * kernels (Epick, Epeck) are, so the strips and the seams agree on every
+ * face. Otherwise the assembled triangulation is validated */
+template <typename Tr>
+struct bulk_exact_predicates
+    : std::integral_constant<bool,
+                             Tr::Geom_traits::Has_filtered_predicates> {};
+
+template <typename Tr>
+void bulk_build(Tr &tr, const point_set &points, const bulk_build_params &,
+                std::true_type) {
+  insert_in_order(tr, points, hilbert_order(points));
+}
+
+template <typename Tr>
+void bulk_build(Tr &tr, const point_set &points,
+                const bulk_build_params &params, std::false_type) {
+  const int strips =
+      params.strips > 0 ? params.strips : parallel_num_threads();
+  if (points.size() < params.strip_min_points || strips < 2) {
+    insert_in_order(tr, points, hilbert_order(points));
+    return;
+  }
+  assemble_triangulation(tr, points, strip_delaunay_triangles(points, strips));
+  if (tr.number_of_vertices() == 0) {
+    // every point on a line, so there were no faces to assemble
+    insert_in_order(tr, points, hilbert_order(points));
+  } else if (!bulk_exact_predicates<Tr>::value && !tr.is_valid()) {
+    HOT_WARN("the strips of " << points.size()
+             << " points don't merge into a Delaunay triangulation with "
+                "inexact predicates, inserting them serially");
+    tr.clear();
+    insert_in_order(tr, points, hilbert_order(points));
+  }
+  index_bulk_vertices(tr);
+}
+
+/* Builds tr (cleared first) from the points. Weighted triangulations, and
+ * small inputs, are built by inserting in parallel computed Hilbert order;
+ * large unweighted inputs are built in strips by strip_delaunay_triangles,
+ * so Tr must then be a Delaunay triangulation (DT or Indexed_DT). Without
+ * exact predicates the strip result is checked with is_valid, and built
+ * serially if it fails */
+template <typename Tr>
+void bulk_build(Tr &tr, const point_set &points,
+                const bulk_build_params &params = bulk_build_params()) {
+  tr.clear();
+  bulk_build(tr, points, params, bulk_weighted<Tr>());
+}
+
+/* Rebuilds tr from the points of a checkpoint by bulk insertion. The new
+ * triangulation iterates its vertices in an order of its own; see
+ * reorder_checkpoint */
+template <typename Tr>
+void restore_triangulation(Tr &tr, const checkpoint &c,
+                           const bulk_build_params &params = bulk_build_params()) {
+  bulk_build(tr, c.points, params);
+}
+
+#endif // _BULK_BUILD_HPP_
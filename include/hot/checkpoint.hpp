@@ -0,0 +1,313 @@
+// checkpoint.hpp
+// snapshots of long optimizations, written atomically by a background
+// thread, and the rebuild of a triangulation from one
+#ifndef _CHECKPOINT_HPP_
+#define _CHECKPOINT_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "hilbert_order.hpp"
+#include "log.hpp"
+#include "point_io.hpp"
+
+/* The state of a solver between two iterations. Which fields are used is up
+ * to the solver; solver names it, so a run doesn't resume another's state */
+struct checkpoint {
+  std::string solver;
+  std::int64_t iteration = 0;
+  // of the random input, 0 if there was none
+  std::uint64_t seed = 0;
+  // vertex positions, with the weights when the stride is 3
+  point_set points;
+  // L-BFGS pairs, oldest first, 2 entries per point, and 1 / (s . y)
+  std::vector<std::vector<double>> history_s, history_y;
+  std::vector<double> history_rho;
+  // anything else, such as the energy of the previous iteration
+  std::vector<double> scalars;
+};
+
+// Binary layout: magic, then the fields in order as native values. Strings
+// and arrays are preceded by their length as a uint64, and the L-BFGS pairs
+// by their count and length
+constexpr const char checkpoint_file_magic[8] = {'H', 'O', 'T', 'C',
+                                                 'K', 'P', '2', '\0'};
+
+namespace checkpoint_detail {
+
+inline bool put(std::FILE *f, const void *data, std::size_t size) {
+  return size == 0 || std::fwrite(data, size, 1, f) == 1;
+}
+
+inline bool put_size(std::FILE *f, std::uint64_t size) {
+  return put(f, &size, sizeof(size));
+}
+
+inline bool put_doubles(std::FILE *f, const std::vector<double> &v) {
+  return put_size(f, v.size()) && put(f, v.data(), v.size() * sizeof(double));
+}
+
+inline bool get(std::FILE *f, void *data, std::size_t size) {
+  return size == 0 || std::fread(data, size, 1, f) == 1;
+}
+
+// sizes are checked against what is left of the file before allocating
+inline bool get_size(std::FILE *f, long remaining, std::size_t element,
+                     std::uint64_t &size) {
+  return get(f, &size, sizeof(size)) && size <= std::uint64_t(remaining) / element;
+}
+
+inline long remaining(std::FILE *f, long end) { return end - std::ftell(f); }
+
+inline bool get_doubles(std::FILE *f, long end, std::vector<double> &v) {
+  std::uint64_t size;
+  if (!get_size(f, remaining(f, end), sizeof(double), size)) {
+    return false;
+  }
+  v.resize(size);
+  return get(f, v.data(), size * sizeof(double));
+}
+
+} // namespace checkpoint_detail
+
+/* Writes c to path + ".tmp", syncs it, and renames it over path, so path
+ * always holds a whole checkpoint, the old one or the new */
+inline bool write_checkpoint(const std::string &path, const checkpoint &c) {
+  using namespace checkpoint_detail;
+  const std::string tmp = path + ".tmp";
+  std::FILE *f = std::fopen(tmp.c_str(), "wb");
+  if (f == nullptr) {
+    HOT_WARN("can't write " << tmp);
+    return false;
+  }
+  const std::uint32_t stride = c.points.stride;
+  bool written = put(f, checkpoint_file_magic, sizeof(checkpoint_file_magic)) &&
+                 put_size(f, c.solver.size()) &&
+                 put(f, c.solver.data(), c.solver.size()) &&
+                 put(f, &c.iteration, sizeof(c.iteration)) &&
+                 put(f, &c.seed, sizeof(c.seed)) &&
+                 put(f, &stride, sizeof(stride)) &&
+                 put_doubles(f, c.points.coords) &&
+                 put_size(f, c.history_s.size());
+  for (std::size_t k = 0; written && k < c.history_s.size(); k++) {
+    written = put_doubles(f, c.history_s[k]) && put_doubles(f, c.history_y[k]);
+  }
+  written = written && put_doubles(f, c.history_rho) &&
+            put_doubles(f, c.scalars) && std::fflush(f) == 0 &&
+            ::fsync(::fileno(f)) == 0;
+  written = std::fclose(f) == 0 && written;
+  if (!written || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    HOT_WARN("can't write " << path);
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+inline bool read_checkpoint(const std::string &path, checkpoint &c) {
+  using namespace checkpoint_detail;
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    return false;
+  }
+  std::fseek(f, 0, SEEK_END);
+  const long end = std::ftell(f);
+  std::fseek(f, 0, SEEK_SET);
+  char magic[sizeof(checkpoint_file_magic)];
+  std::uint64_t length = 0, pairs = 0;
+  std::uint32_t stride = 0;
+  bool read = get(f, magic, sizeof(magic)) &&
+              std::memcmp(magic, checkpoint_file_magic, sizeof(magic)) == 0 &&
+              get_size(f, remaining(f, end), 1, length);
+  if (read) {
+    c.solver.resize(length);
+    read = get(f, &c.solver[0], length) &&
+           get(f, &c.iteration, sizeof(c.iteration)) &&
+           get(f, &c.seed, sizeof(c.seed)) &&
+           get(f, &stride, sizeof(stride)) && (stride == 2 || stride == 3) &&
+           get_doubles(f, end, c.points.coords) &&
+           get_size(f, remaining(f, end), 2 * sizeof(std::uint64_t), pairs);
+  }
+  if (read) {
+    c.points.stride = stride;
+    c.history_s.resize(pairs);
+    c.history_y.resize(pairs);
+  }
+  for (std::uint64_t k = 0; read && k < pairs; k++) {
+    read = get_doubles(f, end, c.history_s[k]) &&
+           get_doubles(f, end, c.history_y[k]);
+  }
+  read = read && get_doubles(f, end, c.history_rho) &&
+         get_doubles(f, end, c.scalars);
+  std::fclose(f);
+  if (!read) {
+    HOT_WARN(path << " is not a checkpoint");
+  }
+  return read;
+}
+
+/* Writes the checkpoints of one run to path from a background thread, so a
+ * solver only pays for copying its state. A checkpoint submitted while the
+ * last is still being written replaces any other one waiting: only the
+ * newest state is worth keeping */
+class checkpoint_writer {
+public:
+  explicit checkpoint_writer(const std::string &path,
+                             double interval_seconds = 600)
+      : path_(path), interval_(interval_seconds),
+        last_(std::chrono::steady_clock::now()),
+        thread_(&checkpoint_writer::run, this) {}
+
+  checkpoint_writer(const checkpoint_writer &) = delete;
+  checkpoint_writer &operator=(const checkpoint_writer &) = delete;
+
+  /* Writes the checkpoint still waiting, if any */
+  ~checkpoint_writer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+  }
+
+  const std::string &path() const { return path_; }
+
+  /* Whether interval_seconds have passed since the last submit */
+  bool due() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         last_)
+               .count() >= interval_;
+  }
+
+  void submit(checkpoint c) {
+    last_ = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_ = std::move(c);
+      has_pending_ = true;
+    }
+    changed_.notify_all();
+  }
+
+  /* Waits until every submitted checkpoint is written. False if any write
+   * since the last flush failed */
+  bool flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return !has_pending_ && !writing_; });
+    const bool ok = ok_;
+    ok_ = true;
+    return ok;
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      changed_.wait(lock, [this] { return has_pending_ || stop_; });
+      if (!has_pending_) {
+        return;
+      }
+      checkpoint c = std::move(pending_);
+      has_pending_ = false;
+      writing_ = true;
+      lock.unlock();
+      const bool written = write_checkpoint(path_, c);
+      lock.lock();
+      ok_ = ok_ && written;
+      writing_ = false;
+      changed_.notify_all();
+    }
+  }
+
+  std::string path_;
+  double interval_;
+  std::chrono::steady_clock::time_point last_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  checkpoint pending_;
+  bool has_pending_ = false, writing_ = false, stop_ = false, ok_ = true;
+  // last, so it starts after everything it uses
+  std::thread thread_;
+};
+
+template <typename Tr>
+void append_checkpoint_point(const typename Tr::Vertex::Point &p,
+                             std::vector<double> &coords, std::false_type) {
+  coords.push_back(CGAL::to_double(p.x()));
+  coords.push_back(CGAL::to_double(p.y()));
+}
+
+template <typename Tr>
+void append_checkpoint_point(const typename Tr::Vertex::Point &p,
+                             std::vector<double> &coords, std::true_type) {
+  coords.push_back(CGAL::to_double(p.point().x()));
+  coords.push_back(CGAL::to_double(p.point().y()));
+  coords.push_back(CGAL::to_double(p.weight()));
+}
+
+/* The finite vertices of tr in iteration order, with their weights if tr is
+ * weighted */
+template <typename Tr> point_set checkpoint_points(const Tr &tr) {
+  point_set points;
+  points.stride = bulk_weighted<Tr>::value ? 3 : 2;
+  points.coords.reserve(points.stride * tr.number_of_vertices());
+  for (auto v_itr = tr.finite_vertices_begin();
+       v_itr != tr.finite_vertices_end(); v_itr++) {
+    append_checkpoint_point<Tr>(v_itr->point(), points.coords,
+                                bulk_weighted<Tr>());
+  }
+  return points;
+}
+
+/* For each point of x (x, y pairs) the index of the checkpoint point in the
+ * same place, or an empty vector if some point has none */
+inline std::vector<int> checkpoint_order(const checkpoint &c,
+                                         const std::vector<double> &x) {
+  std::map<std::pair<double, double>, int> index;
+  for (std::size_t i = 0; i < c.points.size(); i++) {
+    index[std::make_pair(c.points.x(i), c.points.y(i))] = i;
+  }
+  std::vector<int> order(x.size() / 2);
+  for (std::size_t i = 0; i < order.size(); i++) {
+    auto found = index.find(std::make_pair(x[2 * i], x[2 * i + 1]));
+    if (found == index.end()) {
+      return std::vector<int>();
+    }
+    order[i] = found->second;
+  }
+  return order;
+}
+
+/* c with its points and L-BFGS pairs permuted so that point i is the old
+ * point order[i] */
+inline checkpoint reorder_checkpoint(const checkpoint &c,
+                                     const std::vector<int> &order) {
+  checkpoint r = c;
+  const int stride = c.points.stride;
+  for (std::size_t i = 0; i < order.size(); i++) {
+    for (int j = 0; j < stride; j++) {
+      r.points.coords[stride * i + j] = c.points.coords[stride * order[i] + j];
+    }
+    for (std::size_t k = 0; k < c.history_s.size(); k++) {
+      for (int j = 0; j < 2; j++) {
+        r.history_s[k][2 * i + j] = c.history_s[k][2 * order[i] + j];
+        r.history_y[k][2 * i + j] = c.history_y[k][2 * order[i] + j];
+      }
+    }
+  }
+  return r;
+}
+
+#endif // _CHECKPOINT_HPP_
@@ -85,10 +85,9 @@ double tri_energy(const Triangle &tri){
 //Unless you know triangulation is DT, energy_density_TMethod should not be used. TMethod=Triangle Method. This means energy is computed without regard for neighboring triangles, which in general, is not correct. 
 
 // The TMethod (triangle method) does not handle boundary as in the paper. In the code below, boundary edge can make negative contribution to energy. 
-//template<typename T>
-template<int Wk, int star>
-double energy_density_TMethod(const DT &t){
-//double energy_density_TMethod(const T &t, int Wk, int star){
+// T is DT, or a mesh with given connectivity on the same data structure (Mesh_T in mesh_io.hpp)
+template<int Wk, int star, typename T>
+double energy_density_TMethod(const T &t){
   	double energy = 0;
  
   	for(auto face_itr = t.finite_faces_begin(); face_itr != t.finite_faces_end(); face_itr++) {
@@ -104,8 +103,9 @@ double energy_density_TMethod(const DT &t){
 
 
 // bool=false means we use the appendix formulas. bool=true means we use our corrected formulas
-template<int Wk, int star>
-double energy_density_EMethod(const DT &dt, bool corrected_formulas){
+// T is DT or Mesh_T, as for energy_density_TMethod. Edges with an infinite face on one side are boundary edges
+template<int Wk, int star, typename T>
+double energy_density_EMethod(const T &dt, bool corrected_formulas){
   	double energy = 0;
 	
 	int edgenum=0; 
@@ -122,7 +122,7 @@ double energy_density_EMethod(const DT &dt, bool corrected_formulas){
 				finite_tri=face_to_tri(*(ei->first));
 				index_opp_vertex=ei->second;
 			}
-			else{	Edge mirror_ei=dt.mirror_edge(*ei);
+			else{	typename T::Edge mirror_ei=dt.mirror_edge(*ei);
 				index_opp_vertex=mirror_ei.second;
 				finite_tri=face_to_tri(*(mirror_ei.first));
 				
@@ -143,7 +143,7 @@ double energy_density_EMethod(const DT &dt, bool corrected_formulas){
 			Face face1 = *(ei->first); 
     			int index_opp_edge_1 = ei->second;
 			
-			Edge mirror_ei=dt.mirror_edge(*ei); 
+			typename T::Edge mirror_ei=dt.mirror_edge(*ei); 
 			Face face2=*(mirror_ei.first);
 			int index_opp_edge_2=mirror_ei.second;
 	
@@ -190,8 +190,8 @@ double tri_energy_divideArea(const Triangle &tri, int area_pow){
 }
 
 
-template<int Wk, int star>
-double HOTenergy_divideByTriangleArea(const DT &t, int area_pow){
+template<int Wk, int star, typename T>
+double HOTenergy_divideByTriangleArea(const T &t, int area_pow){
   	double energy = 0;
  
   	for(auto face_itr = t.finite_faces_begin(); face_itr != t.finite_faces_end(); face_itr++) {
@@ -202,4 +202,101 @@ double HOTenergy_divideByTriangleArea(const DT &t, int area_pow){
 
   return energy;
 }
+
+//////////////////////////////////////////////////////////////////////
+//////////////////   SEVERAL ENERGIES IN ONE PASS ////////////////////////
+/////////////////////////////////////////////////////////////////////////
+
+// What the triangle energies are made of. h[k] and d[k] are signed_dist_circumcenters(tri,k) and half the length of the edge opposite vertex k, 
+// d3h=sum_k d[k]^3 h[k] and dh3=sum_k d[k] h[k]^3, so each *star-HOT energy is two multiply-adds on top of them
+struct triangle_measures{
+	double h[3]; 
+	double d[3]; 
+	double d3h; 
+	double dh3; 
+	double area; 
+	double perimeter; 
+	double sq_dist_circumcenter_centroid; 
+};
+
+inline
+triangle_measures measure_triangle(const Triangle &tri){
+	triangle_measures m;
+	const double x[3]={tri.vertex(0).x(), tri.vertex(1).x(), tri.vertex(2).x()};
+	const double y[3]={tri.vertex(0).y(), tri.vertex(1).y(), tri.vertex(2).y()};
+	const double cross=(x[1]-x[0])*(y[2]-y[0])-(y[1]-y[0])*(x[2]-x[0]); 
+	m.area=0.5*std::abs(cross);
+	m.d3h=0; 
+	m.dh3=0; 
+	for(int k=0; k<3; k++){
+		const int i=(k+1)%3, j=(k+2)%3; 
+		const double dot=(x[i]-x[k])*(x[j]-x[k])+(y[i]-y[k])*(y[j]-y[k]); 
+		m.d[k]=0.5*std::hypot(x[j]-x[i], y[j]-y[i]); 
+		// h_k = |e_ij| cot(theta_k)/2, with |a x b| = 2*area
+		m.h[k]=0.5*m.d[k]*dot/m.area; 
+		m.d3h+=m.d[k]*m.d[k]*m.d[k]*m.h[k]; 
+		m.dh3+=m.d[k]*m.h[k]*m.h[k]*m.h[k];
+	}
+	m.perimeter=2*(m.d[0]+m.d[1]+m.d[2]); 
+
+	// circumcenter relative to vertex 0, minus the centroid 
+	const double r1x=x[1]-x[0], r1y=y[1]-y[0], r2x=x[2]-x[0], r2y=y[2]-y[0]; 
+	const double r1sq=r1x*r1x+r1y*r1y, r2sq=r2x*r2x+r2y*r2y; 
+	const double cx=(r2y*r1sq-r1y*r2sq)/(2*cross)-(r1x+r2x)/3; 
+	const double cy=(r1x*r2sq-r2x*r1sq)/(2*cross)-(r1y+r2y)/3; 
+	m.sq_dist_circumcenter_centroid=cx*cx+cy*cy; 
+	return m;
+}
+
+// Energy variants for tri_energies. Each has a static energy(const triangle_measures &)
+
+// tri_energy<Wk,star>
+template<int Wk, int star>
+struct star_energy;
+
+template<>
+struct star_energy<2,0>{
+	static double energy(const triangle_measures &m){ return m.d3h/2+m.dh3/6; }
+};
+
+template<>
+struct star_energy<2,1>{
+	static double energy(const triangle_measures &m){ return (2.0/3)*(m.d3h+m.dh3); }
+};
+
+template<>
+struct star_energy<2,2>{
+	static double energy(const triangle_measures &m){ return m.d3h/6+m.dh3/2; }
+};
+
+// tri_energy_divideArea<Wk,star>(tri, area_pow)
+template<int Wk, int star, int area_pow>
+struct star_energy_divideArea{
+	static double energy(const triangle_measures &m){ return star_energy<Wk,star>::energy(m)/pow(m.area, area_pow); }
+};
+
+// triangle_Sb(tri, circumcenter, 2, 1), Sb with the powers of the paper
+struct Sb_energy{
+	static double energy(const triangle_measures &m){ return m.area*m.sq_dist_circumcenter_centroid; }
+};
+
+// triangle_Sb_divide_perim4(tri, circumcenter)
+struct Sb_divide_perim4_energy{
+	static double energy(const triangle_measures &m){ return m.area*m.sq_dist_circumcenter_centroid/pow(m.perimeter, 4); }
+};
+
+// All the Energies of tri, in order, from one measure_triangle. For example
+//   std::array<double,3> e=tri_energies<star_energy<2,0>, star_energy<2,1>, star_energy<2,2>>(tri);
+// gives tri_energy<2,0>, <2,1> and <2,2> of tri
+template<typename... Energies>
+std::array<double, sizeof...(Energies)> tri_energies(const Triangle &tri){
+	const triangle_measures m=measure_triangle(tri);
+	return {{Energies::energy(m)...}};
+}
+
+// The *0, *1 and *2 HOT_2 energies of tri, which the experiments compare side by side
+inline
+std::array<double,3> tri_energies_all_stars(const Triangle &tri){
+	return tri_energies<star_energy<2,0>, star_energy<2,1>, star_energy<2,2>>(tri);
+}
 #endif
@@ -1,6 +1,9 @@
 #ifndef _ENERGYWEIGHTS_HPP_
 #define _ENERGYWEIGHTS_HPP_
 
+#include "log.hpp"
+#include "wcirc_batch.hpp"
+
 /////////////////////////////////////////////////////////////////////////
 //////////////////////////   Energy for weighted triangulations ////////
 ////////////////////////////////////////////////////////////////
@@ -8,98 +11,175 @@
 double triangle_energy_weights_dividebyArea(const weighted_Face_handle &face, const Point &wcirc, int Wk, int star);
 double triangle_energy_weights(const weighted_Face_handle &face, const Point &wcirc, int Wk, int star);
 
+// constant1 and constant2 of the subtriangle energy d^3 h/constant1 + d h^3/constant2 for each star
+template<int Wk, int star>
+struct weighted_star_constant;
+
+template<>
+struct weighted_star_constant<2,0>{
+	static constexpr double constant1=4.0;
+	static constexpr double constant2=12.0;
+};
+
+template<>
+struct weighted_star_constant<2,1>{
+	static constexpr double constant1=3.0;
+	static constexpr double constant2=3.0;
+};
+
+template<>
+struct weighted_star_constant<2,2>{
+	static constexpr double constant1=12.0;
+	static constexpr double constant2=4.0;
+};
+
+// energy of one half of the subtriangle of edge ij, with dij the (power) distance from xi to the dual edge, and hk the signed height of the weighted circumcenter
+template<int Wk, int star>
+inline double subtri_energy_weights(double dij, double hk){
+	const double dij3=dij*dij*dij;
+	const double hk3=hk*hk*hk;
+	return dij3*hk/weighted_star_constant<Wk,star>::constant1+dij*hk3/weighted_star_constant<Wk,star>::constant2;
+}
+
+// partial derivatives of subtri_energy_weights with respect to dij and hk
+template<int Wk, int star>
+inline void subtri_energy_weights_deriv(double dij, double hk, double &dE_ddij, double &dE_dhk){
+	const double dij2=dij*dij;
+	const double hk2=hk*hk;
+	dE_ddij=3*dij2*hk/weighted_star_constant<Wk,star>::constant1+hk2*hk/weighted_star_constant<Wk,star>::constant2;
+	dE_dhk=dij2*dij/weighted_star_constant<Wk,star>::constant1+3*dij*hk2/weighted_star_constant<Wk,star>::constant2;
+}
+
+// energy of the face (x[i], y[i]) with weights w[i] and weighted circumcenter (cx, cy)
+template<int Wk, int star>
+double triangle_energy_weights(const double x[3], const double y[3], const double w[3], double cx, double cy){
+	double energy=0; 
+
+	for(int i=0; i<3; i++)
+  {
+    const int j=(i+1) % 3;
+    const int k=(i+2) % 3;
+
+		const double xi=x[i], yi=y[i];
+		const double tx=x[j]-xi, ty=y[j]-yi;
+		const double kx=x[k]-xi, ky=y[k]-yi;
+
+		const double length_eij2=tx*tx+ty*ty;
+		const double length_eij=std::sqrt(length_eij2);
+		const double inv_2length=0.5/length_eij;
+
+		const double dij=(length_eij2-w[i]+w[j])*inv_2length;
+		const double dji=(length_eij2-w[j]+w[i])*inv_2length;
+
+		// signed distance of wcirc from eij, positive on the same side as xk
+		const double cross_c=tx*(cy-yi)-ty*(cx-xi);
+		const double cross_k=tx*ky-ty*kx;
+		const double hk=((cross_k>0)==(cross_c>0) ? std::abs(cross_c) : -std::abs(cross_c))/length_eij;
+
+		energy+=subtri_energy_weights<Wk,star>(dij,hk);
+		energy+=subtri_energy_weights<Wk,star>(dji,hk);
+	}
+	return energy; 
+}
+
+template<int Wk, int star>
+double triangle_energy_weights_dividebyArea(const double x[3], const double y[3], const double w[3], double cx, double cy){
+	return triangle_energy_weights<Wk,star>(x,y,w,cx,cy)/triangle_area_kernel(x,y); 
+}
+
+// the vertices and weights of face
+inline void weighted_face_vertices(const weighted_Face_handle &face, double x[3], double y[3], double w[3]){
+	for(int i=0; i<3; i++){
+		const auto &p=face->vertex(i)->point();
+		x[i]=CGAL::to_double(p.x());
+		y[i]=CGAL::to_double(p.y());
+		w[i]=CGAL::to_double(p.weight());
+	}
+}
+
+template<int Wk, int star>
+double triangle_energy_weights(const weighted_Face_handle &face, const Point &wcirc){
+	double x[3], y[3], w[3];
+	weighted_face_vertices(face,x,y,w);
+	return triangle_energy_weights<Wk,star>(x,y,w,CGAL::to_double(wcirc.x()),CGAL::to_double(wcirc.y()));
+}
+
+template<int Wk, int star>
+double triangle_energy_weights_dividebyArea(const weighted_Face_handle &face, const Point &wcirc){
+	double x[3], y[3], w[3];
+	weighted_face_vertices(face,x,y,w);
+	return triangle_energy_weights_dividebyArea<Wk,star>(x,y,w,CGAL::to_double(wcirc.x()),CGAL::to_double(wcirc.y()));
+}
+
+// Runtime dispatch for callers passing Wk and star as ints. Only Wk=2 is implemented, so the tables are indexed by star.
+// The faces are given by their vertices, weights and weighted circumcenter, as the batches hold them
+typedef double (*triangle_energy_weights_function)(const double x[3], const double y[3], const double w[3], double cx, double cy);
+
+const triangle_energy_weights_function triangle_energy_weights_table[3]={
+	&triangle_energy_weights<2,0>, &triangle_energy_weights<2,1>, &triangle_energy_weights<2,2>};
+
+const triangle_energy_weights_function triangle_energy_weights_dividebyArea_table[3]={
+	&triangle_energy_weights_dividebyArea<2,0>, &triangle_energy_weights_dividebyArea<2,1>, &triangle_energy_weights_dividebyArea<2,2>};
+
+// star values other than 0 and 1 have always been treated as star 2
+inline int weighted_star_index(int star){
+	return (star==0 || star==1) ? star : 2;
+}
+
 template<typename T>
 double energy_weights(const T &t, int Wk, int star){
-  	double energy = 0;
-
-  	for(auto face_itr = t.finite_faces_begin(); face_itr != t.finite_faces_end(); face_itr++) {
-		Point wcirc=t.weighted_circumcenter(face_itr);
-    		energy+=triangle_energy_weights(face_itr,wcirc, Wk,star);
- 	 }
+	if(Wk!=2){
+		HOT_WARN("energy_weights returning bogus answer because Wk was not 2");
+		return -1;
+	}  
+	const triangle_energy_weights_function face_energy=triangle_energy_weights_table[weighted_star_index(star)];
+	const weighted_face_batch<T> batch=weighted_faces(t);
+	double energy=parallel_sum(batch.size(), [&](std::size_t i){
+		double x[3], y[3], w[3];
+		batch.vertices(i,x,y,w);
+		return face_energy(x,y,w,batch.cx[i],batch.cy[i]);
+	});
 
   return energy;
 }
 
 template<typename T>
 double energy_weights_dividebyArea(const T &t, int Wk, int star){
-  	double energy = 0;
-
-  	for(auto face_itr = t.finite_faces_begin(); face_itr != t.finite_faces_end(); face_itr++) {
-		Point wcirc=t.weighted_circumcenter(face_itr);
-    		energy+=triangle_energy_weights_dividebyArea(face_itr,wcirc,Wk,star);
- 	 }
+	if(Wk!=2){
+		HOT_WARN("energy_weights_dividebyArea returning bogus answer because Wk was not 2");
+		return -1;
+	}  
+	const triangle_energy_weights_function face_energy=triangle_energy_weights_dividebyArea_table[weighted_star_index(star)];
+	const weighted_face_batch<T> batch=weighted_faces(t);
+	double energy=parallel_sum(batch.size(), [&](std::size_t i){
+		double x[3], y[3], w[3];
+		batch.vertices(i,x,y,w);
+		return face_energy(x,y,w,batch.cx[i],batch.cy[i]);
+	});
   return energy;
 }
 
 
 double triangle_energy_weights(const weighted_Face_handle &face, const Point &wcirc, int Wk, int star){
 	if(Wk!=2){
-		std::cout<<"Warning: triangle_energy_weights returning bogus answer because Wk was not 2"<<std::endl;
+		HOT_WARN("triangle_energy_weights returning bogus answer because Wk was not 2");
 		return -1;
 	}  
-	double energy=0; 
-
-	double constant1;
-	double constant2; 
-
-	if(star==0){
-		constant1=4.0;
-		constant2=12.0; 
-	}
-	else if(star==1){
-		constant1=3.0; 
-		constant2=3.0;
-	}
-	else{
-		constant1=12.0; 
-		constant2=4.0;
-
-	}
-	
-	
-	for(int i=0; i<3; i++)
-  {
-    const auto ip1 = (i+1) % 3;
-    const auto ip2 = (i+2) % 3;
-    auto wi = face->vertex(i  )->point();
-    auto wj = face->vertex(ip1)->point();
-    auto wk = face->vertex(ip2)->point();
-    
-		const double weighti=wi.weight();
-		const double weightj=wj.weight();
-	
-    Point xi(wi);
-    Point xj(wj);
-    Point xk(wk);
-
-		const double length_eij=sqrt(pow(xi.x()-xj.x(),2.0)+pow(xi.y()-xj.y(),2.0));
-
-		const double dij= (pow(length_eij,2) -weighti+weightj)/(2*length_eij);
-		const double dji= (pow(length_eij,2) -weightj+weighti)/(2*length_eij);
-		
-		const double unsigned_hk=abs((xj.y()-xi.y())*wcirc.x() - (xj.x()-xi.x())*wcirc.y() +xj.x()*xi.y()-xj.y()*xi.x())/length_eij;
-    double hk = (CGAL::orientation(xi,xj,xk)==CGAL::orientation(xi,xj,wcirc) ? unsigned_hk : -1.0*unsigned_hk);
-		
-		energy+=pow(dij,3)*hk/constant1+dij*pow(hk,3)/constant2;
-		energy+=pow(dji,3)*hk/constant1+dji*pow(hk,3)/constant2;
-	}
-	return energy; 
+	double x[3], y[3], w[3];
+	weighted_face_vertices(face,x,y,w);
+	return triangle_energy_weights_table[weighted_star_index(star)](x,y,w,CGAL::to_double(wcirc.x()),CGAL::to_double(wcirc.y()));
 }
 
 
-
-
 double triangle_energy_weights_dividebyArea(const weighted_Face_handle &face, const Point &wcirc, int Wk, int star){
 	
 	if(Wk!=2){
-		std::cout<<"Warning:triangle_energy_weights_dividedbyArea returning bogus answer because Wk was not 2"<<std::endl;
+		HOT_WARN("triangle_energy_weights_dividedbyArea returning bogus answer because Wk was not 2");
 		return -1;
 	}  
-	
-	Triangle tri=Triangle(Point(face->vertex(0)->point()), Point(face->vertex(1)->point()), Point(face->vertex(2)->point()));
-	double face_area =std::abs(tri.area()); 	
-	
-	return triangle_energy_weights(face,wcirc, Wk, star)/face_area; 
+	double x[3], y[3], w[3];
+	weighted_face_vertices(face,x,y,w);
+	return triangle_energy_weights_dividebyArea_table[weighted_star_index(star)](x,y,w,CGAL::to_double(wcirc.x()),CGAL::to_double(wcirc.y()));
 }
 
 #endif
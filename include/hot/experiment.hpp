@@ -0,0 +1,361 @@
+// experiment.hpp
+// parameter sweeps of the energy of a patch, described by a spec file (see
+// spec.hpp and examples/experiments) instead of compiled into an executable
+#ifndef _EXPERIMENT_HPP_
+#define _EXPERIMENT_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <CGAL/Polygon_2_algorithms.h>
+
+#include "hot.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+#include "result_sink.hpp"
+#include "spec.hpp"
+
+using triangle_energy_function = double (*)(const triangle_measures &);
+
+/* The triangle energy with the given spec name, or null */
+inline triangle_energy_function find_triangle_energy(const std::string &name) {
+  static const struct {
+    const char *name;
+    triangle_energy_function energy;
+  } energies[] = {
+      {"star0", &star_energy<2, 0>::energy},
+      {"star1", &star_energy<2, 1>::energy},
+      {"star2", &star_energy<2, 2>::energy},
+      {"star0_divide_area", &star_energy_divideArea<2, 0, 1>::energy},
+      {"star1_divide_area", &star_energy_divideArea<2, 1, 1>::energy},
+      {"star2_divide_area", &star_energy_divideArea<2, 2, 1>::energy},
+      {"Sb", &Sb_energy::energy},
+      {"Sb_divide_perim4", &Sb_divide_perim4_energy::energy},
+  };
+  for (const auto &e : energies) {
+    if (name == e.name) {
+      return e.energy;
+    }
+  }
+  return nullptr;
+}
+
+/* One coordinate of one free vertex, taking start, start + step, ... while
+ * below stop */
+struct sweep_axis {
+  int vertex = 0;
+  int coordinate = 0;
+  double start = 0, stop = 0, step = 1;
+
+  std::size_t size() const {
+    return stop > start ? static_cast<std::size_t>(
+                              std::ceil((stop - start) / step - 1e-9))
+                        : 0;
+  }
+  double value(std::size_t i) const { return start + i * step; }
+};
+
+struct experiment {
+  enum mesh_kind {
+    fan_mesh,      // (polygon[i], polygon[i + 1], free vertex 0)
+    delaunay_mesh, // Delaunay triangulation of all the vertices
+    given_mesh     // triangles, indexing polygon then free vertices
+  };
+
+  std::string name;
+  std::vector<Point> polygon;
+  std::vector<Point> free_vertices;
+  mesh_kind mesh = fan_mesh;
+  std::vector<std::array<int, 3>> triangles;
+  // the grid is every combination of the axis values, the last axis fastest
+  std::vector<sweep_axis> sweep;
+  // skip grid points with a free vertex outside the polygon
+  bool inside_only = true;
+  std::vector<std::string> energy_names;
+  std::vector<triangle_energy_function> energies;
+  std::string output;
+  // "text" or "columnar", see result_sink.hpp
+  std::string format = "text";
+
+  std::size_t num_rows() const {
+    std::size_t rows = 1;
+    for (const sweep_axis &axis : sweep) {
+      rows *= axis.size();
+    }
+    return rows;
+  }
+
+  // axis values, then energies
+  std::size_t num_columns() const { return sweep.size() + energies.size(); }
+
+  std::vector<std::string> column_names() const {
+    std::vector<std::string> names;
+    for (const sweep_axis &axis : sweep) {
+      names.push_back((axis.coordinate == 0 ? "x" : "y") +
+                      std::to_string(axis.vertex));
+    }
+    names.insert(names.end(), energy_names.begin(), energy_names.end());
+    return names;
+  }
+};
+
+inline bool spec_point(const spec_value &value, Point &p) {
+  if (!value.is_array() || value.items.size() != 2 ||
+      !value.items[0].is_number() || !value.items[1].is_number()) {
+    return false;
+  }
+  p = Point(value.items[0].number, value.items[1].number);
+  return true;
+}
+
+inline bool spec_points(const spec_value *value, std::vector<Point> &points) {
+  if (value == nullptr || !value->is_array()) {
+    return false;
+  }
+  points.resize(value->items.size());
+  for (std::size_t i = 0; i < points.size(); i++) {
+    if (!spec_point(value->items[i], points[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Fills e from a spec such as examples/experiments/exp4a_hex_patch.json.
+ * Reports the first problem and returns false if the spec is incomplete */
+inline bool experiment_from_spec(const spec_value &spec, experiment &e) {
+  if (!spec.is_object()) {
+    HOT_WARN("an experiment spec is an object");
+    return false;
+  }
+  const spec_value *name = spec.find("name");
+  e.name = name != nullptr && name->is_string() ? name->string : "experiment";
+  if (!spec_points(spec.find("polygon"), e.polygon) || e.polygon.size() < 3) {
+    HOT_WARN(e.name << ": polygon should be a list of at least 3 [x, y]");
+    return false;
+  }
+  if (!spec_points(spec.find("free_vertices"), e.free_vertices) ||
+      e.free_vertices.empty()) {
+    HOT_WARN(e.name << ": free_vertices should be a list of [x, y]");
+    return false;
+  }
+  const int num_vertices = e.polygon.size() + e.free_vertices.size();
+
+  const spec_value *mesh = spec.find("mesh");
+  e.triangles.clear();
+  if (mesh == nullptr || (mesh->is_string() && mesh->string == "fan")) {
+    e.mesh = experiment::fan_mesh;
+    if (e.free_vertices.size() != 1) {
+      HOT_WARN(e.name << ": a fan mesh has one free vertex");
+      return false;
+    }
+  } else if (mesh->is_string() && mesh->string == "delaunay") {
+    e.mesh = experiment::delaunay_mesh;
+  } else if (mesh->is_array()) {
+    e.mesh = experiment::given_mesh;
+    for (const spec_value &t : mesh->items) {
+      std::array<int, 3> triangle;
+      bool valid = t.is_array() && t.items.size() == 3;
+      for (int v = 0; valid && v < 3; v++) {
+        valid = t.items[v].is_number() && t.items[v].number >= 0 &&
+                t.items[v].number < num_vertices &&
+                t.items[v].number == std::floor(t.items[v].number);
+        triangle[v] = valid ? static_cast<int>(t.items[v].number) : 0;
+      }
+      if (!valid) {
+        HOT_WARN(e.name << ": mesh triangles are [i, j, k] with 0 <= i < "
+                        << num_vertices);
+        return false;
+      }
+      e.triangles.push_back(triangle);
+    }
+  } else {
+    HOT_WARN(e.name << ": mesh should be \"fan\", \"delaunay\" or a list of "
+                       "triangles");
+    return false;
+  }
+
+  const spec_value *sweep = spec.find("sweep");
+  e.sweep.clear();
+  if (sweep == nullptr || !sweep->is_array()) {
+    HOT_WARN(e.name << ": sweep should be a list of axes");
+    return false;
+  }
+  for (const spec_value &a : sweep->items) {
+    sweep_axis axis;
+    const spec_value *vertex = a.find("vertex");
+    axis.vertex = vertex != nullptr && vertex->is_number()
+                      ? static_cast<int>(vertex->number)
+                      : 0;
+    const spec_value *range = a.find("x");
+    axis.coordinate = 0;
+    if (range == nullptr) {
+      range = a.find("y");
+      axis.coordinate = 1;
+    }
+    if (axis.vertex < 0 ||
+        axis.vertex >= static_cast<int>(e.free_vertices.size()) ||
+        range == nullptr || !range->is_array() || range->items.size() != 3 ||
+        !range->items[0].is_number() || !range->items[1].is_number() ||
+        !range->items[2].is_number() || !(range->items[2].number > 0)) {
+      HOT_WARN(e.name << ": a sweep axis is {\"vertex\": v, \"x\" or \"y\": "
+                         "[start, stop, step]} with step > 0");
+      return false;
+    }
+    axis.start = range->items[0].number;
+    axis.stop = range->items[1].number;
+    axis.step = range->items[2].number;
+    e.sweep.push_back(axis);
+  }
+
+  const spec_value *inside_only = spec.find("inside_only");
+  e.inside_only = inside_only == nullptr ||
+                  inside_only->kind != spec_value::bool_kind ||
+                  inside_only->boolean;
+
+  const spec_value *energies = spec.find("energies");
+  e.energy_names.clear();
+  e.energies.clear();
+  if (energies == nullptr || !energies->is_array() || energies->items.empty()) {
+    HOT_WARN(e.name << ": energies should be a list of energy names");
+    return false;
+  }
+  for (const spec_value &n : energies->items) {
+    const triangle_energy_function energy =
+        n.is_string() ? find_triangle_energy(n.string) : nullptr;
+    if (energy == nullptr) {
+      HOT_WARN(e.name << ": unknown energy " << n.string);
+      return false;
+    }
+    e.energy_names.push_back(n.string);
+    e.energies.push_back(energy);
+  }
+
+  const spec_value *output = spec.find("output");
+  e.output = output != nullptr && output->is_string() ? output->string
+                                                       : e.name + ".txt";
+  const spec_value *format = spec.find("format");
+  e.format = format != nullptr && format->is_string() ? format->string : "text";
+  if (e.format != "text" && e.format != "columnar") {
+    HOT_WARN(e.name << ": format should be \"text\" or \"columnar\"");
+    return false;
+  }
+  return true;
+}
+
+/* Sets row to the axis values and energies at grid point index, summing
+ * each energy over the triangles (as energy_density_TMethod does). Returns
+ * false if the point is skipped */
+inline bool experiment_row(const experiment &e, std::size_t index,
+                           double *row) {
+  std::vector<Point> vertices(e.polygon);
+  vertices.insert(vertices.end(), e.free_vertices.begin(),
+                  e.free_vertices.end());
+  for (std::size_t a = e.sweep.size(); a-- > 0;) {
+    const sweep_axis &axis = e.sweep[a];
+    const std::size_t i = index % axis.size();
+    index /= axis.size();
+    row[a] = axis.value(i);
+    Point &p = vertices[e.polygon.size() + axis.vertex];
+    p = axis.coordinate == 0 ? Point(row[a], p.y()) : Point(p.x(), row[a]);
+  }
+  if (e.inside_only) {
+    for (std::size_t v = e.polygon.size(); v < vertices.size(); v++) {
+      if (CGAL::bounded_side_2(e.polygon.begin(), e.polygon.end(), vertices[v],
+                               K()) != CGAL::ON_BOUNDED_SIDE) {
+        return false;
+      }
+    }
+  }
+
+  std::vector<Triangle> triangles;
+  if (e.mesh == experiment::fan_mesh) {
+    const std::size_t n = e.polygon.size();
+    for (std::size_t i = 0; i < n; i++) {
+      triangles.push_back(
+          Triangle(vertices[i], vertices[(i + 1) % n], vertices[n]));
+    }
+  } else if (e.mesh == experiment::delaunay_mesh) {
+    DT dt(vertices.begin(), vertices.end());
+    for (auto f = dt.finite_faces_begin(); f != dt.finite_faces_end(); f++) {
+      triangles.push_back(face_to_tri(*f));
+    }
+  } else {
+    for (const std::array<int, 3> &t : e.triangles) {
+      triangles.push_back(
+          Triangle(vertices[t[0]], vertices[t[1]], vertices[t[2]]));
+    }
+  }
+
+  double *energies = row + e.sweep.size();
+  std::fill(energies, energies + e.energies.size(), 0.0);
+  for (const Triangle &tri : triangles) {
+    const triangle_measures m = measure_triangle(tri);
+    for (std::size_t k = 0; k < e.energies.size(); k++) {
+      energies[k] += e.energies[k](m);
+    }
+  }
+  return true;
+}
+
+/* The columns of the sweep's rows, all float64 */
+inline std::vector<result_column> experiment_columns(const experiment &e) {
+  std::vector<result_column> columns;
+  for (const std::string &name : e.column_names()) {
+    columns.push_back(result_column{name, column_type::float64});
+  }
+  return columns;
+}
+
+/* Runs the sweep and writes the rows to sink, whose columns are
+ * experiment_columns(e), in grid order, a batch of grid points at a time.
+ * Each thread adds its rows to its own block, and the blocks go to the sink
+ * in thread order after each batch. The sink is left open */
+inline bool run_experiment(const experiment &e, result_sink &sink) {
+  const std::vector<result_column> columns = experiment_columns(e);
+  const std::size_t rows = e.num_rows(), batch = std::size_t(1) << 16,
+                    grain = 64;
+  result_buffers buffers(parallel_num_chunks(batch, grain), columns);
+  std::size_t kept = 0;
+  bool written = true;
+  for (std::size_t first = 0; first < rows && written; first += batch) {
+    parallel_for(std::min(batch, rows - first),
+                 [&](int chunk, std::size_t begin, std::size_t end) {
+                   std::vector<double> row(e.num_columns());
+                   for (std::size_t r = begin; r < end; r++) {
+                     if (experiment_row(e, first + r, row.data())) {
+                       buffers[chunk].add_row(row.data());
+                     }
+                   }
+                 },
+                 grain);
+    kept += buffers.rows();
+    written = buffers.flush(sink);
+  }
+  if (written) {
+    HOT_INFO(e.name << ": " << kept << " rows");
+  }
+  return written;
+}
+
+/* Runs the sweep and writes it to e.output in e.format */
+inline bool run_experiment(const experiment &e) {
+  std::unique_ptr<result_sink> sink =
+      open_result_sink(e.output, e.format, experiment_columns(e));
+  if (!sink) {
+    return false;
+  }
+  const bool written = run_experiment(e, *sink);
+  if (!sink->close() || !written) {
+    HOT_WARN(e.name << ": can't write " << e.output);
+    return false;
+  }
+  return true;
+}
+
+#endif // _EXPERIMENT_HPP_
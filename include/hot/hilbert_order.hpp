@@ -0,0 +1,119 @@
+// hilbert_order.hpp
+// inserting points into a triangulation along a Hilbert curve, with the
+// curve order computed and sorted in parallel
+#ifndef _HILBERT_ORDER_HPP_
+#define _HILBERT_ORDER_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "parallel.hpp"
+#include "point_io.hpp"
+
+/* Position of (x, y) along the Hilbert curve through the 2^32 x 2^32 grid */
+inline std::uint64_t hilbert_key(std::uint32_t x, std::uint32_t y) {
+  std::uint64_t d = 0;
+  for (std::uint32_t s = std::uint32_t(1) << 31; s > 0; s >>= 1) {
+    const std::uint32_t rx = (x & s) != 0, ry = (y & s) != 0;
+    d += std::uint64_t(s) * s * ((3 * rx) ^ ry);
+    // rotate the quadrant so the curve inside it starts at its origin
+    if (ry == 0) {
+      if (rx == 1) {
+        x = ~x;
+        y = ~y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+/* The point indices in Hilbert curve order. The keys are computed and
+ * sorted in parallel */
+inline std::vector<std::size_t> hilbert_order(const point_set &points) {
+  const std::size_t n = points.size();
+  const double inf = std::numeric_limits<double>::infinity();
+  std::vector<std::array<double, 4>> boxes(parallel_num_chunks(n),
+                                           {{inf, -inf, inf, -inf}});
+  parallel_for(n, [&](int chunk, std::size_t begin, std::size_t end) {
+    std::array<double, 4> &box = boxes[chunk];
+    for (std::size_t i = begin; i < end; i++) {
+      box[0] = std::min(box[0], points.x(i));
+      box[1] = std::max(box[1], points.x(i));
+      box[2] = std::min(box[2], points.y(i));
+      box[3] = std::max(box[3], points.y(i));
+    }
+  });
+  std::array<double, 4> box = {{inf, -inf, inf, -inf}};
+  for (const std::array<double, 4> &b : boxes) {
+    box[0] = std::min(box[0], b[0]);
+    box[1] = std::max(box[1], b[1]);
+    box[2] = std::min(box[2], b[2]);
+    box[3] = std::max(box[3], b[3]);
+  }
+  // one scale for both axes, so the curve isn't stretched
+  const double extent = std::max(box[1] - box[0], box[3] - box[2]);
+  const double to_grid = extent > 0 ? 4294967295.0 / extent : 0.0;
+
+  std::vector<std::pair<std::uint64_t, std::size_t>> keys(n);
+  parallel_for(n, [&](int, std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++) {
+      keys[i].first = hilbert_key(
+          static_cast<std::uint32_t>((points.x(i) - box[0]) * to_grid),
+          static_cast<std::uint32_t>((points.y(i) - box[2]) * to_grid));
+      keys[i].second = i;
+    }
+  });
+  parallel_sort(keys);
+  std::vector<std::size_t> order(n);
+  parallel_for(n, [&](int, std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++) {
+      order[i] = keys[i].second;
+    }
+  });
+  return order;
+}
+
+/* Whether the vertices of Tr hold weighted points (RegT) */
+template <typename Tr>
+struct bulk_weighted
+    : std::integral_constant<
+          bool, !std::is_same<typename Tr::Vertex::Point,
+                              typename Tr::Geom_traits::Point_2>::value> {};
+
+template <typename Tr>
+typename Tr::Vertex::Point bulk_point(const point_set &points, std::size_t i,
+                                      std::false_type) {
+  return typename Tr::Vertex::Point(points.x(i), points.y(i));
+}
+
+template <typename Tr>
+typename Tr::Vertex::Point bulk_point(const point_set &points, std::size_t i,
+                                      std::true_type) {
+  return typename Tr::Vertex::Point(
+      typename Tr::Geom_traits::Point_2(points.x(i), points.y(i)),
+      points.weight(i));
+}
+
+/* Inserts the points one at a time in the given order, locating each one
+ * from the face of the one before. In Hilbert order this is the walk
+ * CGAL's range insert does after its own, serial, spatial sort */
+template <typename Tr>
+void insert_in_order(Tr &tr, const point_set &points,
+                     const std::vector<std::size_t> &order) {
+  typename Tr::Face_handle hint;
+  for (std::size_t i : order) {
+    typename Tr::Vertex_handle v =
+        tr.insert(bulk_point<Tr>(points, i, bulk_weighted<Tr>()), hint);
+    if (v != typename Tr::Vertex_handle()) {
+      hint = v->face();
+    }
+  }
+}
+
+#endif // _HILBERT_ORDER_HPP_
@@ -11,12 +11,19 @@
 #include <cmath>
 #include <limits>
 #include <list>
+#include <map>
+#include <queue>
+#include <set>
 #include <vector>
 #include <functional>
 #include <random>
 
 
 #include "cgal-kernel.h"
+#include "checkpoint.hpp"
+#include "hilbert_order.hpp"
+#include "indexed_triangulation.hpp"
+#include "log.hpp"
 
 #include "energyNOweights.hpp"
 #include "polynomial.hpp"
@@ -26,8 +33,9 @@ constexpr const int dims = 2;
 constexpr const int tri_verts = 3;
 constexpr const int tri_edges = 3;
 
-struct finite_diffs {
-  DT::Vertex_handle vtx;
+// The incident energy of vtx at its position and shifted by +-dx, +-dy
+template <typename T = DT> struct basic_finite_diffs {
+  typename T::Vertex_handle vtx;
   K_real center;
   K_real dx_plus;
   K_real dx_minus;
@@ -35,6 +43,8 @@ struct finite_diffs {
   K_real dy_minus;
 };
 
+using finite_diffs = basic_finite_diffs<DT>;
+
 
 using RNG = std::mt19937_64;
 
@@ -42,16 +52,25 @@ constexpr const float min_pos = 10.0;
 constexpr const float max_pos = 20.0;
 
 
+/* num_points uniform random points in [min_pos, max_pos)^2. The same seed
+ * gives the same points, e.g. to rebuild the input of a checkpointed run */
 template <typename T>
-void generate_rand_t(int num_points, T &t) {
-  std::random_device rd;
-  RNG engine(rd());
+void generate_rand_t(int num_points, T &t, std::uint64_t seed) {
+  RNG engine(seed);
   std::uniform_real_distribution<double> genPos(min_pos,
                                                 max_pos);
-  for(int i = 0; i < num_points; i++) {
-    typename T::Point pt(genPos(engine), genPos(engine));
-    t.insert(pt);
+  point_set points;
+  points.coords.resize(2 * num_points);
+  for(double &c : points.coords) {
+    c = genPos(engine);
   }
+  insert_in_order(t, points, hilbert_order(points));
+}
+
+template <typename T>
+void generate_rand_t(int num_points, T &t) {
+  std::random_device rd;
+  generate_rand_t(num_points, t, rd());
 }
 
 void order_points(std::array<Point, tri_verts> &verts);
@@ -64,7 +83,23 @@ void compute_h_deriv(const Point &xi, const Point &xj, const Point &xk, int i, d
 
 double wasserstein2_edge_edge(const Segment &e0, const Segment &e1);
 
-std::list<DT::Vertex_handle> internal_vertices(const DT &dt);
+/* Whether v is on the convex hull of t, i.e. has an infinite incident face.
+ * Costs O(degree of v), so testing every vertex is O(V) */
+template <typename T>
+bool is_hull_vertex(const T &t, const typename T::Vertex_handle &v) {
+  if (t.dimension() < 2) {
+    return true;
+  }
+  typename T::Face_circulator fc = t.incident_faces(v), done(fc);
+  do {
+    if (t.is_infinite(fc)) {
+      return true;
+    }
+  } while (++fc != done);
+  return false;
+}
+
+std::vector<DT::Vertex_handle> internal_vertices(const DT &dt);
 
 /* Computes 1 or 2 triangles which can be used for the
  * piecewise integral of the Wasserstein distance with
@@ -187,18 +222,47 @@ template <int k> K_real hot_energy(const DT &dt) {
   return K_real(float(energy));
 }
 
-template <int k>
-K_real compute_incident_energies(const DT &dt, DT::Vertex_handle vtx) {
+template <int k> K_real face_energy(const Triangle &tri) {
+  return tri.area() * triangle_w<k>(tri);
+}
+
+/* The energy of the faces around vtx; T is DT or Indexed_DT */
+template <int k, typename T>
+K_real compute_incident_energies(const T &dt, typename T::Vertex_handle vtx) {
   K_real energy = 0.0;
   bool once = false;
-  for (DT::Face_circulator face_itr = dt.incident_faces(vtx),
-                           start_face = face_itr;
+  for (typename T::Face_circulator face_itr = dt.incident_faces(vtx),
+                                   start_face = face_itr;
        !once || face_itr != start_face; face_itr++) {
     once = true;
-    Triangle tri = face_to_tri(*face_itr);
-    K_real area = tri.area();
-    K_real wasserstein = triangle_w<k>(tri);
-    energy += area * wasserstein;
+    energy += face_energy<k>(Triangle(face_itr->vertex(0)->point(),
+                                      face_itr->vertex(1)->point(),
+                                      face_itr->vertex(2)->point()));
+  }
+  return energy;
+}
+
+/* The energy of the finite faces with a vertex in verts, each counted once */
+template <int k, typename T>
+K_real compute_faces_energy(const T &dt,
+                            const std::vector<typename T::Vertex_handle> &verts) {
+  std::set<typename T::Face_handle> faces;
+  for (const typename T::Vertex_handle &vtx : verts) {
+    typename T::Face_circulator fc = dt.incident_faces(vtx), done(fc);
+    if (fc == nullptr) {
+      continue;
+    }
+    do {
+      if (!dt.is_infinite(fc)) {
+        faces.insert(fc);
+      }
+    } while (++fc != done);
+  }
+  K_real energy = 0.0;
+  for (const typename T::Face_handle &face : faces) {
+    energy += face_energy<k>(Triangle(face->vertex(0)->point(),
+                                      face->vertex(1)->point(),
+                                      face->vertex(2)->point()));
   }
   return energy;
 }
@@ -209,56 +273,222 @@ K_real choose_distance_scale(DT &dt, std::vector<finite_diffs> diffs) {
   return 1.0;
 }
 
-template <int k>
-std::vector<finite_diffs>
-compute_gradient(DT &dt, std::list<DT::Vertex_handle> &internal_verts) {
+/* Evaluates the incident energy of vtx at its position and at +-dx, +-dy,
+ * restoring the vertex to its original position afterwards. A shift onto
+ * another vertex leaves vtx where it is, rather than removing it */
+template <int k, typename T>
+void compute_vertex_diffs(T &dt, typename T::Vertex_handle vtx,
+                          basic_finite_diffs<T> &grad) {
   constexpr const K_real dx = 0.0000001;
   constexpr const K_real dy = 0.0000001;
-  std::vector<finite_diffs> f_diffs(internal_verts.size());
-  int idx = 0;
-  for (DT::Vertex_handle vtx : internal_verts) {
-    DT::Point initial_point = vtx->point();
-    finite_diffs &grad = f_diffs[idx];
-    grad.vtx = vtx;
+  const Point initial_point = vtx->point();
+  grad.vtx = vtx;
+
+  grad.center = compute_incident_energies<k>(dt, vtx);
+  dt.move_if_no_collision(vtx, Point(initial_point[0] + dx, initial_point[1]));
 
-    grad.center = compute_incident_energies<k>(dt, vtx);
-    dt.move(vtx, Point(initial_point[0] + dx, initial_point[1]));
+  grad.dx_plus = compute_incident_energies<k>(dt, vtx);
+  dt.move_if_no_collision(vtx, Point(initial_point[0] - dx, initial_point[1]));
+  grad.dx_minus = compute_incident_energies<k>(dt, vtx);
+  dt.move_if_no_collision(vtx, Point(initial_point[0], initial_point[1] + dy));
 
-    grad.dx_plus = compute_incident_energies<k>(dt, vtx);
-    dt.move(vtx, Point(initial_point[0] - dx, initial_point[1]));
-    grad.dx_minus = compute_incident_energies<k>(dt, vtx);
-    dt.move(vtx, Point(initial_point[0], initial_point[1] + dy));
+  grad.dy_plus = compute_incident_energies<k>(dt, vtx);
+  dt.move_if_no_collision(vtx, Point(initial_point[0], initial_point[1] - dy));
+  grad.dy_minus = compute_incident_energies<k>(dt, vtx);
 
-    grad.dy_plus = compute_incident_energies<k>(dt, vtx);
-    dt.move(vtx, Point(initial_point[0], initial_point[1] - dy));
-    grad.dy_minus = compute_incident_energies<k>(dt, vtx);
+  dt.move_if_no_collision(vtx, initial_point);
+}
 
-    dt.move(vtx, initial_point);
+template <int k>
+std::vector<finite_diffs>
+compute_gradient(DT &dt,
+                 const std::vector<DT::Vertex_handle> &internal_verts) {
+  std::vector<finite_diffs> f_diffs(internal_verts.size());
+  int idx = 0;
+  for (DT::Vertex_handle vtx : internal_verts) {
+    compute_vertex_diffs<k>(dt, vtx, f_diffs[idx]);
     idx++;
   }
   return f_diffs;
 }
 
-template <int k> DT hot_optimize(DT dt, K_real min_delta_energy = 0.1) {
+/* If checkpoints is given, the positions are handed to it whenever it is
+ * due. Nothing else carries over from one iteration to the next, the
+ * distance scale is recomputed every time, so a checkpoint holds only the
+ * positions and the iteration count. To resume, rebuild dt with
+ * restore_triangulation (bulk_build.hpp) and pass the checkpoint as
+ * resume, which carries on its iteration count */
+template <int k>
+DT hot_optimize(DT dt, K_real min_delta_energy = 0.1,
+                checkpoint_writer *checkpoints = nullptr,
+                const checkpoint *resume = nullptr) {
   K_real delta_energy = std::numeric_limits<K_real>::infinity();
-  std::list<DT::Vertex_handle> internal_verts = internal_vertices(dt);
+  int iteration = 0;
+  if (resume != nullptr && resume->solver == "hot_optimize") {
+    iteration = resume->iteration;
+  }
   // This mesh is modified to determine the gradient each step
   while (delta_energy >= min_delta_energy) {
     delta_energy = 0.0;
+    // Recomputed each step, which is cheap, in case a move changed the hull
+    std::vector<DT::Vertex_handle> internal_verts = internal_vertices(dt);
     // Shift each point by dx and dy separately,
     // measuring how much the energy changes to approximate the gradient
     std::vector<finite_diffs> f_diffs = compute_gradient<k>(dt, internal_verts);
     K_real dist_scale = choose_distance_scale(dt, f_diffs);
+    K_real grad_norm2 = 0.0;
     for (finite_diffs diff : f_diffs) {
       K_real dx = dist_scale * (diff.dx_plus - diff.dx_minus) / 2.0;
       K_real dy = dist_scale * (diff.dy_plus - diff.dy_minus) / 2.0;
+      grad_norm2 += dx * dx + dy * dy;
       dt.move(diff.vtx,
               Point(diff.vtx->point()[0] - dx, diff.vtx->point()[1] - dy));
     }
+    // the energy is only needed for the record, so skip it if nobody listens
+    if (iteration_logging_enabled()) {
+      log_iteration({"hot_optimize", iteration,
+                     CGAL::to_double(hot_energy<k>(dt)),
+                     std::sqrt(CGAL::to_double(grad_norm2)), 1.0, 0.0});
+    }
+    iteration++;
+    if (checkpoints != nullptr && checkpoints->due()) {
+      checkpoint c;
+      c.solver = "hot_optimize";
+      c.iteration = iteration;
+      c.points = checkpoint_points(dt);
+      checkpoints->submit(std::move(c));
+    }
   }
   return dt;
 }
 
+/* Heap entry for hot_optimize_async. Entries are never removed from the
+ * heap when a vertex is re-keyed; instead each vertex carries a stamp
+ * which is bumped on every re-key, and entries with an old stamp are
+ * skipped when popped */
+struct relaxation_entry {
+  K_real grad_norm;
+  K_real grad[dims];
+  Indexed_DT::Vertex_handle vtx;
+  unsigned stamp;
+
+  bool operator<(const relaxation_entry &other) const {
+    return grad_norm < other.grad_norm;
+  }
+};
+
+/* Asynchronous variant of hot_optimize.
+ * Instead of sweeping every internal vertex each iteration, the internal
+ * vertices are kept in a max-heap keyed by the norm of their (finite
+ * difference) gradient. The top vertex is relaxed with a backtracking step,
+ * and only it and its 1-ring (before and after the move, since the move may
+ * flip edges) are re-keyed. Re-keying classifies the vertex again, so one
+ * which a move put on the hull drops out and one which left it joins.
+ * A step is taken if it lowers the energy of the faces around the vertex
+ * and both its rings: every face the move changes has a vertex there, so
+ * that is the change of the total energy.
+ * Terminates when the largest gradient norm is below tolerance, or after
+ * max_relaxations vertex moves. On meshes which are mostly optimized this
+ * only touches the parts of the mesh which still need work. The work is
+ * done on an Indexed_DT copy, whose dense vertex indices number the stamps */
+template <int k>
+DT hot_optimize_async(const DT &input, K_real tolerance = 1e-6,
+                      K_real step_scale = 1e-2,
+                      long max_relaxations = std::numeric_limits<long>::max()) {
+  constexpr const K_real dx = 0.0000001;
+  constexpr const int max_backtracks = 16;
+
+  Indexed_DT dt(input.points_begin(), input.points_end());
+  std::vector<unsigned> stamps(dt.number_of_indexed_vertices(), 0);
+  std::priority_queue<relaxation_entry> heap;
+
+  // Any entry of vtx already in the heap goes stale; a new one is pushed if
+  // vtx is internal
+  auto rekey = [&](Indexed_DT::Vertex_handle vtx) {
+    const unsigned stamp = ++stamps[vtx->index()];
+    if (is_hull_vertex(dt, vtx)) {
+      return;
+    }
+    basic_finite_diffs<Indexed_DT> diff;
+    compute_vertex_diffs<k>(dt, vtx, diff);
+    relaxation_entry entry;
+    entry.grad[0] = (diff.dx_plus - diff.dx_minus) / (2.0 * dx);
+    entry.grad[1] = (diff.dy_plus - diff.dy_minus) / (2.0 * dx);
+    entry.grad_norm = std::sqrt(entry.grad[0] * entry.grad[0] +
+                                entry.grad[1] * entry.grad[1]);
+    entry.vtx = vtx;
+    entry.stamp = stamp;
+    heap.push(entry);
+  };
+  // Appends the finite neighbors of vtx which aren't in ring yet
+  auto add_ring = [&](Indexed_DT::Vertex_handle vtx,
+                      std::vector<Indexed_DT::Vertex_handle> &ring) {
+    Indexed_DT::Vertex_circulator vc = dt.incident_vertices(vtx), done(vc);
+    if (vc != nullptr) {
+      do {
+        if (!dt.is_infinite(vc) &&
+            std::find(ring.begin(), ring.end(), vc) == ring.end()) {
+          ring.push_back(vc);
+        }
+      } while (++vc != done);
+    }
+  };
+
+  for (auto v_itr = dt.finite_vertices_begin(); v_itr != dt.finite_vertices_end();
+       v_itr++) {
+    rekey(v_itr);
+  }
+
+  for (long relaxations = 0; !heap.empty() && relaxations < max_relaxations;) {
+    relaxation_entry top = heap.top();
+    heap.pop();
+    if (top.stamp != stamps[top.vtx->index()]) {
+      // Stale entry, the vertex has been re-keyed since this was pushed
+      continue;
+    }
+    if (top.grad_norm < tolerance) {
+      break;
+    }
+
+    Indexed_DT::Vertex_handle vtx = top.vtx;
+    std::vector<Indexed_DT::Vertex_handle> before(1, vtx);
+    add_ring(vtx, before);
+
+    // Backtrack until the energy goes down. The faces to compare are those
+    // around vtx and both its rings, which depend on where the step lands
+    const Point initial_point = vtx->point();
+    K_real scale = step_scale;
+    bool moved = false;
+    std::vector<Indexed_DT::Vertex_handle> affected;
+    for (int i = 0; i < max_backtracks && !moved; i++, scale /= 2.0) {
+      const Point step(initial_point[0] - scale * top.grad[0],
+                       initial_point[1] - scale * top.grad[1]);
+      if (dt.move_if_no_collision(vtx, step) != vtx) {
+        continue;
+      }
+      affected = before;
+      add_ring(vtx, affected);
+      const K_real energy = compute_faces_energy<k>(dt, affected);
+      dt.move_if_no_collision(vtx, initial_point);
+      if (energy < compute_faces_energy<k>(dt, affected)) {
+        dt.move_if_no_collision(vtx, step);
+        moved = true;
+      }
+    }
+    relaxations++;
+    if (!moved) {
+      // No descent along this gradient; leave the vertex out of the heap
+      // until one of its neighbors moves and re-keys it
+      continue;
+    }
+
+    for (Indexed_DT::Vertex_handle neighbor : affected) {
+      rekey(neighbor);
+    }
+  }
+  return DT(dt.points_begin(), dt.points_end());
+}
+
 
 ///////// check if point is in a polygon ////////
 
@@ -270,7 +500,7 @@ bool point_outside_domain(Point pt, Point *pgn_begin, Point *pgn_end, K traits){
 		case CGAL::ON_BOUNDED_SIDE: return false; 
 		case CGAL::ON_BOUNDARY: return true;
 		case CGAL::ON_UNBOUNDED_SIDE: return true;	
-		default: std::cout<<"Something is wrong with point_outside_domain" <<std::endl; 
+		default: HOT_WARN("Something is wrong with point_outside_domain"); 
 			return false;
 	}
 }
@@ -329,21 +559,15 @@ Point triangle_circumcenter(const Triangle &face) {
   return CGAL::circumcenter(face.vertex(0), face.vertex(1), face.vertex(2));
 }
 
+/* The finite vertices which are not on the convex hull, in one O(V) sweep
+ * with no per-vertex allocation */
 inline
-std::list<DT::Vertex_handle> internal_vertices(const DT &dt) {
-  std::list<DT::Vertex_handle> verts;
-  std::set<DT::Vertex_handle> seen;
-  // First mark the external vertices as having been seen
-  for (auto vert_itr = dt.incident_vertices(dt.infinite_vertex());
-       seen.count(vert_itr) == 0; vert_itr++) {
-    seen.insert(vert_itr);
-  }
-  // Now iterator over all of the vertices,
-  // storing them if we haven't seen them before
+std::vector<DT::Vertex_handle> internal_vertices(const DT &dt) {
+  std::vector<DT::Vertex_handle> verts;
+  verts.reserve(dt.number_of_vertices());
   for (auto vert_itr = dt.finite_vertices_begin();
        vert_itr != dt.finite_vertices_end(); vert_itr++) {
-    if (seen.count(vert_itr) == 0) {
-      seen.insert(vert_itr);
+    if (!is_hull_vertex(dt, vert_itr)) {
       verts.push_back(vert_itr);
     }
   }
@@ -0,0 +1,317 @@
+#ifndef _INDEXED_TRIANGULATION_HPP_
+#define _INDEXED_TRIANGULATION_HPP_
+
+#include <array>
+#include <vector>
+
+#include <CGAL/Regular_triangulation_face_base_2.h>
+#include <CGAL/Regular_triangulation_vertex_base_2.h>
+#include <CGAL/Triangulation_data_structure_2.h>
+#include <CGAL/Triangulation_face_base_2.h>
+#include <CGAL/Triangulation_vertex_base_2.h>
+
+#include "cgal-kernel.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  DENSE VERTEX AND FACE INDICES ///////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// Vertices and faces carry an int index, so per-element data can live in flat
+// arrays instead of maps keyed on handles or points. Vertex indices are
+// 0..n-1 over every vertex the triangulation owns (including hidden vertices
+// of a regular triangulation), and are kept through insert, remove, move and
+// flip. Finite faces are numbered 0..f-1; CGAL creates and destroys faces
+// inside its insert and remove, so the face numbering is rebuilt in one sweep
+// the first time it is needed after such a change. Flips reuse both faces and
+// keep their indices. The infinite vertex and the infinite faces have index -1.
+
+/* Vertex base with an index, for any CGAL vertex base Vb */
+template <typename Gt, typename Vb = CGAL::Triangulation_vertex_base_2<Gt>>
+class Indexed_vertex_base_2 : public Vb {
+public:
+  using Face_handle = typename Vb::Face_handle;
+  using Point = typename Vb::Point;
+
+  template <typename TDS2> struct Rebind_TDS {
+    using Vb2 = typename Vb::template Rebind_TDS<TDS2>::Other;
+    using Other = Indexed_vertex_base_2<Gt, Vb2>;
+  };
+
+  Indexed_vertex_base_2() : Vb() {}
+  Indexed_vertex_base_2(const Point &p) : Vb(p) {}
+  Indexed_vertex_base_2(const Point &p, Face_handle f) : Vb(p, f) {}
+  Indexed_vertex_base_2(Face_handle f) : Vb(f) {}
+
+  int index() const { return index_; }
+  void set_index(int index) { index_ = index; }
+
+private:
+  int index_ = -1;
+};
+
+/* Face base with an index, for any CGAL face base Fb */
+template <typename Gt, typename Fb = CGAL::Triangulation_face_base_2<Gt>>
+class Indexed_face_base_2 : public Fb {
+public:
+  using Vertex_handle = typename Fb::Vertex_handle;
+  using Face_handle = typename Fb::Face_handle;
+
+  template <typename TDS2> struct Rebind_TDS {
+    using Fb2 = typename Fb::template Rebind_TDS<TDS2>::Other;
+    using Other = Indexed_face_base_2<Gt, Fb2>;
+  };
+
+  Indexed_face_base_2() : Fb() {}
+  Indexed_face_base_2(Vertex_handle v0, Vertex_handle v1, Vertex_handle v2)
+      : Fb(v0, v1, v2) {}
+  Indexed_face_base_2(Vertex_handle v0, Vertex_handle v1, Vertex_handle v2,
+                      Face_handle n0, Face_handle n1, Face_handle n2)
+      : Fb(v0, v1, v2, n0, n1, n2) {}
+
+  // index(v) and index(f), the local index of a vertex or neighbor, which
+  // CGAL itself uses
+  using Fb::index;
+
+  int index() const { return index_; }
+  void set_index(int index) { index_ = index; }
+
+private:
+  int index_ = -1;
+};
+
+/* A triangulation Tr, built on the indexed bases, which maintains the
+ * indices. The mutating members of Tr which change the set of vertices or
+ * faces are hidden by ones that keep the indices up to date, so an
+ * Indexed_triangulation must not be modified through a reference to Tr.
+ *
+ * Removing a vertex moves the vertex with the largest index into its slot,
+ * so arrays indexed by vertex are kept in step with
+ *   data[index] = data.back(); data.pop_back(); */
+template <typename Tr> class Indexed_triangulation : public Tr {
+public:
+  using Vertex_handle = typename Tr::Vertex_handle;
+  using Face_handle = typename Tr::Face_handle;
+  // Point for DT, Weighted_point for RegT
+  using Vertex_point = typename Tr::Vertex::Point;
+
+  Indexed_triangulation() : Tr() {}
+
+  Indexed_triangulation(const Indexed_triangulation &other) : Tr(other) {
+    collect_vertices(other.vertices_.size());
+  }
+
+  Indexed_triangulation &operator=(const Indexed_triangulation &other) {
+    if (this != &other) {
+      Tr::operator=(other);
+      collect_vertices(other.vertices_.size());
+    }
+    return *this;
+  }
+
+  template <typename InputIterator>
+  Indexed_triangulation(InputIterator first, InputIterator last) : Tr() {
+    insert(first, last);
+  }
+
+  int number_of_indexed_vertices() const { return vertices_.size(); }
+
+  Vertex_handle indexed_vertex(int index) const { return vertices_[index]; }
+
+  int number_of_indexed_faces() const {
+    index_faces();
+    return faces_.size();
+  }
+
+  Face_handle indexed_face(int index) const {
+    index_faces();
+    return faces_[index];
+  }
+
+  /* The index of a finite face, or -1 for an infinite one */
+  int face_index(const Face_handle &f) const {
+    index_faces();
+    return f->index();
+  }
+
+  /* The vertex indices of the finite faces, in face index order */
+  std::vector<std::array<int, 3>> indexed_triangles() const {
+    index_faces();
+    std::vector<std::array<int, 3>> triangles(faces_.size());
+    for (size_t f = 0; f < faces_.size(); f++) {
+      for (int v = 0; v < 3; v++) {
+        triangles[f][v] = faces_[f]->vertex(v)->index();
+      }
+    }
+    return triangles;
+  }
+
+  Vertex_handle insert(const Vertex_point &p,
+                       Face_handle hint = Face_handle()) {
+    Vertex_handle v = Tr::insert(p, hint);
+    if (v != Vertex_handle() && v->index() < 0) {
+      add_vertex(v);
+    }
+    faces_dirty_ = true;
+    return v;
+  }
+
+  /* Uses the spatially sorted insertion of Tr, then indexes the new
+   * vertices in one sweep */
+  template <typename InputIterator>
+  std::ptrdiff_t insert(InputIterator first, InputIterator last) {
+    const std::ptrdiff_t inserted = Tr::insert(first, last);
+    index_new_vertices();
+    return inserted;
+  }
+
+  /* Indexes the vertices which don't have an index yet, for vertices made
+   * directly in the data structure (e.g. by assemble_triangulation) */
+  void index_new_vertices() {
+    for (auto v_itr = this->tds().vertices_begin();
+         v_itr != this->tds().vertices_end(); v_itr++) {
+      if (v_itr->index() < 0 && !this->is_infinite(v_itr)) {
+        add_vertex(v_itr);
+      }
+    }
+    faces_dirty_ = true;
+  }
+
+  void remove(Vertex_handle v) {
+    const int index = v->index();
+    Tr::remove(v);
+    release_index(index);
+    faces_dirty_ = true;
+  }
+
+  /* Keeps the index of v. On a collision v is left in place and the
+   * vertex already at p is returned */
+  Vertex_handle move_if_no_collision(Vertex_handle v, const Vertex_point &p) {
+    Vertex_handle w = Tr::move_if_no_collision(v, p);
+    faces_dirty_ = true;
+    return w;
+  }
+
+  /* Keeps the index of v. On a collision v is removed, as in Tr::move, and
+   * the vertex already at p is returned */
+  Vertex_handle move(Vertex_handle v, const Vertex_point &p) {
+    const int index = v->index();
+    Vertex_handle w = Tr::move(v, p);
+    if (w != v) {
+      release_index(index);
+    }
+    faces_dirty_ = true;
+    return w;
+  }
+
+  /* Moves v by removing it and inserting p near one of its neighbors, for
+   * triangulations without a move (RegT). The new vertex takes the index
+   * of v, unless p lands on a vertex which already has one */
+  Vertex_handle reinsert(Vertex_handle v, const Vertex_point &p) {
+    const int index = v->index();
+    Face_handle hint;
+    Vertex_handle neighbor;
+    if (this->dimension() == 2 && v->face() != Face_handle() &&
+        v->face()->has_vertex(v)) {
+      typename Tr::Vertex_circulator vc = this->incident_vertices(v),
+                                     done(vc);
+      while (this->is_infinite(vc) && ++vc != done) {
+      }
+      neighbor = vc;
+    } else {
+      // hidden vertices of a RegT live in the face which contains them
+      hint = v->face();
+    }
+    Tr::remove(v);
+    if (neighbor != Vertex_handle()) {
+      hint = neighbor->face();
+    }
+    Vertex_handle w = Tr::insert(p, hint);
+    if (w != Vertex_handle() && w->index() < 0) {
+      w->set_index(index);
+      vertices_[index] = w;
+    } else {
+      release_index(index);
+    }
+    faces_dirty_ = true;
+    return w;
+  }
+
+  /* Flips reuse the two faces, so every index is kept */
+  void flip(Face_handle f, int i) { Tr::flip(f, i); }
+
+  void clear() {
+    Tr::clear();
+    vertices_.clear();
+    faces_.clear();
+    faces_dirty_ = false;
+  }
+
+  /* Numbers the finite faces if they changed since the last call */
+  void index_faces() const {
+    if (!faces_dirty_) {
+      return;
+    }
+    faces_.clear();
+    faces_.reserve(this->number_of_faces());
+    for (auto f_itr = this->all_faces_begin(); f_itr != this->all_faces_end();
+         f_itr++) {
+      if (this->is_infinite(f_itr)) {
+        f_itr->set_index(-1);
+      } else {
+        f_itr->set_index(faces_.size());
+        faces_.push_back(f_itr);
+      }
+    }
+    faces_dirty_ = false;
+  }
+
+private:
+  void add_vertex(Vertex_handle v) {
+    v->set_index(vertices_.size());
+    vertices_.push_back(v);
+  }
+
+  // The vertex with index is gone, move the last one into its slot
+  void release_index(int index) {
+    Vertex_handle last = vertices_.back();
+    vertices_.pop_back();
+    if (index < static_cast<int>(vertices_.size())) {
+      last->set_index(index);
+      vertices_[index] = last;
+    }
+  }
+
+  // After a copy the indices are already in the vertices
+  void collect_vertices(size_t count) {
+    vertices_.assign(count, Vertex_handle());
+    for (auto v_itr = this->tds().vertices_begin();
+         v_itr != this->tds().vertices_end(); v_itr++) {
+      if (v_itr->index() >= 0) {
+        vertices_[v_itr->index()] = v_itr;
+      }
+    }
+    faces_dirty_ = true;
+  }
+
+  std::vector<Vertex_handle> vertices_;
+  mutable std::vector<Face_handle> faces_;
+  mutable bool faces_dirty_ = false;
+};
+
+using Indexed_DT_Tds =
+    CGAL::Triangulation_data_structure_2<Indexed_vertex_base_2<DT::Geom_traits>,
+                                         Indexed_face_base_2<DT::Geom_traits>>;
+using Indexed_DT = Indexed_triangulation<
+    CGAL::Delaunay_triangulation_2<DT::Geom_traits, Indexed_DT_Tds>>;
+
+using Indexed_RegT_Tds = CGAL::Triangulation_data_structure_2<
+    Indexed_vertex_base_2<
+        RegT::Geom_traits,
+        CGAL::Regular_triangulation_vertex_base_2<RegT::Geom_traits>>,
+    Indexed_face_base_2<
+        RegT::Geom_traits,
+        CGAL::Regular_triangulation_face_base_2<RegT::Geom_traits>>>;
+using Indexed_RegT = Indexed_triangulation<
+    CGAL::Regular_triangulation_2<RegT::Geom_traits, Indexed_RegT_Tds>>;
+
+#endif // _INDEXED_TRIANGULATION_HPP_
@@ -0,0 +1,81 @@
+// log.hpp
+// Logging with compile-time levels. Messages above HOT_LOG_LEVEL are
+// dead code, so per-element tracing in the hot loops costs nothing unless
+// it is compiled in, e.g. with -DHOT_LOG_LEVEL=HOT_LOG_TRACE
+#ifndef _LOG_HPP_
+#define _LOG_HPP_
+
+#include <functional>
+#include <iostream>
+
+#define HOT_LOG_OFF 0
+#define HOT_LOG_WARN 1
+#define HOT_LOG_INFO 2
+#define HOT_LOG_DEBUG 3
+#define HOT_LOG_TRACE 4
+
+#ifndef HOT_LOG_LEVEL
+#define HOT_LOG_LEVEL HOT_LOG_INFO
+#endif
+
+// Where log messages go; std::clog, so they stay out of piped results
+inline std::ostream &hot_log_stream() { return std::clog; }
+
+// Streams the message expression followed by a newline (not std::endl, so
+// the stream isn't flushed per message)
+#define HOT_LOG(level, message)                                                \
+  do {                                                                         \
+    if (HOT_LOG_LEVEL >= (level)) {                                            \
+      hot_log_stream() << message << '\n';                                     \
+    }                                                                          \
+  } while (0)
+
+#define HOT_WARN(message) HOT_LOG(HOT_LOG_WARN, "Warning: " << message)
+#define HOT_INFO(message) HOT_LOG(HOT_LOG_INFO, message)
+#define HOT_DEBUG(message) HOT_LOG(HOT_LOG_DEBUG, message)
+#define HOT_TRACE(message) HOT_LOG(HOT_LOG_TRACE, message)
+
+/* One line summary of an optimizer iteration. Fields which don't apply to
+ * a solver are left at zero */
+struct iteration_record {
+  const char *solver;
+  int iteration;
+  double energy;
+  double gradient_norm;
+  double step;
+  double max_displacement;
+};
+
+inline std::ostream &operator<<(std::ostream &out,
+                                const iteration_record &record) {
+  return out << "solver=" << record.solver
+             << " iteration=" << record.iteration
+             << " energy=" << record.energy
+             << " gradient_norm=" << record.gradient_norm
+             << " step=" << record.step
+             << " max_displacement=" << record.max_displacement;
+}
+
+/* Optional consumer of every iteration record, e.g. to write convergence
+ * histories to a file. Unset by default */
+inline std::function<void(const iteration_record &)> &iteration_callback() {
+  static std::function<void(const iteration_record &)> callback;
+  return callback;
+}
+
+/* Whether log_iteration goes anywhere, for solvers whose records cost
+ * extra work to fill in */
+inline bool iteration_logging_enabled() {
+  return HOT_LOG_LEVEL >= HOT_LOG_DEBUG || bool(iteration_callback());
+}
+
+/* Reports an iteration: to the callback if one is set, and to the log at
+ * the DEBUG level */
+inline void log_iteration(const iteration_record &record) {
+  if (iteration_callback()) {
+    iteration_callback()(record);
+  }
+  HOT_DEBUG(record);
+}
+
+#endif // _LOG_HPP_
@@ -0,0 +1,147 @@
+// mesh_io.hpp
+// reading meshes with given connectivity, in the three file format of
+// examples/readme.txt
+#ifndef _MESH_IO_HPP_
+#define _MESH_IO_HPP_
+
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <CGAL/Triangulation_2.h>
+
+#include "bulk_build.hpp"
+#include "cgal-kernel.h"
+#include "log.hpp"
+#include "point_io.hpp"
+
+// Triangulations with the connectivity they were given, which need not be
+// Delaunay or regular. They are the bases of DT and RegT, on the same data
+// structures, so their faces work with the energy kernels written for DT
+// (energy_density_EMethod, ...) and RegT (energy_weights, ...)
+using Mesh_T =
+    CGAL::Triangulation_2<DT::Geom_traits, DT::Triangulation_data_structure>;
+using Weighted_mesh_T = CGAL::Triangulation_2<RegT::Geom_traits,
+                                              RegT::Triangulation_data_structure>;
+// with the vertex and face indices of Indexed_DT, e.g. for
+// energy_and_gradient_EMethod
+using Indexed_mesh_T = Indexed_triangulation<
+    CGAL::Triangulation_2<DT::Geom_traits, Indexed_DT_Tds>>;
+
+/* Reads prefix_points.txt, prefix_weights.txt if there is one, and
+ * prefix_triangles.txt. Triangles are numbered from 1 in the file and from
+ * 0 in triangles. Clockwise triangles are turned counterclockwise */
+inline bool read_mesh_files(const std::string &prefix, point_set &points,
+                            std::vector<std::array<int, 3>> &triangles) {
+  if (!read_points_text(prefix + "_points.txt", points)) {
+    return false;
+  }
+  const std::string weights_path = prefix + "_weights.txt";
+  if (!points.weighted() && std::ifstream(weights_path).good() &&
+      !read_weights_text(weights_path, points)) {
+    return false;
+  }
+
+  std::vector<char> buffer;
+  std::vector<double> indices;
+  const std::string triangles_path = prefix + "_triangles.txt";
+  if (!read_file(triangles_path, buffer) || !parse_numbers(buffer, indices) ||
+      indices.size() % 3 != 0) {
+    HOT_WARN(triangles_path << " is not a list of triangles");
+    return false;
+  }
+  const int n = points.size();
+  triangles.resize(indices.size() / 3);
+  int reoriented = 0;
+  for (std::size_t f = 0; f < triangles.size(); f++) {
+    std::array<int, 3> &t = triangles[f];
+    for (int v = 0; v < 3; v++) {
+      const double index = indices[3 * f + v];
+      if (index != std::floor(index) || index < 1 || index > n) {
+        HOT_WARN(triangles_path << " triangle " << f + 1 << " has vertex "
+                                << index << ", not in 1.." << n);
+        return false;
+      }
+      t[v] = static_cast<int>(index) - 1;
+    }
+    const double cross =
+        (points.x(t[1]) - points.x(t[0])) * (points.y(t[2]) - points.y(t[0])) -
+        (points.y(t[1]) - points.y(t[0])) * (points.x(t[2]) - points.x(t[0]));
+    if (cross < 0) {
+      std::swap(t[1], t[2]);
+      reoriented++;
+    } else if (cross == 0) {
+      HOT_WARN(triangles_path << " triangle " << f + 1 << " is degenerate");
+    }
+  }
+  if (reoriented > 0) {
+    HOT_WARN(triangles_path << " has " << reoriented
+                            << " clockwise triangles, reoriented");
+  }
+  return true;
+}
+
+/* Whether the boundary of triangles, counterclockwise faces over points,
+ * turns left or goes straight at every vertex. The boundary edges are the
+ * ones whose reverse is in no triangle */
+inline bool convex_boundary(const point_set &points,
+                            const std::vector<std::array<int, 3>> &triangles) {
+  std::set<std::pair<int, int>> edges;
+  for (const std::array<int, 3> &t : triangles) {
+    for (int v = 0; v < 3; v++) {
+      edges.insert(std::make_pair(t[v], t[(v + 1) % 3]));
+    }
+  }
+  std::map<int, int> next;
+  for (const std::pair<int, int> &e : edges) {
+    if (edges.count(std::make_pair(e.second, e.first)) == 0) {
+      next[e.first] = e.second;
+    }
+  }
+  for (const std::pair<const int, int> &e : next) {
+    const auto after = next.find(e.second);
+    if (after == next.end()) {
+      return false;
+    }
+    const int a = e.first, b = e.second, c = after->second;
+    const double cross =
+        (points.x(b) - points.x(a)) * (points.y(c) - points.y(a)) -
+        (points.y(b) - points.y(a)) * (points.x(c) - points.x(a));
+    if (cross < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Loads a mesh into tr (Mesh_T, Weighted_mesh_T or Indexed_mesh_T) with exactly the given
+ * faces, linked by assemble_triangulation. The faces must form a
+ * triangulated disk with a convex boundary, since CGAL takes the edges next
+ * to infinite faces for the convex hull (locate, insert and move rely on
+ * it). Returns false if the files can't be read or the faces don't form a
+ * valid data structure with a convex boundary */
+template <typename Tr> bool load_mesh(const std::string &prefix, Tr &tr) {
+  point_set points;
+  std::vector<std::array<int, 3>> triangles;
+  if (!read_mesh_files(prefix, points, triangles)) {
+    return false;
+  }
+  if (!convex_boundary(points, triangles)) {
+    HOT_WARN(prefix << " does not have a convex boundary");
+    return false;
+  }
+  assemble_triangulation(tr, points, triangles);
+  index_bulk_vertices(tr);
+  if (!tr.tds().is_valid()) {
+    HOT_WARN(prefix << " is not a triangulated disk");
+    return false;
+  }
+  return true;
+}
+
+#endif // _MESH_IO_HPP_
@@ -0,0 +1,113 @@
+// parallel.hpp
+// minimal std::thread based loop parallelism, so we don't need OpenMP or TBB
+#ifndef _PARALLEL_HPP_
+#define _PARALLEL_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Loops shorter than this are not worth starting threads for
+constexpr const std::size_t parallel_min_grain = 4096;
+
+inline int parallel_num_threads() {
+  const unsigned hw = std::thread::hardware_concurrency();
+  return hw == 0 ? 1 : static_cast<int>(hw);
+}
+
+/* Number of contiguous chunks parallel_for will split [0, n) into */
+inline int parallel_num_chunks(std::size_t n,
+                               std::size_t grain = parallel_min_grain) {
+  const std::size_t by_grain = (n + grain - 1) / std::max<std::size_t>(grain, 1);
+  return static_cast<int>(std::max<std::size_t>(
+      1, std::min<std::size_t>(by_grain, parallel_num_threads())));
+}
+
+/* Calls body(chunk, begin, end) over contiguous chunks covering [0, n),
+ * one thread per chunk. Chunk c always covers the same range for a given
+ * n and grain, so per-chunk results can be combined deterministically */
+template <typename Body>
+void parallel_for(std::size_t n, Body body,
+                  std::size_t grain = parallel_min_grain) {
+  const int chunks = parallel_num_chunks(n, grain);
+  if (chunks == 1) {
+    body(0, std::size_t(0), n);
+    return;
+  }
+  const std::size_t chunk_size = (n + chunks - 1) / chunks;
+  std::vector<std::thread> threads;
+  threads.reserve(chunks - 1);
+  for (int c = 1; c < chunks; c++) {
+    const std::size_t begin = std::min(n, c * chunk_size);
+    const std::size_t end = std::min(n, begin + chunk_size);
+    threads.push_back(std::thread(body, c, begin, end));
+  }
+  body(0, std::size_t(0), std::min(n, chunk_size));
+  for (std::thread &t : threads) {
+    t.join();
+  }
+}
+
+/* Sums term(i) over [0, n) in parallel. Partial sums are added in chunk
+ * order, so the result doesn't depend on thread scheduling */
+template <typename Term>
+double parallel_sum(std::size_t n, Term term,
+                    std::size_t grain = parallel_min_grain) {
+  std::vector<double> partial(parallel_num_chunks(n, grain), 0.0);
+  parallel_for(n,
+               [&](int chunk, std::size_t begin, std::size_t end) {
+                 double sum = 0.0;
+                 for (std::size_t i = begin; i < end; i++) {
+                   sum += term(i);
+                 }
+                 partial[chunk] = sum;
+               },
+               grain);
+  double total = 0.0;
+  for (double p : partial) {
+    total += p;
+  }
+  return total;
+}
+
+/* Sorts v by sorting one chunk per thread, then merging pairs of runs in
+ * parallel rounds. Not stable */
+template <typename T, typename Compare = std::less<T>>
+void parallel_sort(std::vector<T> &v, Compare less = Compare()) {
+  const std::size_t n = v.size();
+  const int chunks = parallel_num_chunks(n);
+  if (chunks == 1) {
+    std::sort(v.begin(), v.end(), less);
+    return;
+  }
+  const std::size_t chunk_size = (n + chunks - 1) / chunks;
+  parallel_for(chunks,
+               [&](int, std::size_t begin, std::size_t end) {
+                 for (std::size_t c = begin; c < end; c++) {
+                   std::sort(v.begin() + std::min(n, c * chunk_size),
+                             v.begin() + std::min(n, (c + 1) * chunk_size),
+                             less);
+                 }
+               },
+               1);
+  std::vector<T> merged(n);
+  for (std::size_t width = chunk_size; width < n; width *= 2) {
+    parallel_for((n + 2 * width - 1) / (2 * width),
+                 [&](int, std::size_t begin, std::size_t end) {
+                   for (std::size_t m = begin; m < end; m++) {
+                     const std::size_t lo = 2 * width * m;
+                     const std::size_t mid = std::min(n, lo + width);
+                     const std::size_t hi = std::min(n, lo + 2 * width);
+                     std::merge(v.begin() + lo, v.begin() + mid,
+                                v.begin() + mid, v.begin() + hi,
+                                merged.begin() + lo, less);
+                   }
+                 },
+                 1);
+    v.swap(merged);
+  }
+}
+
+#endif // _PARALLEL_HPP_
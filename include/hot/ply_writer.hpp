@@ -3,7 +3,11 @@
 #define _PLY_WRITER_HPP_
 
 #include "hot.hpp"
+#include "indexed_triangulation.hpp"
 
 void write_ply(const char *fname, const DT &mesh);
 
+// Writes the vertices in index order, without looking them up by point
+void write_ply(const char *fname, const Indexed_DT &mesh);
+
 #endif
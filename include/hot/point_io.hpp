@@ -0,0 +1,301 @@
+// point_io.hpp
+// reading and writing large point sets, with or without weights
+#ifndef _POINT_IO_HPP_
+#define _POINT_IO_HPP_
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "log.hpp"
+#include "parallel.hpp"
+
+/* Points stored flat as x y (stride 2) or x y w (stride 3) */
+struct point_set {
+  std::vector<double> coords;
+  int stride = 2;
+
+  std::size_t size() const { return coords.size() / stride; }
+  bool weighted() const { return stride == 3; }
+  double x(std::size_t i) const { return coords[stride * i]; }
+  double y(std::size_t i) const { return coords[stride * i + 1]; }
+  double weight(std::size_t i) const {
+    return weighted() ? coords[stride * i + 2] : 0.0;
+  }
+};
+
+// Binary layout: magic, point count, stride, then the coordinates as
+// native doubles, stride per point
+constexpr const char point_file_magic[8] = {'H', 'O', 'T', 'P',
+                                           'T', 'S', '1', '\0'};
+
+struct point_file_header {
+  char magic[8];
+  std::uint64_t count;
+  std::uint32_t stride;
+  std::uint32_t reserved;
+};
+
+/* Reads a whole file into buffer, followed by a '\0' */
+inline bool read_file(const std::string &path, std::vector<char> &buffer) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    HOT_WARN("can't open " << path);
+    return false;
+  }
+  const std::streamsize size = in.tellg();
+  in.seekg(0);
+  buffer.resize(size + 1);
+  if (!in.read(buffer.data(), size)) {
+    HOT_WARN("can't read " << path);
+    return false;
+  }
+  buffer[size] = '\0';
+  return true;
+}
+
+/* Parses a decimal number starting at c, as strtod does, and sets end past
+ * it (to c if there is none). A number with a mantissa below 2^53 and a
+ * decimal exponent of at most 22 is a single product or quotient of two
+ * exact doubles, so it is correctly rounded without strtod; anything else,
+ * and inf or nan, goes to strtod */
+inline double parse_number(const char *c, const char **end) {
+  static const double powers_of_ten[23] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *p = c;
+  const bool negative = *p == '-';
+  if (*p == '-' || *p == '+') {
+    p++;
+  }
+  std::uint64_t mantissa = 0;
+  int exponent = 0;
+  bool digits = false, exact = true;
+  auto digit = [&](int d, bool fraction) {
+    digits = true;
+    if (mantissa < 100000000000000000ull) {
+      mantissa = 10 * mantissa + d;
+      exponent -= fraction;
+    } else if (!fraction) {
+      exponent++;
+      exact = exact && d == 0;
+    } else {
+      exact = exact && d == 0;
+    }
+  };
+  for (; *p >= '0' && *p <= '9'; p++) {
+    digit(*p - '0', false);
+  }
+  if (*p == '.') {
+    for (p++; *p >= '0' && *p <= '9'; p++) {
+      digit(*p - '0', true);
+    }
+  }
+  if (!digits) {
+    char *strtod_end;
+    const double value = std::strtod(c, &strtod_end);
+    *end = strtod_end;
+    return value;
+  }
+  if (*p == 'e' || *p == 'E') {
+    const char *q = p + 1;
+    const bool negative_exponent = *q == '-';
+    if (*q == '-' || *q == '+') {
+      q++;
+    }
+    if (*q >= '0' && *q <= '9') {
+      int e = 0;
+      for (; *q >= '0' && *q <= '9'; q++) {
+        e = std::min(10 * e + (*q - '0'), 100000);
+      }
+      exponent += negative_exponent ? -e : e;
+      p = q;
+    }
+  }
+  if (!exact || mantissa > (std::uint64_t(1) << 53) || exponent > 22 ||
+      exponent < -22) {
+    char *strtod_end;
+    const double value = std::strtod(c, &strtod_end);
+    *end = strtod_end;
+    return value;
+  }
+  *end = p;
+  const double value = exponent < 0
+                           ? mantissa / powers_of_ten[-exponent]
+                           : mantissa * powers_of_ten[exponent];
+  return negative ? -value : value;
+}
+
+/* Parses every number in a '\0' terminated text buffer, in order. The
+ * buffer is split at whitespace into one piece per thread, each parsed
+ * with parse_number, and the pieces are concatenated */
+inline bool parse_numbers(const std::vector<char> &buffer,
+                          std::vector<double> &numbers) {
+  const std::size_t length = buffer.empty() ? 0 : buffer.size() - 1;
+  const int pieces = parallel_num_chunks(length, std::size_t(1) << 20);
+  std::vector<std::size_t> starts(pieces + 1, length);
+  for (int p = 0; p < pieces; p++) {
+    std::size_t start = length * p / pieces;
+    // start each piece after a space, so no number is split
+    while (start > 0 && start < length &&
+           !std::isspace(static_cast<unsigned char>(buffer[start - 1]))) {
+      start++;
+    }
+    starts[p] = start;
+  }
+  std::vector<std::vector<double>> parsed(pieces);
+  std::vector<char> failed(pieces, 0);
+  parallel_for(pieces,
+               [&](int, std::size_t begin, std::size_t end) {
+                 for (std::size_t p = begin; p < end; p++) {
+                   const char *c = buffer.data() + starts[p];
+                   const char *stop = buffer.data() + starts[p + 1];
+                   while (c < stop) {
+                     if (std::isspace(static_cast<unsigned char>(*c))) {
+                       c++;
+                       continue;
+                     }
+                     const char *next;
+                     const double value = parse_number(c, &next);
+                     if (next == c) {
+                       failed[p] = 1;
+                       break;
+                     }
+                     parsed[p].push_back(value);
+                     c = next;
+                   }
+                 }
+               },
+               1);
+  std::size_t total = 0;
+  for (int p = 0; p < pieces; p++) {
+    if (failed[p]) {
+      return false;
+    }
+    total += parsed[p].size();
+  }
+  numbers.clear();
+  numbers.reserve(total);
+  for (int p = 0; p < pieces; p++) {
+    numbers.insert(numbers.end(), parsed[p].begin(), parsed[p].end());
+  }
+  return true;
+}
+
+/* Text points, one per line as "x y" or "x y w". The stride is taken from
+ * the first line */
+inline bool read_points_text(const std::string &path, point_set &points) {
+  std::vector<char> buffer;
+  if (!read_file(path, buffer)) {
+    return false;
+  }
+  int stride = 0;
+  for (const char *c = buffer.data(); *c != '\0' && *c != '\n';) {
+    // skip spaces here, so the count stops at the end of the line
+    if (std::isspace(static_cast<unsigned char>(*c))) {
+      c++;
+      continue;
+    }
+    const char *next;
+    parse_number(c, &next);
+    if (next == c) {
+      break;
+    }
+    stride++;
+    c = next;
+  }
+  if (stride != 2 && stride != 3) {
+    HOT_WARN(path << " should have 2 or 3 numbers per line, not " << stride);
+    return false;
+  }
+  if (!parse_numbers(buffer, points.coords) ||
+      points.coords.size() % stride != 0) {
+    HOT_WARN(path << " is not a list of points");
+    return false;
+  }
+  points.stride = stride;
+  return true;
+}
+
+/* Adds the weights in a text file, one per point, to unweighted points,
+ * for inputs which keep them in a separate file */
+inline bool read_weights_text(const std::string &path, point_set &points) {
+  std::vector<char> buffer;
+  std::vector<double> weights;
+  if (!read_file(path, buffer) || !parse_numbers(buffer, weights)) {
+    return false;
+  }
+  if (points.weighted() || weights.size() != points.size()) {
+    HOT_WARN(path << " has " << weights.size() << " weights for "
+                  << points.size() << " points");
+    return false;
+  }
+  std::vector<double> coords(3 * points.size());
+  parallel_for(points.size(), [&](int, std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++) {
+      coords[3 * i] = points.x(i);
+      coords[3 * i + 1] = points.y(i);
+      coords[3 * i + 2] = weights[i];
+    }
+  });
+  points.coords.swap(coords);
+  points.stride = 3;
+  return true;
+}
+
+inline bool write_points_binary(const std::string &path,
+                                const point_set &points) {
+  std::ofstream out(path, std::ios::binary);
+  point_file_header header;
+  std::memcpy(header.magic, point_file_magic, sizeof(header.magic));
+  header.count = points.size();
+  header.stride = points.stride;
+  header.reserved = 0;
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(points.coords.data()),
+            points.coords.size() * sizeof(double));
+  if (!out) {
+    HOT_WARN("can't write " << path);
+    return false;
+  }
+  return true;
+}
+
+inline bool read_points_binary(const std::string &path, point_set &points) {
+  std::ifstream in(path, std::ios::binary);
+  point_file_header header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, point_file_magic, sizeof(header.magic)) != 0 ||
+      (header.stride != 2 && header.stride != 3)) {
+    HOT_WARN(path << " is not a binary point file");
+    return false;
+  }
+  points.stride = header.stride;
+  points.coords.resize(header.count * header.stride);
+  if (!in.read(reinterpret_cast<char *>(points.coords.data()),
+               points.coords.size() * sizeof(double))) {
+    HOT_WARN(path << " is truncated");
+    return false;
+  }
+  return true;
+}
+
+/* Binary if the file starts with the magic, text otherwise */
+inline bool read_points(const std::string &path, point_set &points) {
+  char magic[sizeof(point_file_magic)] = {};
+  {
+    std::ifstream in(path, std::ios::binary);
+    in.read(magic, sizeof(magic));
+  }
+  if (std::memcmp(magic, point_file_magic, sizeof(magic)) == 0) {
+    return read_points_binary(path, points);
+  }
+  return read_points_text(path, points);
+}
+
+#endif // _POINT_IO_HPP_
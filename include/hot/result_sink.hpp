@@ -0,0 +1,436 @@
+// result_sink.hpp
+// where experiments write their tables: buffered text, or binary columns
+#ifndef _RESULT_SINK_HPP_
+#define _RESULT_SINK_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "log.hpp"
+
+enum class column_type : std::uint32_t { float64 = 0, int64 = 1 };
+
+struct result_column {
+  std::string name;
+  column_type type;
+
+  bool operator==(const result_column &other) const {
+    return name == other.name && type == other.type;
+  }
+};
+
+/* A batch of rows, stored by column. Each int64 column holds its values in
+ * ints, the float64 columns in floats. Not thread safe: each thread fills
+ * its own block and hands it to a sink when it is done */
+class result_block {
+public:
+  explicit result_block(const std::vector<result_column> &columns)
+      : columns_(columns), floats_(columns.size()), ints_(columns.size()) {}
+
+  const std::vector<result_column> &columns() const { return columns_; }
+  std::size_t rows() const { return rows_; }
+
+  /* Appends a row of values, one per column in order. int64 columns take
+   * the value cast to an integer */
+  void add_row(const double *values) {
+    for (std::size_t c = 0; c < columns_.size(); c++) {
+      if (columns_[c].type == column_type::int64) {
+        ints_[c].push_back(static_cast<std::int64_t>(values[c]));
+      } else {
+        floats_[c].push_back(values[c]);
+      }
+    }
+    rows_++;
+  }
+
+  /* Appends the rows of other, which has the same columns */
+  void append(const result_block &other) {
+    for (std::size_t c = 0; c < columns_.size(); c++) {
+      floats_[c].insert(floats_[c].end(), other.floats_[c].begin(),
+                        other.floats_[c].end());
+      ints_[c].insert(ints_[c].end(), other.ints_[c].begin(),
+                      other.ints_[c].end());
+    }
+    rows_ += other.rows_;
+  }
+
+  double value(std::size_t row, std::size_t column) const {
+    return columns_[column].type == column_type::int64
+               ? static_cast<double>(ints_[column][row])
+               : floats_[column][row];
+  }
+
+  const std::vector<double> &floats(std::size_t column) const {
+    return floats_[column];
+  }
+  const std::vector<std::int64_t> &ints(std::size_t column) const {
+    return ints_[column];
+  }
+  std::vector<double> &floats(std::size_t column) { return floats_[column]; }
+  std::vector<std::int64_t> &ints(std::size_t column) { return ints_[column]; }
+
+  /* For a block filled through floats() and ints() */
+  void set_rows(std::size_t rows) { rows_ = rows; }
+
+  void clear() {
+    for (std::size_t c = 0; c < columns_.size(); c++) {
+      floats_[c].clear();
+      ints_[c].clear();
+    }
+    rows_ = 0;
+  }
+
+private:
+  std::vector<result_column> columns_;
+  std::vector<std::vector<double>> floats_;
+  std::vector<std::vector<std::int64_t>> ints_;
+  std::size_t rows_ = 0;
+};
+
+class result_sink {
+public:
+  virtual ~result_sink() {}
+  /* Whether the sink could be opened */
+  virtual bool is_open() const = 0;
+  /* Writes the rows of block, whose columns are the sink's */
+  virtual bool write(const result_block &block) = 0;
+  /* Flushes anything buffered and closes the file */
+  virtual bool close() = 0;
+};
+
+/* Formats v into out (at least 32 chars) with 17 significant digits, which
+ * always read back as v, and returns the length */
+inline int format_double(double v, char *out) {
+  return std::snprintf(out, 32, "%.17g", v);
+}
+
+/* Keeps the rows in memory, for callers which want the table itself */
+class memory_result_sink : public result_sink {
+public:
+  explicit memory_result_sink(const std::vector<result_column> &columns)
+      : rows_(columns) {}
+
+  bool is_open() const override { return true; }
+
+  bool write(const result_block &block) override {
+    rows_.append(block);
+    return true;
+  }
+
+  bool close() override { return true; }
+
+  const result_block &rows() const { return rows_; }
+
+private:
+  result_block rows_;
+};
+
+/* One line per row, space separated, after a line of column names starting
+ * with #. Rows are formatted into a buffer which is written when it fills,
+ * never flushed per line */
+class text_result_sink : public result_sink {
+public:
+  static constexpr std::size_t buffer_size = std::size_t(1) << 20;
+
+  text_result_sink(const std::string &path,
+                   const std::vector<result_column> &columns)
+      : path_(path), columns_(columns), out_(path, std::ios::binary) {
+    buffer_.reserve(buffer_size + 64);
+    buffer_ += '#';
+    for (const result_column &c : columns_) {
+      buffer_ += ' ';
+      buffer_ += c.name;
+    }
+    buffer_ += '\n';
+  }
+
+  ~text_result_sink() { close(); }
+
+  bool is_open() const override { return out_.is_open(); }
+
+  bool write(const result_block &block) override {
+    char number[32];
+    for (std::size_t r = 0; r < block.rows(); r++) {
+      for (std::size_t c = 0; c < columns_.size(); c++) {
+        if (c > 0) {
+          buffer_ += ' ';
+        }
+        if (columns_[c].type == column_type::int64) {
+          buffer_ += std::to_string(block.ints(c)[r]);
+        } else {
+          buffer_.append(number, format_double(block.floats(c)[r], number));
+        }
+      }
+      buffer_ += '\n';
+      if (buffer_.size() >= buffer_size && !drain()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool close() override {
+    if (!out_.is_open()) {
+      return true;
+    }
+    const bool drained = drain();
+    out_.close();
+    return drained;
+  }
+
+private:
+  bool drain() {
+    out_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+    if (!out_) {
+      HOT_WARN("can't write " << path_);
+      return false;
+    }
+    return true;
+  }
+
+  std::string path_;
+  std::vector<result_column> columns_;
+  std::ofstream out_;
+  std::string buffer_;
+};
+
+// Binary columnar layout: magic, column count, then per column its type,
+// name length and name; then any number of blocks, each a row count and
+// then each column's values for those rows, 8 native bytes per value
+constexpr const char columnar_file_magic[8] = {'H', 'O', 'T', 'C',
+                                               'O', 'L', '1', '\0'};
+
+inline bool read_columnar_header(std::istream &in,
+                                 std::vector<result_column> &columns) {
+  char magic[sizeof(columnar_file_magic)];
+  std::uint32_t count = 0, reserved = 0;
+  if (!in.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, columnar_file_magic, sizeof(magic)) != 0 ||
+      !in.read(reinterpret_cast<char *>(&count), sizeof(count)) ||
+      !in.read(reinterpret_cast<char *>(&reserved), sizeof(reserved))) {
+    return false;
+  }
+  columns.resize(count);
+  for (result_column &c : columns) {
+    std::uint32_t type = 0, length = 0;
+    if (!in.read(reinterpret_cast<char *>(&type), sizeof(type)) ||
+        !in.read(reinterpret_cast<char *>(&length), sizeof(length)) ||
+        type > static_cast<std::uint32_t>(column_type::int64) ||
+        length > 4096) {
+      return false;
+    }
+    c.type = static_cast<column_type>(type);
+    c.name.resize(length);
+    if (!in.read(&c.name[0], length)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Skips the whole blocks which follow the header, and returns the offset
+ * where they end: the end of the file, unless a run stopped partway through
+ * writing its last block */
+inline std::streamoff skip_columnar_blocks(std::istream &in,
+                                           std::size_t num_columns) {
+  std::streamoff end = in.tellg();
+  in.seekg(0, std::ios::end);
+  const std::streamoff size = in.tellg();
+  const std::uint64_t row_bytes = 8 * num_columns;
+  std::uint64_t rows;
+  while (in.seekg(end) &&
+         in.read(reinterpret_cast<char *>(&rows), sizeof(rows))) {
+    const std::uint64_t left = size - end - sizeof(rows);
+    if (row_bytes > 0 && rows > left / row_bytes) {
+      break;
+    }
+    end += sizeof(rows) + rows * row_bytes;
+  }
+  return end;
+}
+
+/* Each write is one block. Opening an existing file with the same columns
+ * appends to it, so a sweep can be extended by later runs; a block cut
+ * short at the end of the file is dropped first, since anything appended
+ * after it would be misread */
+class columnar_result_sink : public result_sink {
+public:
+  columnar_result_sink(const std::string &path,
+                       const std::vector<result_column> &columns)
+      : path_(path) {
+    std::vector<result_column> existing;
+    bool append = false;
+    std::streamoff whole = 0, size = 0;
+    {
+      std::ifstream in(path, std::ios::binary);
+      append = in && read_columnar_header(in, existing);
+      if (append && existing == columns) {
+        whole = skip_columnar_blocks(in, columns.size());
+        in.clear();
+        in.seekg(0, std::ios::end);
+        size = in.tellg();
+      }
+    }
+    if (append && existing != columns) {
+      HOT_WARN(path << " has other columns, overwriting it");
+      append = false;
+    }
+    if (append && whole < size) {
+      HOT_WARN(path << " ends in a truncated block, dropping it");
+      if (::truncate(path.c_str(), whole) != 0) {
+        HOT_WARN("can't truncate " << path);
+        return;
+      }
+    }
+    out_.open(path, append ? std::ios::binary | std::ios::app
+                           : std::ios::binary | std::ios::trunc);
+    if (append) {
+      return;
+    }
+    const std::uint32_t count = columns.size(), reserved = 0;
+    out_.write(columnar_file_magic, sizeof(columnar_file_magic));
+    out_.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    out_.write(reinterpret_cast<const char *>(&reserved), sizeof(reserved));
+    for (const result_column &c : columns) {
+      const std::uint32_t type = static_cast<std::uint32_t>(c.type);
+      const std::uint32_t length = c.name.size();
+      out_.write(reinterpret_cast<const char *>(&type), sizeof(type));
+      out_.write(reinterpret_cast<const char *>(&length), sizeof(length));
+      out_.write(c.name.data(), length);
+    }
+  }
+
+  ~columnar_result_sink() { close(); }
+
+  bool is_open() const override { return out_.is_open(); }
+
+  bool write(const result_block &block) override {
+    if (block.rows() == 0) {
+      return true;
+    }
+    const std::uint64_t rows = block.rows();
+    out_.write(reinterpret_cast<const char *>(&rows), sizeof(rows));
+    for (std::size_t c = 0; c < block.columns().size(); c++) {
+      if (block.columns()[c].type == column_type::int64) {
+        out_.write(reinterpret_cast<const char *>(block.ints(c).data()),
+                   rows * sizeof(std::int64_t));
+      } else {
+        out_.write(reinterpret_cast<const char *>(block.floats(c).data()),
+                   rows * sizeof(double));
+      }
+    }
+    if (!out_) {
+      HOT_WARN("can't write " << path_);
+      return false;
+    }
+    return true;
+  }
+
+  bool close() override {
+    if (!out_.is_open()) {
+      return true;
+    }
+    out_.close();
+    return !out_.fail();
+  }
+
+private:
+  std::string path_;
+  std::ofstream out_;
+};
+
+/* Reads every block of a columnar file into one block */
+inline bool read_columnar_results(const std::string &path,
+                                  std::unique_ptr<result_block> &results) {
+  std::ifstream in(path, std::ios::binary);
+  std::vector<result_column> columns;
+  if (!in || !read_columnar_header(in, columns)) {
+    HOT_WARN(path << " is not a columnar result file");
+    return false;
+  }
+  results.reset(new result_block(columns));
+  std::uint64_t rows;
+  while (in.read(reinterpret_cast<char *>(&rows), sizeof(rows))) {
+    result_block block(columns);
+    for (std::size_t c = 0; c < columns.size(); c++) {
+      char *data;
+      if (columns[c].type == column_type::int64) {
+        block.ints(c).resize(rows);
+        data = reinterpret_cast<char *>(block.ints(c).data());
+      } else {
+        block.floats(c).resize(rows);
+        data = reinterpret_cast<char *>(block.floats(c).data());
+      }
+      if (!in.read(data, rows * 8)) {
+        HOT_WARN(path << " is truncated");
+        return false;
+      }
+    }
+    block.set_rows(rows);
+    results->append(block);
+  }
+  return true;
+}
+
+/* "text" or "columnar"; null for any other format, or if path can't be
+ * opened */
+inline std::unique_ptr<result_sink>
+open_result_sink(const std::string &path, const std::string &format,
+                 const std::vector<result_column> &columns) {
+  std::unique_ptr<result_sink> sink;
+  if (format == "text") {
+    sink.reset(new text_result_sink(path, columns));
+  } else if (format == "columnar") {
+    sink.reset(new columnar_result_sink(path, columns));
+  } else {
+    HOT_WARN("unknown result format " << format);
+    return sink;
+  }
+  if (!sink->is_open()) {
+    HOT_WARN("can't open " << path);
+    sink.reset();
+  }
+  return sink;
+}
+
+/* One block per thread, so threads add rows without locking. The blocks are
+ * written in thread order, so the file doesn't depend on scheduling as long
+ * as each thread's rows are a fixed range, as with parallel_for */
+class result_buffers {
+public:
+  result_buffers(int threads, const std::vector<result_column> &columns)
+      : blocks_(threads, result_block(columns)) {}
+
+  result_block &operator[](int thread) { return blocks_[thread]; }
+
+  std::size_t rows() const {
+    std::size_t rows = 0;
+    for (const result_block &b : blocks_) {
+      rows += b.rows();
+    }
+    return rows;
+  }
+
+  /* Writes and empties every block */
+  bool flush(result_sink &sink) {
+    bool written = true;
+    for (result_block &b : blocks_) {
+      written = sink.write(b) && written;
+      b.clear();
+    }
+    return written;
+  }
+
+private:
+  std::vector<result_block> blocks_;
+};
+
+#endif // _RESULT_SINK_HPP_
@@ -0,0 +1,282 @@
+// soup_energy.hpp
+// EMethod HOT energy and its gradient on indexed triangles, without a CGAL
+// triangulation. The mesh need not be Delaunay
+#ifndef _SOUP_ENERGY_HPP_
+#define _SOUP_ENERGY_HPP_
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "cgal-kernel.h"
+#include "energyWeights.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+#include "point_io.hpp"
+
+// An edge is named as in CGAL, by a face and the local index (0, 1, 2) of
+// the vertex opposite it. face[1] is -1 for a boundary edge
+struct soup_edge {
+  int face[2];
+  int opposite[2];
+};
+
+/* The edges of a list of triangles, with the faces on each side, and the
+ * faces incident to each vertex in compressed rows: vertex v is corner
+ * incident[k] % 3 of face incident[k] / 3 for start[v] <= k < start[v + 1] */
+struct soup_adjacency {
+  std::vector<soup_edge> edges;
+  std::vector<int> start;
+  std::vector<int> incident;
+};
+
+/* Builds the adjacency of triangles over n vertices. Every face side is
+ * keyed by its (min, max) vertex pair and the keys are sorted, so the two
+ * sides of an edge end up next to each other. Returns false if an edge has
+ * more than two faces. Orientation doesn't matter */
+inline bool soup_build_adjacency(std::size_t n,
+                                 const std::vector<std::array<int, 3>> &triangles,
+                                 soup_adjacency &adjacency) {
+  const std::size_t num_faces = triangles.size();
+  // (min vertex, max vertex, 3 * face + opposite corner)
+  std::vector<std::array<int, 3>> sides(3 * num_faces);
+  parallel_for(num_faces, [&](int, std::size_t begin, std::size_t end) {
+    for (std::size_t f = begin; f < end; f++) {
+      for (int k = 0; k < 3; k++) {
+        const int a = triangles[f][(k + 1) % 3], b = triangles[f][(k + 2) % 3];
+        sides[3 * f + k] = {{std::min(a, b), std::max(a, b),
+                             static_cast<int>(3 * f + k)}};
+      }
+    }
+  });
+  parallel_sort(sides);
+
+  adjacency.edges.clear();
+  adjacency.edges.reserve(3 * num_faces / 2 + 1);
+  for (std::size_t s = 0; s < sides.size();) {
+    std::size_t run = s + 1;
+    while (run < sides.size() && sides[run][0] == sides[s][0] &&
+           sides[run][1] == sides[s][1]) {
+      run++;
+    }
+    if (run - s > 2) {
+      HOT_WARN("edge " << sides[s][0] << " " << sides[s][1] << " has "
+                       << run - s << " faces");
+      return false;
+    }
+    soup_edge edge;
+    edge.face[0] = sides[s][2] / 3;
+    edge.opposite[0] = sides[s][2] % 3;
+    edge.face[1] = run - s == 2 ? sides[s + 1][2] / 3 : -1;
+    edge.opposite[1] = run - s == 2 ? sides[s + 1][2] % 3 : -1;
+    adjacency.edges.push_back(edge);
+    s = run;
+  }
+
+  adjacency.start.assign(n + 1, 0);
+  for (const std::array<int, 3> &t : triangles) {
+    for (int v = 0; v < 3; v++) {
+      adjacency.start[t[v] + 1]++;
+    }
+  }
+  for (std::size_t v = 0; v < n; v++) {
+    adjacency.start[v + 1] += adjacency.start[v];
+  }
+  adjacency.incident.resize(3 * num_faces);
+  std::vector<int> cursor(adjacency.start.begin(), adjacency.start.end() - 1);
+  for (std::size_t f = 0; f < num_faces; f++) {
+    for (int v = 0; v < 3; v++) {
+      adjacency.incident[cursor[triangles[f][v]]++] = 3 * f + v;
+    }
+  }
+  return true;
+}
+
+/* h_k of the face, as signed_dist_circumcenters: the signed distance of
+ * the circumcenter from the edge opposite corner k, positive on the side of
+ * corner k. If grad isn't null, grad[c] is set to the gradient of h_k with
+ * respect to corner c. With a = x_i - x_k, b = x_j - x_k and e = x_j - x_i,
+ *   h_k = |e| (a . b) / (2 |a x b|) */
+inline double soup_height(const point_set &points, const std::array<int, 3> &t,
+                          int k, double (*grad)[2] = nullptr) {
+  const int i = (k + 1) % 3, j = (k + 2) % 3;
+  const double xk = points.x(t[k]), yk = points.y(t[k]);
+  const double ax = points.x(t[i]) - xk, ay = points.y(t[i]) - yk;
+  const double bx = points.x(t[j]) - xk, by = points.y(t[j]) - yk;
+  const double ex = bx - ax, ey = by - ay;
+  const double length = std::sqrt(ex * ex + ey * ey);
+  const double dot = ax * bx + ay * by;
+  const double cross = ax * by - ay * bx;
+  const double area2 = std::abs(cross);
+  const double h = 0.5 * length * dot / area2;
+  if (grad == nullptr) {
+    return h;
+  }
+  // dh = (dot dL + L ddot) / (2 |cross|) - h d|cross| / |cross|
+  const double c_length = 0.5 * dot / (area2 * length);
+  const double c_dot = 0.5 * length / area2;
+  const double c_cross = (cross > 0 ? h : -h) / area2;
+  grad[i][0] = -c_length * ex + c_dot * bx - c_cross * by;
+  grad[i][1] = -c_length * ey + c_dot * by + c_cross * bx;
+  grad[j][0] = c_length * ex + c_dot * ax + c_cross * ay;
+  grad[j][1] = c_length * ey + c_dot * ay - c_cross * ax;
+  grad[k][0] = -grad[i][0] - grad[j][0];
+  grad[k][1] = -grad[i][1] - grad[j][1];
+  return h;
+}
+
+// h_k of every face, at 3 f + k
+inline std::vector<double>
+soup_heights(const point_set &points,
+             const std::vector<std::array<int, 3>> &triangles) {
+  std::vector<double> heights(3 * triangles.size());
+  parallel_for(triangles.size(), [&](int, std::size_t begin, std::size_t end) {
+    for (std::size_t f = begin; f < end; f++) {
+      for (int k = 0; k < 3; k++) {
+        heights[3 * f + k] = soup_height(points, triangles[f], k);
+      }
+    }
+  });
+  return heights;
+}
+
+// Half the length of edge e, which is dij = dji for unweighted points
+inline double soup_half_length(const point_set &points,
+                               const std::vector<std::array<int, 3>> &triangles,
+                               const soup_edge &e) {
+  const std::array<int, 3> &t = triangles[e.face[0]];
+  const int a = t[(e.opposite[0] + 1) % 3], b = t[(e.opposite[0] + 2) % 3];
+  return 0.5 * std::hypot(points.x(b) - points.x(a), points.y(b) - points.y(a));
+}
+
+/* The factor of each side's subtriangle energy in the energy of edge e, as
+ * in energy_density_EMethod: sgn(h1 + h2) for an interior edge with the
+ * corrected formulas, 1 without them, and on the boundary 1 if h > 0 and 0
+ * otherwise */
+inline double soup_edge_sign(const soup_edge &e,
+                             const std::vector<double> &heights,
+                             bool corrected_formulas) {
+  const double h1 = heights[3 * e.face[0] + e.opposite[0]];
+  if (e.face[1] < 0) {
+    return h1 > 0 ? 1.0 : 0.0;
+  }
+  if (!corrected_formulas) {
+    return 1.0;
+  }
+  return h1 + heights[3 * e.face[1] + e.opposite[1]] > 0 ? 1.0 : -1.0;
+}
+
+/* energy_density_EMethod<Wk, star> of the mesh with the given faces over
+ * points, which is the same number for a Mesh_T holding them. Weights are
+ * ignored. adjacency comes from soup_build_adjacency */
+template <int Wk, int star>
+double soup_energy_EMethod(const point_set &points,
+                           const std::vector<std::array<int, 3>> &triangles,
+                           const soup_adjacency &adjacency,
+                           bool corrected_formulas) {
+  const std::vector<double> heights = soup_heights(points, triangles);
+  return parallel_sum(adjacency.edges.size(), [&](std::size_t i) {
+    const soup_edge &e = adjacency.edges[i];
+    const double sign = soup_edge_sign(e, heights, corrected_formulas);
+    if (sign == 0) {
+      return 0.0;
+    }
+    // subtri_energy<Wk, star> is both halves, dij and dji
+    const double d = soup_half_length(points, triangles, e);
+    double energy = 2 * subtri_energy_weights<Wk, star>(
+                            d, heights[3 * e.face[0] + e.opposite[0]]);
+    if (e.face[1] >= 0) {
+      energy += 2 * subtri_energy_weights<Wk, star>(
+                        d, heights[3 * e.face[1] + e.opposite[1]]);
+    }
+    return sign * energy;
+  });
+}
+
+/* soup_energy_EMethod, and its gradient with respect to every point in
+ * gradient (x and y of point v at 2 v and 2 v + 1; 0 for points in no
+ * face). The sign factors are held fixed, as they are piecewise constant.
+ *
+ * One sweep over the edges gives the derivatives of each edge energy with
+ * respect to its half length and the heights of its faces, each stored in
+ * the face side it belongs to. A sweep over the faces turns them into the
+ * gradient with respect to the three corners, and each vertex sums its
+ * incident corners. Every entry has one writer, so nothing is locked and
+ * the sums don't depend on the number of threads */
+template <int Wk, int star>
+double soup_energy_gradient_EMethod(
+    const point_set &points, const std::vector<std::array<int, 3>> &triangles,
+    const soup_adjacency &adjacency, bool corrected_formulas,
+    std::vector<double> &gradient) {
+  const std::vector<double> heights = soup_heights(points, triangles);
+  const std::size_t num_faces = triangles.size();
+  // derivatives of the energy of the edge across each face side with
+  // respect to its half length and to the height of this side
+  std::vector<double> dE_dd(3 * num_faces, 0.0), dE_dh(3 * num_faces, 0.0);
+
+  const double energy = parallel_sum(adjacency.edges.size(), [&](std::size_t i) {
+    const soup_edge &e = adjacency.edges[i];
+    const double sign = soup_edge_sign(e, heights, corrected_formulas);
+    if (sign == 0) {
+      return 0.0;
+    }
+    const double d = soup_half_length(points, triangles, e);
+    double edge_energy = 0;
+    for (int side = 0; side < 2 && e.face[side] >= 0; side++) {
+      const int slot = 3 * e.face[side] + e.opposite[side];
+      double dd, dh;
+      subtri_energy_weights_deriv<Wk, star>(d, heights[slot], dd, dh);
+      edge_energy += 2 * subtri_energy_weights<Wk, star>(d, heights[slot]);
+      dE_dd[slot] = 2 * sign * dd;
+      dE_dh[slot] = 2 * sign * dh;
+    }
+    return sign * edge_energy;
+  });
+
+  std::vector<std::array<double, 6>> corner_gradient(num_faces);
+  parallel_for(num_faces, [&](int, std::size_t begin, std::size_t end) {
+    for (std::size_t f = begin; f < end; f++) {
+      const std::array<int, 3> &t = triangles[f];
+      std::array<double, 6> &g = corner_gradient[f];
+      g.fill(0.0);
+      for (int k = 0; k < 3; k++) {
+        const int slot = 3 * f + k;
+        if (dE_dd[slot] == 0 && dE_dh[slot] == 0) {
+          continue;
+        }
+        double grad_h[3][2];
+        soup_height(points, t, k, grad_h);
+        const int i = (k + 1) % 3, j = (k + 2) % 3;
+        const double ex = points.x(t[j]) - points.x(t[i]);
+        const double ey = points.y(t[j]) - points.y(t[i]);
+        // d = |e| / 2
+        const double c_d = dE_dd[slot] * 0.5 / std::hypot(ex, ey);
+        for (int c = 0; c < 3; c++) {
+          g[2 * c] += dE_dh[slot] * grad_h[c][0];
+          g[2 * c + 1] += dE_dh[slot] * grad_h[c][1];
+        }
+        g[2 * i] -= c_d * ex;
+        g[2 * i + 1] -= c_d * ey;
+        g[2 * j] += c_d * ex;
+        g[2 * j + 1] += c_d * ey;
+      }
+    }
+  });
+
+  const std::size_t n = points.size();
+  gradient.assign(2 * n, 0.0);
+  parallel_for(n, [&](int, std::size_t begin, std::size_t end) {
+    for (std::size_t v = begin; v < end; v++) {
+      for (int k = adjacency.start[v]; k < adjacency.start[v + 1]; k++) {
+        const int corner = adjacency.incident[k];
+        const std::array<double, 6> &g = corner_gradient[corner / 3];
+        gradient[2 * v] += g[2 * (corner % 3)];
+        gradient[2 * v + 1] += g[2 * (corner % 3) + 1];
+      }
+    }
+  });
+  return energy;
+}
+
+#endif // _SOUP_ENERGY_HPP_
@@ -0,0 +1,246 @@
+// spec.hpp
+// a small JSON reader for experiment specs. As in YAML, # starts a comment
+// that runs to the end of the line, and a list may end with a comma
+#ifndef _SPEC_HPP_
+#define _SPEC_HPP_
+
+#include <cctype>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "log.hpp"
+#include "point_io.hpp"
+
+struct spec_value {
+  enum kind_t { null_kind, bool_kind, number_kind, string_kind, array_kind, object_kind };
+
+  kind_t kind = null_kind;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<spec_value> items;
+  std::vector<std::pair<std::string, spec_value>> members;
+
+  bool is_number() const { return kind == number_kind; }
+  bool is_string() const { return kind == string_kind; }
+  bool is_array() const { return kind == array_kind; }
+  bool is_object() const { return kind == object_kind; }
+
+  /* The member named key of an object, or null if there is none */
+  const spec_value *find(const std::string &key) const {
+    for (const std::pair<std::string, spec_value> &m : members) {
+      if (m.first == key) {
+        return &m.second;
+      }
+    }
+    return nullptr;
+  }
+};
+
+/* Recursive descent over a '\0' terminated buffer. On an error, error is
+ * set to a message and the line it was found on */
+class spec_parser {
+public:
+  explicit spec_parser(const char *text) : c_(text), line_(1) {}
+
+  bool parse(spec_value &value, std::string &error) {
+    if (!parse_value(value, 0)) {
+      error = error_ + " on line " + std::to_string(line_);
+      return false;
+    }
+    skip_space();
+    if (*c_ != '\0') {
+      error = "text after the end on line " + std::to_string(line_);
+      return false;
+    }
+    return true;
+  }
+
+private:
+  // deeper than any spec, and well short of the stack
+  static constexpr int max_depth = 64;
+
+  void skip_space() {
+    for (;;) {
+      if (*c_ == '\n') {
+        line_++;
+        c_++;
+      } else if (std::isspace(static_cast<unsigned char>(*c_))) {
+        c_++;
+      } else if (*c_ == '#') {
+        while (*c_ != '\0' && *c_ != '\n') {
+          c_++;
+        }
+      } else {
+        return;
+      }
+    }
+  }
+
+  bool fail(const std::string &message) {
+    error_ = message;
+    return false;
+  }
+
+  bool parse_value(spec_value &value, int depth) {
+    if (depth > max_depth) {
+      return fail("too deeply nested");
+    }
+    skip_space();
+    if (*c_ == '{') {
+      return parse_object(value, depth);
+    }
+    if (*c_ == '[') {
+      return parse_array(value, depth);
+    }
+    if (*c_ == '"') {
+      value.kind = spec_value::string_kind;
+      return parse_string(value.string);
+    }
+    if (match("true")) {
+      value.kind = spec_value::bool_kind;
+      value.boolean = true;
+      return true;
+    }
+    if (match("false")) {
+      value.kind = spec_value::bool_kind;
+      value.boolean = false;
+      return true;
+    }
+    if (match("null")) {
+      value.kind = spec_value::null_kind;
+      return true;
+    }
+    const char *end;
+    value.number = parse_number(c_, &end);
+    if (end == c_) {
+      return fail("expected a value");
+    }
+    value.kind = spec_value::number_kind;
+    c_ = end;
+    return true;
+  }
+
+  bool match(const char *word) {
+    const std::size_t length = std::char_traits<char>::length(word);
+    if (std::char_traits<char>::compare(c_, word, length) != 0 ||
+        std::isalnum(static_cast<unsigned char>(c_[length]))) {
+      return false;
+    }
+    c_ += length;
+    return true;
+  }
+
+  bool parse_string(std::string &s) {
+    s.clear();
+    for (c_++; *c_ != '"'; c_++) {
+      if (*c_ == '\0' || *c_ == '\n') {
+        return fail("unterminated string");
+      }
+      if (*c_ == '\\') {
+        c_++;
+        switch (*c_) {
+        case 'n':
+          s += '\n';
+          break;
+        case 't':
+          s += '\t';
+          break;
+        case '"':
+        case '\\':
+        case '/':
+          s += *c_;
+          break;
+        default:
+          return fail("unsupported escape in string");
+        }
+      } else {
+        s += *c_;
+      }
+    }
+    c_++;
+    return true;
+  }
+
+  bool parse_array(spec_value &value, int depth) {
+    value.kind = spec_value::array_kind;
+    c_++;
+    for (;;) {
+      skip_space();
+      if (*c_ == ']') {
+        c_++;
+        return true;
+      }
+      value.items.push_back(spec_value());
+      if (!parse_value(value.items.back(), depth + 1)) {
+        return false;
+      }
+      skip_space();
+      if (*c_ == ',') {
+        c_++;
+      } else if (*c_ != ']') {
+        return fail("expected , or ]");
+      }
+    }
+  }
+
+  bool parse_object(spec_value &value, int depth) {
+    value.kind = spec_value::object_kind;
+    c_++;
+    for (;;) {
+      skip_space();
+      if (*c_ == '}') {
+        c_++;
+        return true;
+      }
+      if (*c_ != '"') {
+        return fail("expected a quoted name");
+      }
+      std::string key;
+      if (!parse_string(key)) {
+        return false;
+      }
+      skip_space();
+      if (*c_ != ':') {
+        return fail("expected : after \"" + key + "\"");
+      }
+      c_++;
+      value.members.push_back(std::make_pair(key, spec_value()));
+      if (!parse_value(value.members.back().second, depth + 1)) {
+        return false;
+      }
+      skip_space();
+      if (*c_ == ',') {
+        c_++;
+      } else if (*c_ != '}') {
+        return fail("expected , or }");
+      }
+    }
+  }
+
+  const char *c_;
+  int line_;
+  std::string error_;
+};
+
+inline bool parse_spec(const std::string &text, spec_value &value,
+                       std::string &error) {
+  return spec_parser(text.c_str()).parse(value, error);
+}
+
+inline bool read_spec(const std::string &path, spec_value &value) {
+  std::vector<char> buffer;
+  if (!read_file(path, buffer)) {
+    return false;
+  }
+  std::string error;
+  if (!spec_parser(buffer.data()).parse(value, error)) {
+    HOT_WARN(path << ": " << error);
+    return false;
+  }
+  return true;
+}
+
+#endif // _SPEC_HPP_
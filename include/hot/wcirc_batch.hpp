@@ -0,0 +1,135 @@
+// wcirc_batch.hpp
+// Weighted circumcenters of every face of a regular triangulation at once.
+// The faces are gathered into structure of arrays form, so the circumcenter
+// loop is branch free and vectorizes, and it is split across threads.
+#ifndef _WCIRC_BATCH_HPP_
+#define _WCIRC_BATCH_HPP_
+
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+
+#include "parallel.hpp"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define HOT_RESTRICT __restrict__
+#else
+#define HOT_RESTRICT
+#endif
+
+/* Weighted circumcenter of (x0, x1, x2) with weights (w0, w1, w2): the point
+ * c with |c - xi|^2 - wi equal for all three vertices. Solves
+ *   (x1 - x0) . (c - x0) = (|x1 - x0|^2 + w0 - w1) / 2
+ *   (x2 - x0) . (c - x0) = (|x2 - x0|^2 + w0 - w2) / 2
+ * by Cramer's rule, which needs no orientation test */
+inline void weighted_circumcenter_kernel(double x0, double y0, double x1,
+                                         double y1, double x2, double y2,
+                                         double w0, double w1, double w2,
+                                         double &cx, double &cy) {
+  const double r1x = x1 - x0, r1y = y1 - y0;
+  const double r2x = x2 - x0, r2y = y2 - y0;
+  const double b1 = 0.5 * (r1x * r1x + r1y * r1y + w0 - w1);
+  const double b2 = 0.5 * (r2x * r2x + r2y * r2y + w0 - w2);
+  const double inv_det = 1.0 / (r1x * r2y - r1y * r2x);
+  cx = x0 + (b1 * r2y - b2 * r1y) * inv_det;
+  cy = y0 + (b2 * r1x - b1 * r2x) * inv_det;
+}
+
+/* Unsigned area of the face (x[i], y[i]) */
+inline double triangle_area_kernel(const double x[3], const double y[3]) {
+  return 0.5 * std::fabs((x[1] - x[0]) * (y[2] - y[0]) -
+                         (x[2] - x[0]) * (y[1] - y[0]));
+}
+
+/* Faces of a triangulation in structure of arrays form, along with their
+ * weighted circumcenters. faces[i] is the handle of face i */
+template <typename T> struct weighted_face_batch {
+  std::vector<typename T::Face_handle> faces;
+  std::vector<double> x0, y0, x1, y1, x2, y2;
+  std::vector<double> w0, w1, w2;
+  std::vector<double> cx, cy;
+
+  std::size_t size() const { return faces.size(); }
+
+  void resize(std::size_t n) {
+    faces.resize(n);
+    for (std::vector<double> *column :
+         {&x0, &y0, &x1, &y1, &x2, &y2, &w0, &w1, &w2, &cx, &cy}) {
+      column->resize(n);
+    }
+  }
+
+  /* The vertices and weights of face i. Per face work in the parallel loops
+   * reads these columns rather than the faces, since copying CGAL's reference
+   * counted points from several threads at once is a data race */
+  void vertices(std::size_t i, double x[3], double y[3], double w[3]) const {
+    x[0] = x0[i];
+    x[1] = x1[i];
+    x[2] = x2[i];
+    y[0] = y0[i];
+    y[1] = y1[i];
+    y[2] = y2[i];
+    w[0] = w0[i];
+    w[1] = w1[i];
+    w[2] = w2[i];
+  }
+};
+
+/* Computes the weighted circumcenters of faces [begin, end) */
+inline void weighted_circumcenters_soa(
+    const double *HOT_RESTRICT x0, const double *HOT_RESTRICT y0,
+    const double *HOT_RESTRICT x1, const double *HOT_RESTRICT y1,
+    const double *HOT_RESTRICT x2, const double *HOT_RESTRICT y2,
+    const double *HOT_RESTRICT w0, const double *HOT_RESTRICT w1,
+    const double *HOT_RESTRICT w2, double *HOT_RESTRICT cx,
+    double *HOT_RESTRICT cy, std::size_t begin, std::size_t end) {
+  for (std::size_t i = begin; i < end; i++) {
+    // Through locals, so the stores don't look like they alias the loads
+    double c_x, c_y;
+    weighted_circumcenter_kernel(x0[i], y0[i], x1[i], y1[i], x2[i], y2[i],
+                                 w0[i], w1[i], w2[i], c_x, c_y);
+    cx[i] = c_x;
+    cy[i] = c_y;
+  }
+}
+
+/* Weighted circumcenters of every face in the batch, in parallel */
+template <typename T>
+void compute_weighted_circumcenters(weighted_face_batch<T> &batch) {
+  parallel_for(batch.size(), [&](int, std::size_t begin, std::size_t end) {
+    weighted_circumcenters_soa(
+        batch.x0.data(), batch.y0.data(), batch.x1.data(), batch.y1.data(),
+        batch.x2.data(), batch.y2.data(), batch.w0.data(), batch.w1.data(),
+        batch.w2.data(), batch.cx.data(), batch.cy.data(), begin, end);
+  });
+}
+
+/* Gathers the finite faces of the regular triangulation t and computes
+ * their weighted circumcenters */
+template <typename T> weighted_face_batch<T> weighted_faces(const T &t) {
+  weighted_face_batch<T> batch;
+  batch.resize(t.number_of_faces());
+  std::size_t i = 0;
+  for (auto face_itr = t.finite_faces_begin();
+       face_itr != t.finite_faces_end(); face_itr++, i++) {
+    batch.faces[i] = face_itr;
+    const auto &p0 = face_itr->vertex(0)->point();
+    const auto &p1 = face_itr->vertex(1)->point();
+    const auto &p2 = face_itr->vertex(2)->point();
+    batch.x0[i] = CGAL::to_double(p0.x());
+    batch.y0[i] = CGAL::to_double(p0.y());
+    batch.w0[i] = CGAL::to_double(p0.weight());
+    batch.x1[i] = CGAL::to_double(p1.x());
+    batch.y1[i] = CGAL::to_double(p1.y());
+    batch.w1[i] = CGAL::to_double(p1.weight());
+    batch.x2[i] = CGAL::to_double(p2.x());
+    batch.y2[i] = CGAL::to_double(p2.y());
+    batch.w2[i] = CGAL::to_double(p2.weight());
+  }
+  batch.resize(i);
+  compute_weighted_circumcenters(batch);
+  return batch;
+}
+
+#endif // _WCIRC_BATCH_HPP_
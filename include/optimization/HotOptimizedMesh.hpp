@@ -0,0 +1,31 @@
+#ifndef _HOT_OPTIMIZED_MESH_HPP_
+#define _HOT_OPTIMIZED_MESH_HPP_
+
+#include "OptimizedMesh.hpp"
+#include "analytic_energyWeights_Derv.hpp"
+#include "hot_hessian.hpp"
+
+/* Optimizes the *star-HOT_2 energy of a DT, CDT or RegT. On a RegT the
+ * weights are optimized along with the positions (weighted-HOT); on the
+ * unweighted triangulations the weights are zero and this is the energy
+ * of energy_density_TMethod<2, star> */
+template <typename Mesh, int star = 1>
+class HotOptimizedMesh
+    : public OptimizedMesh<HotOptimizedMesh<Mesh, star>, Mesh> {
+public:
+  explicit HotOptimizedMesh(Mesh &mesh)
+      : OptimizedMesh<HotOptimizedMesh<Mesh, star>, Mesh>(mesh) {}
+
+  double face_energy(const double x[3][2], const double w[3],
+                     double grad_x[3][2], double grad_w[3]) const {
+    return hot_face_kernel<star>()(x, w, grad_x, grad_w);
+  }
+
+  // for newton_optimize
+  double face_hessian(const double x[3][2], const double w[3], double grad[6],
+                      double hess[6][6]) const {
+    return hot_face_hessian<2, star>(x, w, grad, hess);
+  }
+};
+
+#endif // _HOT_OPTIMIZED_MESH_HPP_
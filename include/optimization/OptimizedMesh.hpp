@@ -0,0 +1,610 @@
+#ifndef _OPTIMIZED_MESH_HPP_
+#define _OPTIMIZED_MESH_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <CGAL/Constrained_Delaunay_triangulation_2.h>
+
+#include "analytic_energyWeights_Derv.hpp"
+#include "hot.hpp"
+#include "indexed_triangulation.hpp"
+#include "log.hpp"
+#include "sparse_newton.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  POLICY BASED MESH OPTIMIZATION //////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// OptimizedMesh runs gradient descent on the free vertices of a triangulation
+// for any energy which is a sum over the finite faces. The energy is supplied
+// by the derived class (CRTP), so the per face call is resolved at compile
+// time and inlines into the face loop, and the triangulation specific parts
+// (which vertices may move, how to move them) come from mesh_traits.
+
+/* Triangulation policy: the raw vertex and face layout used by the face
+ * kernels, which vertices are free, and how a vertex is moved. The primary
+ * template is left undefined so unsupported triangulations fail to compile */
+template <typename Mesh> struct mesh_traits;
+
+/* Delaunay triangulations: unweighted, every vertex off the hull is free */
+template <typename Gt, typename Tds>
+struct mesh_traits<CGAL::Delaunay_triangulation_2<Gt, Tds>> {
+  using Mesh = CGAL::Delaunay_triangulation_2<Gt, Tds>;
+  static constexpr bool weighted = false;
+
+  static void vertex_coordinates(const typename Mesh::Vertex_handle &v,
+                                 double x[2], double &w) {
+    x[0] = CGAL::to_double(v->point().x());
+    x[1] = CGAL::to_double(v->point().y());
+    w = 0.0;
+  }
+
+  static void face_coordinates(const typename Mesh::Face_handle &face,
+                               double x[3][2], double w[3]) {
+    for (int v = 0; v < 3; v++) {
+      vertex_coordinates(face->vertex(v), x[v], w[v]);
+    }
+  }
+
+  static bool is_free(const Mesh &, const typename Mesh::Vertex_handle &) {
+    return true;
+  }
+
+  /* A move onto another vertex is refused, leaving v where it was */
+  static typename Mesh::Vertex_handle move(Mesh &mesh,
+                                           typename Mesh::Vertex_handle v,
+                                           double x, double y, double) {
+    mesh.move_if_no_collision(v, typename Mesh::Point(x, y));
+    return v;
+  }
+};
+
+/* Moves a vertex of rt to a new weighted point by a local remove and
+ * hinted re-insert, rather than rebuilding the triangulation.
+ * CGAL takes care of the hidden vertices: removing v re-inserts the
+ * points it was hiding, and the new point may itself end up hidden (the
+ * returned handle then has is_hidden() set), or hide its neighbors.
+ * T is any CGAL::Regular_triangulation_2 */
+template <typename T>
+typename T::Vertex_handle move_weighted_vertex(
+    T &rt, typename T::Vertex_handle v,
+    const typename T::Weighted_point &wp) {
+  typename T::Face_handle hint;
+  typename T::Vertex_handle neighbor;
+  if (v->is_hidden()) {
+    // Hidden vertices live in the face which contains them, which is
+    // not modified by removing the hidden vertex
+    hint = v->face();
+  } else {
+    typename T::Vertex_circulator vc = rt.incident_vertices(v), done(vc);
+    while (rt.is_infinite(vc) && ++vc != done) {
+    }
+    neighbor = vc;
+  }
+  rt.remove(v);
+  if (neighbor != typename T::Vertex_handle()) {
+    hint = neighbor->face();
+  }
+  return rt.insert(wp, hint);
+}
+
+/* Regular triangulations: weighted. Hidden vertices are not iterated by
+ * finite_vertices, so they are frozen until they reappear */
+template <typename Gt, typename Tds>
+struct mesh_traits<CGAL::Regular_triangulation_2<Gt, Tds>> {
+  using Mesh = CGAL::Regular_triangulation_2<Gt, Tds>;
+  static constexpr bool weighted = true;
+
+  static void vertex_coordinates(const typename Mesh::Vertex_handle &v,
+                                 double x[2], double &w) {
+    x[0] = CGAL::to_double(v->point().x());
+    x[1] = CGAL::to_double(v->point().y());
+    w = CGAL::to_double(v->point().weight());
+  }
+
+  static void face_coordinates(const typename Mesh::Face_handle &face,
+                               double x[3][2], double w[3]) {
+    weighted_face_coordinates(face, x, w);
+  }
+
+  static bool is_free(const Mesh &, const typename Mesh::Vertex_handle &) {
+    return true;
+  }
+
+  static typename Mesh::Vertex_handle move(Mesh &mesh,
+                                           typename Mesh::Vertex_handle v,
+                                           double x, double y, double w) {
+    return move_weighted_vertex(
+        mesh, v,
+        typename Mesh::Weighted_point(typename Mesh::Bare_point(x, y), w));
+  }
+};
+
+/* Whether p is already a vertex of tr other than v. Moving v there by a
+ * remove and insert would merge it into that vertex, leaving the handle
+ * pointing at another vertex and one vertex fewer */
+template <typename Tr>
+bool lands_on_other_vertex(const Tr &tr, typename Tr::Vertex_handle v,
+                           const typename Tr::Point &p) {
+  typename Tr::Locate_type lt;
+  int li;
+  typename Tr::Face_handle face = tr.locate(p, lt, li, v->face());
+  return lt == Tr::VERTEX && face->vertex(li) != v;
+}
+
+/* Constrained Delaunay triangulations: unweighted, and vertices on a
+ * constraint stay put along with the hull */
+template <typename Gt, typename Tds, typename Itag>
+struct mesh_traits<CGAL::Constrained_Delaunay_triangulation_2<Gt, Tds, Itag>> {
+  using Mesh = CGAL::Constrained_Delaunay_triangulation_2<Gt, Tds, Itag>;
+  static constexpr bool weighted = false;
+
+  static void vertex_coordinates(const typename Mesh::Vertex_handle &v,
+                                 double x[2], double &w) {
+    x[0] = CGAL::to_double(v->point().x());
+    x[1] = CGAL::to_double(v->point().y());
+    w = 0.0;
+  }
+
+  static void face_coordinates(const typename Mesh::Face_handle &face,
+                               double x[3][2], double w[3]) {
+    for (int v = 0; v < 3; v++) {
+      vertex_coordinates(face->vertex(v), x[v], w[v]);
+    }
+  }
+
+  static bool is_free(const Mesh &mesh,
+                      const typename Mesh::Vertex_handle &v) {
+    return !mesh.are_there_incident_constraints(v);
+  }
+
+  /* CDT has no move, so remove and re-insert with a neighbor's face as
+   * the hint. remove is only allowed on a vertex with no incident
+   * constraints, so a move of a constrained vertex is refused, leaving v
+   * where it was, as is a move onto another vertex */
+  static typename Mesh::Vertex_handle move(Mesh &mesh,
+                                           typename Mesh::Vertex_handle v,
+                                           double x, double y, double) {
+    const typename Mesh::Point p(x, y);
+    if (mesh.are_there_incident_constraints(v) ||
+        lands_on_other_vertex(mesh, v, p)) {
+      return v;
+    }
+    typename Mesh::Vertex_circulator vc = mesh.incident_vertices(v), done(vc);
+    while (mesh.is_infinite(vc) && ++vc != done) {
+    }
+    typename Mesh::Vertex_handle neighbor = vc;
+    mesh.remove(v);
+    return mesh.insert(p, neighbor->face());
+  }
+};
+
+/* Indexed triangulations: as Tr, but moved through the wrapper so the
+ * vertex indices are kept */
+template <typename Tr>
+struct mesh_traits<Indexed_triangulation<Tr>> : mesh_traits<Tr> {
+  using Mesh = Indexed_triangulation<Tr>;
+
+  static typename Mesh::Vertex_handle move(Mesh &mesh,
+                                           typename Mesh::Vertex_handle v,
+                                           double x, double y, double w) {
+    return move(mesh, v, x, y, w,
+                std::integral_constant<bool, mesh_traits<Tr>::weighted>());
+  }
+
+private:
+  static typename Mesh::Vertex_handle
+  move(Mesh &mesh, typename Mesh::Vertex_handle v, double x, double y, double,
+       std::false_type) {
+    mesh.move_if_no_collision(v, typename Mesh::Point(x, y));
+    return v;
+  }
+
+  static typename Mesh::Vertex_handle
+  move(Mesh &mesh, typename Mesh::Vertex_handle v, double x, double y,
+       double w, std::true_type) {
+    return mesh.reinsert(
+        v, typename Mesh::Weighted_point(typename Mesh::Bare_point(x, y), w));
+  }
+};
+
+struct mesh_optimize_params {
+  // initial gradient step, adapted by the backtracking line search
+  double step = 1e-2;
+  int max_iterations = 100;
+  int max_backtracks = 20;
+  // stop once an accepted step lowers the energy by less than this
+  double min_delta_energy = 1e-12;
+  bool optimize_positions = true;
+  // only used for weighted triangulations
+  bool optimize_weights = true;
+};
+
+struct mesh_optimize_result {
+  int iterations;
+  double energy;
+};
+
+struct newton_params {
+  int max_iterations = 50;
+  // stop once the gradient norm is below this
+  double gradient_tolerance = 1e-10;
+  // trust region radius, in the scaled norm of steihaug_cg, which is about
+  // the length of a vertex displacement
+  double initial_radius = 0.1;
+  double max_radius = 1.0;
+  // steps which achieve less than this fraction of the predicted decrease
+  // are rejected
+  double accept_ratio = 0.1;
+  // CG iterations per step, 0 for the number of unknowns
+  int max_cg_iterations = 0;
+};
+
+struct newton_result {
+  int iterations;
+  double energy;
+  double gradient_norm;
+  // total over all steps
+  int cg_iterations;
+};
+
+/* The position of each free vertex in the free vertex list, -1 for the
+ * fixed ones, which is where the gradient of a face corner is scattered.
+ * Assigned once per iteration. Triangulations without vertex indices key
+ * it on the vertex address */
+template <typename Mesh> class vertex_slots {
+public:
+  using Vertex_handle = typename Mesh::Vertex_handle;
+
+  void assign(const Mesh &, const std::vector<Vertex_handle> &verts) {
+    slots_.clear();
+    slots_.reserve(verts.size());
+    for (size_t i = 0; i < verts.size(); i++) {
+      slots_[&*verts[i]] = i;
+    }
+  }
+
+  int operator()(const Vertex_handle &v) const {
+    auto slot_itr = slots_.find(&*v);
+    return slot_itr == slots_.end() ? -1 : slot_itr->second;
+  }
+
+private:
+  std::unordered_map<const void *, int> slots_;
+};
+
+/* Indexed triangulations number their vertices densely, so the slots are a
+ * flat array */
+template <typename Tr> class vertex_slots<Indexed_triangulation<Tr>> {
+public:
+  using Mesh = Indexed_triangulation<Tr>;
+  using Vertex_handle = typename Mesh::Vertex_handle;
+
+  void assign(const Mesh &mesh, const std::vector<Vertex_handle> &verts) {
+    slots_.assign(mesh.number_of_indexed_vertices(), -1);
+    for (size_t i = 0; i < verts.size(); i++) {
+      slots_[verts[i]->index()] = i;
+    }
+  }
+
+  int operator()(const Vertex_handle &v) const {
+    return v->index() < 0 ? -1 : slots_[v->index()];
+  }
+
+private:
+  std::vector<int> slots_;
+};
+
+/* Derived must provide
+ *   double face_energy(const double x[3][2], const double w[3],
+ *                      double grad_x[3][2], double grad_w[3]) const;
+ * with the kernel layout of analytic_energyWeights_Derv.hpp. The mesh is
+ * held by reference and optimized in place */
+template <typename Derived, typename Mesh> class OptimizedMesh {
+public:
+  using traits = mesh_traits<Mesh>;
+  using Vertex_handle = typename Mesh::Vertex_handle;
+
+  explicit OptimizedMesh(Mesh &mesh) : mesh_(mesh) {}
+
+  Mesh &mesh() { return mesh_; }
+  const Mesh &mesh() const { return mesh_; }
+
+  /* The finite vertices which are neither on the convex hull nor pinned by
+   * the traits */
+  std::vector<Vertex_handle> free_vertices() const {
+    std::vector<Vertex_handle> verts;
+    verts.reserve(mesh_.number_of_vertices());
+    for (auto v_itr = mesh_.finite_vertices_begin();
+         v_itr != mesh_.finite_vertices_end(); v_itr++) {
+      if (!is_hull_vertex(mesh_, v_itr) && traits::is_free(mesh_, v_itr)) {
+        verts.push_back(v_itr);
+      }
+    }
+    return verts;
+  }
+
+  double energy() const {
+    return energy_and_gradient(nullptr, nullptr, nullptr);
+  }
+
+  /* Sums the face energies over the finite faces. If slots is non-null,
+   * the face gradients are scattered into grad_x (2 entries per vertex)
+   * and grad_w for the vertices with a slot */
+  double energy_and_gradient(const vertex_slots<Mesh> *slots,
+                             std::vector<double> *grad_x,
+                             std::vector<double> *grad_w) const {
+    const Derived &derived = static_cast<const Derived &>(*this);
+    double energy = 0;
+    for (auto face_itr = mesh_.finite_faces_begin();
+         face_itr != mesh_.finite_faces_end(); face_itr++) {
+      double x[3][2], w[3], gx[3][2], gw[3];
+      traits::face_coordinates(face_itr, x, w);
+      energy += derived.face_energy(x, w, gx, gw);
+      if (slots == nullptr) {
+        continue;
+      }
+      for (int v = 0; v < 3; v++) {
+        const int idx = (*slots)(face_itr->vertex(v));
+        if (idx < 0) {
+          continue;
+        }
+        (*grad_x)[2 * idx] += gx[v][0];
+        (*grad_x)[2 * idx + 1] += gx[v][1];
+        (*grad_w)[idx] += gw[v];
+      }
+    }
+    return energy;
+  }
+
+  /* Gradient descent on the free vertices with a backtracking line search.
+   * The mesh is updated one vertex at a time, so
+   * connectivity changes are handled incrementally by CGAL */
+  mesh_optimize_result
+  optimize(const mesh_optimize_params &params = mesh_optimize_params()) {
+    mesh_optimize_result result;
+    result.iterations = 0;
+    result.energy = energy();
+
+    const bool move_weights = traits::weighted && params.optimize_weights;
+    double step = params.step;
+    for (; result.iterations < params.max_iterations; result.iterations++) {
+      std::vector<Vertex_handle> verts = free_vertices();
+      if (verts.empty()) {
+        break;
+      }
+      vertex_slots<Mesh> slots;
+      slots.assign(mesh_, verts);
+      std::vector<double> initial(3 * verts.size());
+      for (size_t i = 0; i < verts.size(); i++) {
+        traits::vertex_coordinates(verts[i], &initial[3 * i],
+                                   initial[3 * i + 2]);
+      }
+      std::vector<double> grad_x(2 * verts.size(), 0.0);
+      std::vector<double> grad_w(verts.size(), 0.0);
+      const double current = energy_and_gradient(&slots, &grad_x, &grad_w);
+      if (!params.optimize_positions) {
+        std::fill(grad_x.begin(), grad_x.end(), 0.0);
+      }
+      if (!move_weights) {
+        std::fill(grad_w.begin(), grad_w.end(), 0.0);
+      }
+
+      double new_energy = std::numeric_limits<double>::infinity();
+      for (int backtrack = 0; backtrack < params.max_backtracks; backtrack++) {
+        for (size_t i = 0; i < verts.size(); i++) {
+          verts[i] = traits::move(mesh_, verts[i],
+                                  initial[3 * i] - step * grad_x[2 * i],
+                                  initial[3 * i + 1] - step * grad_x[2 * i + 1],
+                                  initial[3 * i + 2] - step * grad_w[i]);
+        }
+        new_energy = energy();
+        if (new_energy < current) {
+          step *= 1.5;
+          break;
+        }
+        // Undo the step and try a shorter one
+        for (size_t i = 0; i < verts.size(); i++) {
+          verts[i] = traits::move(mesh_, verts[i], initial[3 * i],
+                                  initial[3 * i + 1], initial[3 * i + 2]);
+        }
+        new_energy = current;
+        step *= 0.5;
+      }
+
+      result.energy = new_energy;
+      log_iteration({"OptimizedMesh", result.iterations, new_energy,
+                     std::sqrt(std::inner_product(grad_x.begin(), grad_x.end(),
+                                                  grad_x.begin(), 0.0) +
+                               std::inner_product(grad_w.begin(), grad_w.end(),
+                                                  grad_w.begin(), 0.0)),
+                     step, 0});
+      if (current - new_energy < params.min_delta_energy) {
+        result.iterations++;
+        break;
+      }
+    }
+    return result;
+  }
+
+  /* Trust region Newton on the free vertex positions. Derived must also
+   * provide
+   *   double face_hessian(const double x[3][2], const double w[3],
+   *                       double grad[6], double hess[6][6]) const;
+   * giving the face energy with its gradient and Hessian with respect to
+   * the positions, variable 2 v + a for x[v][a]. The weights are held
+   * fixed. Each step assembles the 2V x 2V Hessian in CSR form and solves
+   * for the step with steihaug_cg, so indefinite Hessians are handled by
+   * the trust region. Connectivity changes from a step are taken into
+   * account by the actual to predicted decrease ratio */
+  newton_result
+  newton_optimize(const newton_params &params = newton_params()) {
+    const Derived &derived = static_cast<const Derived &>(*this);
+    newton_result result = {0, energy(), 0.0, 0};
+    double radius = params.initial_radius;
+
+    for (; result.iterations < params.max_iterations; result.iterations++) {
+      std::vector<Vertex_handle> verts = free_vertices();
+      if (verts.empty()) {
+        break;
+      }
+      const int n = 2 * verts.size();
+      vertex_slots<Mesh> slots;
+      slots.assign(mesh_, verts);
+      std::vector<double> initial(3 * verts.size());
+      for (size_t i = 0; i < verts.size(); i++) {
+        traits::vertex_coordinates(verts[i], &initial[3 * i],
+                                   initial[3 * i + 2]);
+      }
+
+      // Face blocks first, then the pattern, then the assembly
+      struct face_block {
+        int vertex[3];
+        double grad[6];
+        double hess[6][6];
+      };
+      std::vector<face_block> blocks;
+      std::vector<std::pair<int, int>> entries;
+      double current = 0.0;
+      for (auto face_itr = mesh_.finite_faces_begin();
+           face_itr != mesh_.finite_faces_end(); face_itr++) {
+        face_block block;
+        bool any_free = false;
+        for (int v = 0; v < 3; v++) {
+          block.vertex[v] = slots(face_itr->vertex(v));
+          any_free = any_free || block.vertex[v] >= 0;
+        }
+        double x[3][2], w[3];
+        traits::face_coordinates(face_itr, x, w);
+        current += derived.face_hessian(x, w, block.grad, block.hess);
+        if (!any_free) {
+          continue;
+        }
+        for (int u = 0; u < 3; u++) {
+          for (int v = 0; v < 3; v++) {
+            if (block.vertex[u] < 0 || block.vertex[v] < 0) {
+              continue;
+            }
+            for (int a = 0; a < 2; a++) {
+              for (int b = 0; b < 2; b++) {
+                entries.push_back(std::make_pair(2 * block.vertex[u] + a,
+                                                 2 * block.vertex[v] + b));
+              }
+            }
+          }
+        }
+        blocks.push_back(block);
+      }
+      csr_matrix hessian;
+      hessian.set_pattern(n, entries);
+      std::vector<double> grad(n, 0.0);
+      for (const face_block &block : blocks) {
+        for (int u = 0; u < 3; u++) {
+          if (block.vertex[u] < 0) {
+            continue;
+          }
+          for (int a = 0; a < 2; a++) {
+            const int row = 2 * block.vertex[u] + a;
+            grad[row] += block.grad[2 * u + a];
+            for (int v = 0; v < 3; v++) {
+              if (block.vertex[v] < 0) {
+                continue;
+              }
+              for (int b = 0; b < 2; b++) {
+                hessian.add(row, 2 * block.vertex[v] + b,
+                            block.hess[2 * u + a][2 * v + b]);
+              }
+            }
+          }
+        }
+      }
+
+      result.energy = current;
+      result.gradient_norm = std::sqrt(sparse_dot(grad, grad));
+      if (result.gradient_norm <= params.gradient_tolerance ||
+          radius < std::numeric_limits<double>::epsilon()) {
+        break;
+      }
+
+      // Inexact Newton: the forcing term shrinks with the gradient, which
+      // keeps the convergence quadratic
+      std::vector<double> step, hessian_step;
+      const steihaug_result cg = steihaug_cg(
+          hessian, grad, radius,
+          std::min(0.5, std::sqrt(result.gradient_norm)) *
+              result.gradient_norm,
+          params.max_cg_iterations > 0 ? params.max_cg_iterations : n, step);
+      result.cg_iterations += cg.iterations;
+      hessian.multiply(step, hessian_step);
+      const double predicted =
+          -(sparse_dot(grad, step) + 0.5 * sparse_dot(step, hessian_step));
+      if (!(predicted > 0)) {
+        break;
+      }
+
+      double max_displacement = 0.0;
+      for (size_t i = 0; i < verts.size(); i++) {
+        verts[i] = traits::move(mesh_, verts[i],
+                                initial[3 * i] + step[2 * i],
+                                initial[3 * i + 1] + step[2 * i + 1],
+                                initial[3 * i + 2]);
+        max_displacement = std::max(
+            max_displacement, std::hypot(step[2 * i], step[2 * i + 1]));
+      }
+      const double new_energy = energy();
+      const double ratio = (current - new_energy) / predicted;
+      if (ratio < 0.25) {
+        radius *= 0.25;
+      } else if (ratio > 0.75 && cg.on_boundary) {
+        radius = std::min(2 * radius, params.max_radius);
+      }
+      if (ratio > params.accept_ratio) {
+        result.energy = new_energy;
+      } else {
+        for (size_t i = 0; i < verts.size(); i++) {
+          verts[i] = traits::move(mesh_, verts[i], initial[3 * i],
+                                  initial[3 * i + 1], initial[3 * i + 2]);
+        }
+        max_displacement = 0.0;
+      }
+      log_iteration({"newton", result.iterations, result.energy,
+                     result.gradient_norm, radius, max_displacement});
+    }
+    return result;
+  }
+
+private:
+  Mesh &mesh_;
+};
+
+/* OptimizedMesh for any face kernel, e.g. hot_face_kernel, Sb_kernel or
+ * cvt_kite_kernel. The kernel is a template parameter, so its call inlines */
+template <typename Mesh, typename FaceKernel>
+class KernelOptimizedMesh
+    : public OptimizedMesh<KernelOptimizedMesh<Mesh, FaceKernel>, Mesh> {
+public:
+  KernelOptimizedMesh(Mesh &mesh, const FaceKernel &kernel = FaceKernel())
+      : OptimizedMesh<KernelOptimizedMesh<Mesh, FaceKernel>, Mesh>(mesh),
+        kernel(kernel) {}
+
+  double face_energy(const double x[3][2], const double w[3],
+                     double grad_x[3][2], double grad_w[3]) const {
+    return kernel(x, w, grad_x, grad_w);
+  }
+
+  FaceKernel kernel;
+};
+
+template <typename Mesh, typename FaceKernel>
+KernelOptimizedMesh<Mesh, FaceKernel>
+make_optimized_mesh(Mesh &mesh, const FaceKernel &kernel) {
+  return KernelOptimizedMesh<Mesh, FaceKernel>(mesh, kernel);
+}
+
+#endif // _OPTIMIZED_MESH_HPP_
@@ -0,0 +1,430 @@
+#ifndef _ACCELERATED_CVT_HPP_
+#define _ACCELERATED_CVT_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <vector>
+
+#include "lloyds.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  ACCELERATED CVT ////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// Lloyd's iteration is the fixed point map x -> centroids(x), and a gradient
+// step on the CVT energy E = sum_i \int_{cell i} |x - x_i|^2, whose gradient
+// is 2 m_i (x_i - c_i). Both views converge linearly and slowly, so here they
+// are accelerated by Anderson mixing and by L-BFGS respectively.
+//
+// The iterations work on flat coordinate vectors x = (x_0, y_0, x_1, ...)
+// through an evaluator, evaluate(x, moments), which projects x into the
+// domain, fills the cell moments at x, and returns the energy. cvt_sites
+// is the evaluator for sites stored in a DT.
+
+/* Closest point of the convex domain to (px, py) */
+inline void cvt_project(const cvt_domain &domain, double &px, double &py) {
+  const size_t n = domain.x.size();
+  bool inside = true;
+  double best = std::numeric_limits<double>::infinity(), bx = px, by = py;
+  for (size_t i = 0; i < n; i++) {
+    const size_t j = (i + 1) % n;
+    const double ex = domain.x[j] - domain.x[i];
+    const double ey = domain.y[j] - domain.y[i];
+    const double rx = px - domain.x[i], ry = py - domain.y[i];
+    if (ex * ry - ey * rx < 0) {
+      inside = false;
+    }
+    const double t =
+        std::min(1.0, std::max(0.0, (rx * ex + ry * ey) / (ex * ex + ey * ey)));
+    const double qx = domain.x[i] + t * ex, qy = domain.y[i] + t * ey;
+    const double d2 = (px - qx) * (px - qx) + (py - qy) * (py - qy);
+    if (d2 < best) {
+      best = d2;
+      bx = qx;
+      by = qy;
+    }
+  }
+  if (!inside) {
+    px = bx;
+    py = by;
+  }
+}
+
+/* The sites of a DT as a flat coordinate vector. Evaluating moves the
+ * vertices in place and computes their clipped cells */
+template <typename Density = uniform_density> struct cvt_sites {
+  DT &dt;
+  const cvt_domain &domain;
+  const Density &density;
+  std::vector<DT::Vertex_handle> vertices;
+
+  cvt_sites(DT &dt, const cvt_domain &domain, const Density &density)
+      : dt(dt), domain(domain), density(density) {
+    for (auto v_itr = dt.finite_vertices_begin();
+         v_itr != dt.finite_vertices_end(); v_itr++) {
+      vertices.push_back(v_itr);
+    }
+  }
+
+  std::vector<double> coordinates() const {
+    std::vector<double> x(2 * vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+      x[2 * i] = CGAL::to_double(vertices[i]->point().x());
+      x[2 * i + 1] = CGAL::to_double(vertices[i]->point().y());
+    }
+    return x;
+  }
+
+  double operator()(std::vector<double> &x,
+                    std::vector<cvt_cell_moments> &moments) {
+    for (size_t i = 0; i < vertices.size(); i++) {
+      cvt_project(domain, x[2 * i], x[2 * i + 1]);
+      const Point p(x[2 * i], x[2 * i + 1]);
+      if (vertices[i]->point() == p) {
+        continue;
+      }
+      if (dt.move_if_no_collision(vertices[i], p) != vertices[i]) {
+        // another site is already there, so this one stays put
+        x[2 * i] = CGAL::to_double(vertices[i]->point().x());
+        x[2 * i + 1] = CGAL::to_double(vertices[i]->point().y());
+      }
+    }
+    cvt_cell_moments_all(dt, vertices, domain, density, moments);
+    return parallel_sum(moments.size(),
+                        [&](size_t i) { return moments[i].energy; });
+  }
+};
+
+/* Lloyd residual f = centroids(x) - x, returning its largest site
+ * displacement. Sites with empty cells get a zero residual */
+inline double cvt_residual(const std::vector<double> &x,
+                           const std::vector<cvt_cell_moments> &moments,
+                           std::vector<double> &f) {
+  f.resize(x.size());
+  double max_displacement = 0;
+  for (size_t i = 0; i < moments.size(); i++) {
+    if (moments[i].area <= 0) {
+      f[2 * i] = f[2 * i + 1] = 0;
+      continue;
+    }
+    f[2 * i] = moments[i].centroid[0] - x[2 * i];
+    f[2 * i + 1] = moments[i].centroid[1] - x[2 * i + 1];
+    max_displacement = std::max(
+        max_displacement,
+        std::sqrt(f[2 * i] * f[2 * i] + f[2 * i + 1] * f[2 * i + 1]));
+  }
+  return max_displacement;
+}
+
+inline double cvt_dot(const std::vector<double> &a,
+                      const std::vector<double> &b) {
+  double sum = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+/* Solves the small dense system A g = b in place by Gaussian elimination
+ * with partial pivoting. A is row major, n x n */
+inline void cvt_dense_solve(std::vector<double> &A, std::vector<double> &b,
+                            int n) {
+  for (int k = 0; k < n; k++) {
+    int pivot = k;
+    for (int r = k + 1; r < n; r++) {
+      if (std::abs(A[r * n + k]) > std::abs(A[pivot * n + k])) {
+        pivot = r;
+      }
+    }
+    for (int c = 0; c < n; c++) {
+      std::swap(A[k * n + c], A[pivot * n + c]);
+    }
+    std::swap(b[k], b[pivot]);
+    if (A[k * n + k] == 0) {
+      continue;
+    }
+    for (int r = k + 1; r < n; r++) {
+      const double factor = A[r * n + k] / A[k * n + k];
+      for (int c = k; c < n; c++) {
+        A[r * n + c] -= factor * A[k * n + c];
+      }
+      b[r] -= factor * b[k];
+    }
+  }
+  for (int k = n - 1; k >= 0; k--) {
+    for (int c = k + 1; c < n; c++) {
+      b[k] -= A[k * n + c] * b[c];
+    }
+    b[k] = A[k * n + k] == 0 ? 0 : b[k] / A[k * n + k];
+  }
+}
+
+/* Anderson acceleration of Lloyd's map, mixing the last memory residuals.
+ * An accelerated step which raises the energy is replaced by a plain Lloyd
+ * step, which always lowers it, and the history is dropped. x is updated in
+ * place; stopping follows cvt_params as in lloyd_iterate */
+template <typename Evaluate>
+cvt_result anderson_cvt(std::vector<double> &x, Evaluate &evaluate,
+                        const cvt_params &params = cvt_params(),
+                        int memory = 5) {
+  cvt_result result = {0, 0, 0};
+  std::vector<cvt_cell_moments> moments;
+  std::vector<double> f, x_prev, f_prev, x_new;
+  std::deque<std::vector<double> > dX, dF;
+  double energy = evaluate(x, moments);
+  double previous_energy = std::numeric_limits<double>::infinity();
+
+  for (; result.iterations < params.max_iterations; result.iterations++) {
+    result.energy = energy;
+    result.max_displacement = cvt_residual(x, moments, f);
+    log_iteration({"anderson", result.iterations, energy, 0, 0,
+                   result.max_displacement});
+    if (result.max_displacement <= params.displacement_tolerance ||
+        previous_energy - energy < params.energy_tolerance * energy) {
+      break;
+    }
+
+    if (!x_prev.empty()) {
+      dX.push_back(x);
+      dF.push_back(f);
+      for (size_t k = 0; k < x.size(); k++) {
+        dX.back()[k] -= x_prev[k];
+        dF.back()[k] -= f_prev[k];
+      }
+      if (static_cast<int>(dX.size()) > memory) {
+        dX.pop_front();
+        dF.pop_front();
+      }
+    }
+
+    // gamma minimizes |f - dF gamma|, from the regularized normal equations
+    const int m = dF.size();
+    std::vector<double> A(m * m), gamma(m);
+    double trace = 0;
+    for (int a = 0; a < m; a++) {
+      for (int b = 0; b <= a; b++) {
+        A[a * m + b] = A[b * m + a] = cvt_dot(dF[a], dF[b]);
+      }
+      gamma[a] = cvt_dot(dF[a], f);
+      trace += A[a * m + a];
+    }
+    for (int a = 0; a < m; a++) {
+      A[a * m + a] += 1e-10 * trace;
+    }
+    cvt_dense_solve(A, gamma, m);
+
+    x_new = x;
+    for (size_t k = 0; k < x.size(); k++) {
+      x_new[k] += f[k];
+      for (int a = 0; a < m; a++) {
+        x_new[k] -= gamma[a] * (dX[a][k] + dF[a][k]);
+      }
+    }
+    double new_energy = evaluate(x_new, moments);
+    if (m > 0 && !(new_energy <= energy)) {
+      for (size_t k = 0; k < x.size(); k++) {
+        x_new[k] = x[k] + f[k];
+      }
+      new_energy = evaluate(x_new, moments);
+      dX.clear();
+      dF.clear();
+    }
+
+    x_prev.swap(x);
+    f_prev.swap(f);
+    x.swap(x_new);
+    previous_energy = energy;
+    energy = new_energy;
+  }
+  return result;
+}
+
+/* CVT energy gradient 2 m_i (x_i - c_i), and the inverse diagonal
+ * 1 / (2 m_i) which turns it back into the Lloyd step */
+inline void cvt_gradient(const std::vector<double> &x,
+                         const std::vector<cvt_cell_moments> &moments,
+                         std::vector<double> &g, std::vector<double> &h0) {
+  g.resize(x.size());
+  h0.resize(x.size());
+  for (size_t i = 0; i < moments.size(); i++) {
+    const double m = moments[i].area;
+    if (m <= 0) {
+      g[2 * i] = g[2 * i + 1] = h0[2 * i] = h0[2 * i + 1] = 0;
+      continue;
+    }
+    g[2 * i] = 2 * m * (x[2 * i] - moments[i].centroid[0]);
+    g[2 * i + 1] = 2 * m * (x[2 * i + 1] - moments[i].centroid[1]);
+    h0[2 * i] = h0[2 * i + 1] = 0.5 / m;
+  }
+}
+
+/* L-BFGS on the CVT energy with an Armijo backtracking line search. The
+ * initial inverse Hessian is the Lloyd diagonal, so with no history the
+ * step is exactly a Lloyd step. Sites are projected into the domain after
+ * every step. x is updated in place. A checkpoint holds x, the history
+ * and the previous energy, in the order of x; resuming from one replaces x */
+template <typename Evaluate>
+cvt_result lbfgs_cvt(std::vector<double> &x, Evaluate &evaluate,
+                     const cvt_params &params = cvt_params(),
+                     int memory = 5, int max_backtracks = 20) {
+  cvt_result result = {0, 0, 0};
+  std::vector<cvt_cell_moments> moments;
+  std::vector<double> f, g, h0, d, x_new, g_new, h0_new;
+  std::deque<std::vector<double> > S, Y;
+  std::deque<double> rho;
+  double previous_energy = std::numeric_limits<double>::infinity();
+  const checkpoint *resume = params.resume;
+  if (resume != nullptr && resume->solver == "lbfgs" &&
+      resume->points.coords.size() == x.size() && !resume->scalars.empty()) {
+    x = resume->points.coords;
+    S.assign(resume->history_s.begin(), resume->history_s.end());
+    Y.assign(resume->history_y.begin(), resume->history_y.end());
+    rho.assign(resume->history_rho.begin(), resume->history_rho.end());
+    result.iterations = resume->iteration;
+    previous_energy = resume->scalars[0];
+  }
+  double energy = evaluate(x, moments);
+  cvt_gradient(x, moments, g, h0);
+
+  for (; result.iterations < params.max_iterations; result.iterations++) {
+    result.energy = energy;
+    result.max_displacement = cvt_residual(x, moments, f);
+    log_iteration({"lbfgs", result.iterations, energy,
+                   std::sqrt(cvt_dot(g, g)), 0, result.max_displacement});
+    if (result.max_displacement <= params.displacement_tolerance ||
+        previous_energy - energy < params.energy_tolerance * energy) {
+      break;
+    }
+    if (params.checkpoints != nullptr && params.checkpoints->due()) {
+      checkpoint c;
+      c.solver = "lbfgs";
+      c.iteration = result.iterations;
+      c.points.coords = x;
+      c.history_s.assign(S.begin(), S.end());
+      c.history_y.assign(Y.begin(), Y.end());
+      c.history_rho.assign(rho.begin(), rho.end());
+      c.scalars.push_back(previous_energy);
+      params.checkpoints->submit(std::move(c));
+    }
+
+    // two loop recursion for d = -H g
+    d = g;
+    std::vector<double> alpha(S.size());
+    for (int k = static_cast<int>(S.size()) - 1; k >= 0; k--) {
+      alpha[k] = rho[k] * cvt_dot(S[k], d);
+      for (size_t j = 0; j < d.size(); j++) {
+        d[j] -= alpha[k] * Y[k][j];
+      }
+    }
+    for (size_t j = 0; j < d.size(); j++) {
+      d[j] *= h0[j];
+    }
+    for (size_t k = 0; k < S.size(); k++) {
+      const double beta = rho[k] * cvt_dot(Y[k], d);
+      for (size_t j = 0; j < d.size(); j++) {
+        d[j] += (alpha[k] - beta) * S[k][j];
+      }
+    }
+    for (size_t j = 0; j < d.size(); j++) {
+      d[j] = -d[j];
+    }
+    double slope = cvt_dot(g, d);
+    if (!(slope < 0)) {
+      // not a descent direction, fall back to the Lloyd step
+      S.clear();
+      Y.clear();
+      rho.clear();
+      for (size_t j = 0; j < d.size(); j++) {
+        d[j] = -h0[j] * g[j];
+      }
+      slope = cvt_dot(g, d);
+    }
+
+    double new_energy = energy;
+    bool accepted = false;
+    // every line search starts from the full step, so it isn't checkpointed
+    double step = 1.0;
+    for (int backtrack = 0; backtrack < max_backtracks; backtrack++) {
+      x_new = x;
+      for (size_t j = 0; j < x.size(); j++) {
+        x_new[j] += step * d[j];
+      }
+      new_energy = evaluate(x_new, moments);
+      if (new_energy <= energy + 1e-4 * step * slope) {
+        accepted = true;
+        break;
+      }
+      step *= 0.5;
+    }
+    if (!accepted) {
+      // restore the sites and stop, the line search can't make progress
+      evaluate(x, moments);
+      break;
+    }
+
+    cvt_gradient(x_new, moments, g_new, h0_new);
+    // the projection may shorten the step, so use the actual one
+    std::vector<double> s(x.size()), y(x.size());
+    for (size_t j = 0; j < x.size(); j++) {
+      s[j] = x_new[j] - x[j];
+      y[j] = g_new[j] - g[j];
+    }
+    const double sy = cvt_dot(s, y);
+    if (sy > 1e-12 * std::sqrt(cvt_dot(s, s) * cvt_dot(y, y))) {
+      S.push_back(s);
+      Y.push_back(y);
+      rho.push_back(1.0 / sy);
+      if (static_cast<int>(S.size()) > memory) {
+        S.pop_front();
+        Y.pop_front();
+        rho.pop_front();
+      }
+    }
+
+    x.swap(x_new);
+    g.swap(g_new);
+    h0.swap(h0_new);
+    previous_energy = energy;
+    energy = new_energy;
+  }
+  return result;
+}
+
+// Anderson accelerated Lloyd's iterations on the vertices of dt
+template <typename Density = uniform_density>
+cvt_result anderson_cvt(DT &dt, const cvt_domain &domain,
+                        const cvt_params &params = cvt_params(),
+                        int memory = 5, const Density &density = Density()) {
+  cvt_sites<Density> sites(dt, domain, density);
+  std::vector<double> x = sites.coordinates();
+  return anderson_cvt(x, sites, params, memory);
+}
+
+// L-BFGS minimization of the CVT energy of the vertices of dt. To resume,
+// rebuild dt with restore_triangulation; the checkpoint is matched to the
+// vertices by position, since the rebuilt dt has its own vertex order
+template <typename Density = uniform_density>
+cvt_result lbfgs_cvt(DT &dt, const cvt_domain &domain,
+                     const cvt_params &params = cvt_params(), int memory = 5,
+                     const Density &density = Density()) {
+  cvt_sites<Density> sites(dt, domain, density);
+  std::vector<double> x = sites.coordinates();
+  if (params.resume == nullptr) {
+    return lbfgs_cvt(x, sites, params, memory);
+  }
+  const std::vector<int> order = checkpoint_order(*params.resume, x);
+  if (order.empty()) {
+    HOT_WARN("the sites are not at the checkpoint's points, starting over");
+    cvt_params fresh = params;
+    fresh.resume = nullptr;
+    return lbfgs_cvt(x, sites, fresh, memory);
+  }
+  const checkpoint resume = reorder_checkpoint(*params.resume, order);
+  cvt_params resumed = params;
+  resumed.resume = &resume;
+  return lbfgs_cvt(x, sites, resumed, memory);
+}
+
+#endif // _ACCELERATED_CVT_HPP_
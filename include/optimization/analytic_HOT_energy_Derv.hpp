@@ -1,15 +1,22 @@
 #ifndef _ANALYTIC_HPP_
 #define _ANALYTIC_HPP_
 
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "energyWeights.hpp"
+#include "h_deriv_batch.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
+
 //////////////////////////////////////////////////////////////////////////////////
 /////////////////////  ENERGY DERIVATIVES /////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////
 
-template<typename T>
-void energy_gradient(T &triangulation,int Wk, int star, Vertex_handle v, double total_deriv[2], bool corrected_formulas){
-
-//template< > 
-//void energy_gradient<2,int star>(const DT &dt, Vertex_handle v, double total_deriv[2], bool //corrected_formulas){
+// Gradient of the *star-HOT_Wk energy with respect to the position of v, with Wk and star fixed at compile time
+template<int Wk, int star, typename T>
+void energy_gradient(T &triangulation, Vertex_handle v, double total_deriv[2], bool corrected_formulas){
 	
 	total_deriv[0]=0; 
 	total_deriv[1]=0; 
@@ -101,40 +108,21 @@ void energy_gradient(T &triangulation,int Wk, int star, Vertex_handle v, double
 		double hl=signed_dist_circumcenters(face_to_tri(mirror_edge_face), mirror_index); 
 		int sign=sgn(hk+hl); 
 
-		// I want to make constants that varry based on what Wk and star are. 
-			double constant1; 
-			double constant2;
-		if(star==0){
-			constant1=4.0;
-			constant2=12.0; 
-		}
-		else if(star==1){
-			constant1=3.0; 
-			constant2=3.0;
-		}
-		else{
-			constant1=12.0; 
-			constant2=4.0;
-
-		}
-		
 		bool boundary_edge= triangulation.is_infinite(edge.first) ||triangulation.is_infinite(mirror_edge.first); 
 			
 			if(!triangulation.is_infinite(edge.first)){
 				if(!boundary_edge || hk>0){
+					double dE_ddij, dE_dhk_ij, dE_ddji, dE_dhk_ji; 
+					subtri_energy_weights_deriv<Wk,star>(dij, hk, dE_ddij, dE_dhk_ij); 
+					subtri_energy_weights_deriv<Wk,star>(dji, hk, dE_ddji, dE_dhk_ji); 
 					double edge_deriv[2]={0,0}; 
 					for(int coor=0; coor <2 ; coor++){
-						edge_deriv[coor]+=(3*pow(dij,2)*hk*dij_derv[coor]+pow(dij,3)*hk_derv[coor])/constant1;
-						edge_deriv[coor]+=3*pow(dji,2)*dji_derv[coor]*hk+pow(dji,3)*hk_derv[coor]/constant1;
-						edge_deriv[coor]+= dij*3*pow(hk,2)*hk_derv[coor]+dij_derv[coor]*pow(hk,3)/constant2;
-						edge_deriv[coor]+=dji*3*pow(hk,2)*hk_derv[coor]+dji_derv[coor]*pow(hk,3)/constant2;
+						edge_deriv[coor]+=dE_ddij*dij_derv[coor]+dE_dhk_ij*hk_derv[coor];
+						edge_deriv[coor]+=dE_ddji*dji_derv[coor]+dE_dhk_ji*hk_derv[coor];
 							
-						if(star==1){
-							if(boundary_edge) total_deriv[coor]+=edge_deriv[coor];
-							else if(corrected_formulas) total_deriv[coor]+=sign*edge_deriv[coor]; 						
-							else total_deriv[coor]+=edge_deriv[coor]; 
-						}
-						// otherwise star=0 or 2. for now, we make no special treatment for boundary triangles for these stars.
+						// the sign multiplies the energy of an interior edge for every star, see Edge_Energy
+						if(boundary_edge) total_deriv[coor]+=edge_deriv[coor];
+						else if(corrected_formulas) total_deriv[coor]+=sign*edge_deriv[coor]; 
 						else total_deriv[coor]+=edge_deriv[coor]; 
 					}
 				} 
@@ -142,70 +130,157 @@ void energy_gradient(T &triangulation,int Wk, int star, Vertex_handle v, double
 
 			if(!triangulation.is_infinite(mirror_edge.first)){
 				if(!boundary_edge || hl >0){
+					double dE_ddij, dE_dhl_ij, dE_ddji, dE_dhl_ji; 
+					subtri_energy_weights_deriv<Wk,star>(dij, hl, dE_ddij, dE_dhl_ij); 
+					subtri_energy_weights_deriv<Wk,star>(dji, hl, dE_ddji, dE_dhl_ji); 
 					double edge_deriv[2]={0,0}; 
 					for(int coor=0; coor <2 ; coor++){
-						edge_deriv[coor]+=3*pow(dij,2)*hl*dij_derv[coor]+pow(dij,3)*hl_derv[coor]/constant1;
-						edge_deriv[coor]+=3*pow(dji,2)*dji_derv[coor]*hl+pow(dji,3)*hl_derv[coor]/constant1;
-						edge_deriv[coor]+= dij*3*pow(hl,2)*hl_derv[coor]+dij_derv[coor]*pow(hl,3)/constant2;
-						edge_deriv[coor]+= dji*3*pow(hl,2)*hl_derv[coor]+dji_derv[coor]*pow(hl,3)/constant2;
+						edge_deriv[coor]+=dE_ddij*dij_derv[coor]+dE_dhl_ij*hl_derv[coor];
+						edge_deriv[coor]+=dE_ddji*dji_derv[coor]+dE_dhl_ji*hl_derv[coor];
 					
-						if(star==1){
-							if(boundary_edge) total_deriv[coor]+=edge_deriv[coor];
-							else if (corrected_formulas) total_deriv[coor]+=sign*edge_deriv[coor]; 
-							else total_deriv[coor]+=edge_deriv[coor];
-						}
-						// otherwise star=0 or 2. for now, we make no special treatment for boundary triangles for these stars.
+						// the sign multiplies the energy of an interior edge for every star, see Edge_Energy
+						if(boundary_edge) total_deriv[coor]+=edge_deriv[coor];
+						else if(corrected_formulas) total_deriv[coor]+=sign*edge_deriv[coor]; 
 						else total_deriv[coor]+=edge_deriv[coor]; 
 					}
 				} 
 			}		
 			
 		} 
-	// rescale to be unit vector
-	double grad_length=sqrt(pow(total_deriv[0],2)+ pow(total_deriv[1],2)); 
-	std::cout<<"unit vector in direction gradient:" << std::setw(15) << total_deriv[0]/grad_length << std::setw(15) <<total_deriv[1]/grad_length <<std::endl; 
+	// direction of the gradient, for tracing
+	HOT_TRACE("unit vector in direction gradient: " << total_deriv[0]/std::hypot(total_deriv[0],total_deriv[1]) << " " << total_deriv[1]/std::hypot(total_deriv[0],total_deriv[1])); 
 	return; 
 }
 
-
-void compute_h_deriv(const Point &xi, const Point &xj, const Point &xk, int i, double h_derv[2]){
-
-	double xi1=xi.x();  
-	double xi2=xi.y(); 
-	double xj1=xj.x(); 
-	double xj2=xj.y(); 
-	double xk1=xk.x(); 
-	double xk2=xk.y(); 
-
-	if(i==1){ // diff wrt xi coordinates
-		
-		h_derv[0]= (2*(pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*(xj1 - xk1)*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2) - 
-     ((xi1 - xk1)*(xj1 - xk1) + (xi2 - xk2)*(xj2 - xk2))*(2*(pow(xi1 - xj1,2) + pow(xi2 - xj2,2))*(xj2 - xk2)*(-(xj2*xk1) + xi2*(-xj1 + xk1) + xi1*(xj2 - xk2) + xj1*xk2) + 
-        2*(xi1 - xj1)*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2)))/ (4.*pow((pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2),1.5));
-
-
-		h_derv[1]= ((xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2))*((pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*(xj2 - xk2)*(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2)) -  ((xi1 - xk1)*(xj1 - xk1) + (xi2 - xk2)*(xj2 - xk2))*((pow(xi1 - xj1,2) + pow(xi2 - xj2,2))*(xj1 - xk1) + (xi2 - xj2)*(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2)))))/ (2.*pow((pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2),1.5)); 
+// Runtime dispatch of energy_gradient<Wk,star> for callers passing ints. Only Wk=2 is implemented
+template<typename T>
+void energy_gradient(T &triangulation,int Wk, int star, Vertex_handle v, double total_deriv[2], bool corrected_formulas){
+	typedef void (*energy_gradient_function)(T &, Vertex_handle, double [2], bool); 
+	static const energy_gradient_function energy_gradient_table[3]={
+		&energy_gradient<2,0,T>, &energy_gradient<2,1,T>, &energy_gradient<2,2,T>}; 
+
+	if(Wk!=2){
+		HOT_WARN("energy_gradient returning bogus answer because Wk was not 2");
+		total_deriv[0]=0; 
+		total_deriv[1]=0; 
+		return; 
 	}
+	energy_gradient_table[weighted_star_index(star)](triangulation, v, total_deriv, corrected_formulas); 
+}
 
-
-	if(i==2){ // diff wrt xj coordinates
-		h_derv[0]= ((xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2))*((pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*(xi1 - xk1)*(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2)) -  ((xi1 - xk1)*(xj1 - xk1) + (xi2 - xk2)*(xj2 - xk2))*((pow(xi1 - xj1,2) + pow(xi2 - xj2,2))*(xi2 - xk2) + (xi1 - xj1)*(-(xj2*xk1) + xi2*(-xj1 + xk1) + xi1*(xj2 - xk2) + xj1*xk2))))/(2.*pow((pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2),1.5));
-
-
-		h_derv[1]= (2*(pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*(xi2 - xk2)*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2) - 
-     ((xi1 - xk1)*(xj1 - xk1) + (xi2 - xk2)*(xj2 - xk2))*(2*(pow(xi1 - xj1,2) + pow(xi2 - xj2,2))*(xi1 - xk1)*(-(xj2*xk1) + xi2*(-xj1 + xk1) + xi1*(xj2 - xk2) + xj1*xk2) - 
-        2*(xi2 - xj2)*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2)))/(4.*pow((pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2),1.5));
+// energy_density_EMethod<Wk,star> and its gradient in one sweep over the faces of an indexed triangulation (Indexed_DT,
+// Indexed_mesh_T). Each face does the edges it shares with no face of lower index: it computes their heights, sign and
+// dij once and scatters their derivatives to the (up to) four vertices. gradient gets the x and y derivatives of the
+// vertex with index i at 2i and 2i+1. The faces are split over threads, each adding into a gradient buffer of its own,
+// and the buffers and the partial energies are summed in chunk order, so the result doesn't depend on scheduling
+template<int Wk, int star, typename T>
+double energy_and_gradient_EMethod(const T &triangulation, std::vector<double> &gradient, bool corrected_formulas){
+	typedef typename T::Face_handle Face_handle_T;
+	const int num_vertices=triangulation.number_of_indexed_vertices();
+	const int num_faces=triangulation.number_of_indexed_faces();
+	const std::size_t num_coords=2*num_vertices;
+
+	// The coordinates by vertex index, and for each face its vertex indices and, across edge e, the index of the
+	// neighbor (-1 outside the hull) and the index of its vertex opposite the edge. The threads read these rather
+	// than the faces, since copying CGAL's reference counted points from several threads at once is a data race
+	std::vector<double> coords(num_coords);
+	for(int v=0; v<num_vertices; v++){
+		const auto &p=triangulation.indexed_vertex(v)->point();
+		coords[2*v]=CGAL::to_double(p.x());
+		coords[2*v+1]=CGAL::to_double(p.y());
+	}
+	const std::vector<std::array<int,3> > triangles=triangulation.indexed_triangles();
+	std::vector<std::array<int,3> > neighbors(num_faces), across(num_faces);
+	for(int f=0; f<num_faces; f++){
+		const Face_handle_T face=triangulation.indexed_face(f);
+		for(int e=0; e<3; e++){
+			const Face_handle_T neighbor=face->neighbor(e);
+			neighbors[f][e]=triangulation.face_index(neighbor);
+			across[f][e]=neighbors[f][e]<0 ? -1 : neighbor->vertex(triangulation.mirror_index(face, e))->index();
+		}
 	}
 
-	if(i==3){ //diff wrt xk coordinates
-		h_derv[0]= (xj2*pow(xk1,2) + pow(xi1,2)*(xj2 - xk2) + pow(xi2,2)*(xj2 - xk2) + pow(xj1,2)*xk2 + pow(xj2,2)*xk2 - 2*xj1*xk1*xk2 - xj2*pow(xk2,2) + 2*xi1*xk1*(-xj2 + xk2) - 
-     xi2*(pow(xj1,2) + pow(xj2,2) - 2*xj1*xk1 + pow(xk1,2) - pow(xk2,2)))/(2.*(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2))*sqrt((pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2)));
-
-
-		h_derv[1]= (-(pow(xj1,2)*xk1) - pow(xj2,2)*xk1 + xj1*pow(xk1,2) + pow(xi1,2)*(-xj1 + xk1) + pow(xi2,2)*(-xj1 + xk1) + 2*xi2*(xj1 - xk1)*xk2 + 2*xj2*xk1*xk2 - xj1*pow(xk2,2) + 
-     xi1*(pow(xj1,2) + pow(xj2,2) - pow(xk1,2) - 2*xj2*xk2 + pow(xk2,2)))/(2.*(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2))*sqrt((pow(xi1,2) + pow(xi2,2) - 2*xi1*xj1 + pow(xj1,2) - 2*xi2*xj2 + pow(xj2,2))*pow(xi2*(xj1 - xk1) + xj2*xk1 - xj1*xk2 + xi1*(-xj2 + xk2),2)));
+	const int chunks=parallel_num_chunks(num_faces);
+	std::vector<std::vector<double> > buffers(chunks);
+	std::vector<double> partial(chunks, 0.0);
+
+	parallel_for(num_faces, [&](int chunk, std::size_t begin, std::size_t end){
+		std::vector<double> &buffer=buffers[chunk];
+		buffer.assign(num_coords, 0.0);
+		double energy=0;
+		for(std::size_t f=begin; f<end; f++){
+			for(int e=0; e<3; e++){
+				const bool boundary_edge=neighbors[f][e]<0;
+				if(!boundary_edge && neighbors[f][e]<static_cast<int>(f)){
+					continue;
+				}
+				// i and j in the orientation energy_gradient takes from the face of the edge, vertex cw(e) and ccw(e)
+				const int i=triangles[f][(e+2)%3], j=triangles[f][(e+1)%3];
+				const int opposite[2]={triangles[f][e], across[f][e]};
+				const double xi=coords[2*i], yi=coords[2*i+1];
+				const double xj=coords[2*j], yj=coords[2*j+1];
+				const double dij=0.5*std::sqrt((xi-xj)*(xi-xj)+(yi-yj)*(yi-yj));
+
+				const int num_sides=boundary_edge ? 1 : 2;
+				double h[2]={0, 0};
+				for(int s=0; s<num_sides; s++){
+					const int k=opposite[s];
+					h[s]=h_kernel(xi, yi, xj, yj, coords[2*k], coords[2*k+1]);
+				}
+				double sign=1;
+				if(!boundary_edge && corrected_formulas){
+					sign=sgn(h[0]+h[1]);
+				}
+
+				for(int s=0; s<num_sides; s++){
+					// a boundary edge only counts while its circumcenter is inside
+					if(boundary_edge && h[s]<=0){
+						continue;
+					}
+					const int k=opposite[s];
+					// subtri_energy is both halves, and dij=dji, so both halves have the same derivatives
+					energy+=2*sign*subtri_energy_weights<Wk,star>(dij, h[s]);
+					double dE_dd, dE_dh;
+					subtri_energy_weights_deriv<Wk,star>(dij, h[s], dE_dd, dE_dh);
+					dE_dd*=2*sign;
+					dE_dh*=2*sign;
+					double h_derv[3][2];
+					h_derivs_kernel(xi, yi, xj, yj, coords[2*k], coords[2*k+1], h_derv[0][0], h_derv[0][1],
+						h_derv[1][0], h_derv[1][1], h_derv[2][0], h_derv[2][1]);
+					buffer[2*i]+=dE_dd*(-(xj-xi)/(4.0*dij))+dE_dh*h_derv[0][0];
+					buffer[2*i+1]+=dE_dd*(-(yj-yi)/(4.0*dij))+dE_dh*h_derv[0][1];
+					buffer[2*j]+=dE_dd*((xj-xi)/(4.0*dij))+dE_dh*h_derv[1][0];
+					buffer[2*j+1]+=dE_dd*((yj-yi)/(4.0*dij))+dE_dh*h_derv[1][1];
+					buffer[2*k]+=dE_dh*h_derv[2][0];
+					buffer[2*k+1]+=dE_dh*h_derv[2][1];
+				}
+			}
+		}
+		partial[chunk]=energy;
+	});
+
+	gradient.assign(num_coords, 0.0);
+	parallel_for(num_coords, [&](int, std::size_t begin, std::size_t end){
+		for(int chunk=0; chunk<chunks; chunk++){
+			for(std::size_t c=begin; c<end; c++){
+				gradient[c]+=buffers[chunk][c];
+			}
+		}
+	});
+	double energy=0;
+	for(double p : partial){
+		energy+=p;
 	}
+	return energy;
+}
 
+
+// Derivative of the height of edge (xi, xj) opposite xk with respect to xi, xj or xk, for i=1, 2 or 3
+void compute_h_deriv(const Point &xi, const Point &xj, const Point &xk, int i, double h_derv[2]){
+	double all_derv[3][2];
+	compute_h_derivs(xi, xj, xk, all_derv);
+	h_derv[0]=all_derv[i-1][0];
+	h_derv[1]=all_derv[i-1][1];
 }
 
 
@@ -0,0 +1,152 @@
+#ifndef _ANALYTIC_SB_DERV_HPP_
+#define _ANALYTIC_SB_DERV_HPP_
+
+#include <cmath>
+
+#include "Sb.hpp"
+#include "analytic_energyWeights_Derv.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  Sb ENERGY DERIVATIVES //////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// Same raw face layout as analytic_energyWeights_Derv.hpp. Both energies are
+// built from the area A, the perimeter P, and the offset b = c - g of the
+// weighted circumcenter c from the centroid g, so the kernels differentiate
+// those and chain them together.
+
+/* Area, perimeter and circumcenter offset of a face, with their
+ * derivatives. dA_dx and dP_dx are [vertex][coordinate], db_dx is
+ * [vertex][coordinate][b coordinate] and db_dw is [vertex][b coordinate].
+ * Returns false for degenerate faces */
+inline bool Sb_face_terms(const double x[3][2], const double w[3], double &A,
+                          double dA_dx[3][2], double &P, double dP_dx[3][2],
+                          double b[2], double db_dx[3][2][2],
+                          double db_dw[3][2]) {
+  double c[2];
+  if (!weighted_circumcenter_derivs(x, w, c, db_dx, db_dw)) {
+    return false;
+  }
+  // g moves with each vertex by a third
+  for (int v = 0; v < 3; v++) {
+    db_dx[v][0][0] -= 1.0 / 3.0;
+    db_dx[v][1][1] -= 1.0 / 3.0;
+  }
+  b[0] = c[0] - (x[0][0] + x[1][0] + x[2][0]) / 3.0;
+  b[1] = c[1] - (x[0][1] + x[1][1] + x[2][1]) / 3.0;
+
+  const double orient = (x[1][0] - x[0][0]) * (x[2][1] - x[0][1]) -
+                        (x[1][1] - x[0][1]) * (x[2][0] - x[0][0]);
+  const double s = orient > 0 ? 0.5 : -0.5;
+  A = s * orient;
+
+  P = 0.0;
+  for (int v = 0; v < 3; v++) {
+    const int j = (v + 1) % 3, k = (v + 2) % 3;
+    dA_dx[v][0] = s * (x[j][1] - x[k][1]);
+    dA_dx[v][1] = s * (x[k][0] - x[j][0]);
+    dP_dx[v][0] = dP_dx[v][1] = 0.0;
+  }
+  for (int i = 0; i < 3; i++) {
+    const int j = (i + 1) % 3;
+    const double t[2] = {x[j][0] - x[i][0], x[j][1] - x[i][1]};
+    const double e = std::sqrt(t[0] * t[0] + t[1] * t[1]);
+    P += e;
+    for (int a = 0; a < 2; a++) {
+      dP_dx[i][a] -= t[a] / e;
+      dP_dx[j][a] += t[a] / e;
+    }
+  }
+  return true;
+}
+
+/* triangle_Sb, A^powarea |b|^powdist, with its gradient with respect to the
+ * vertex positions grad_x[vertex][coordinate] and weights grad_w[vertex].
+ * The gradients are overwritten, not accumulated */
+inline double triangle_Sb_grad(const double x[3][2], const double w[3],
+                               double powdist, double powarea,
+                               double grad_x[3][2], double grad_w[3]) {
+  for (int v = 0; v < 3; v++) {
+    grad_x[v][0] = grad_x[v][1] = 0.0;
+    grad_w[v] = 0.0;
+  }
+  double A, dA_dx[3][2], P, dP_dx[3][2], b[2], db_dx[3][2][2], db_dw[3][2];
+  if (!Sb_face_terms(x, w, A, dA_dx, P, dP_dx, b, db_dx, db_dw)) {
+    return 0.0;
+  }
+  const double b2 = b[0] * b[0] + b[1] * b[1];
+  const double area_term = std::pow(A, powarea);
+  const double dist_term = std::pow(b2, 0.5 * powdist);
+  const double energy = area_term * dist_term;
+  if (b2 == 0.0) {
+    // |b|^powdist is not differentiable here unless powdist >= 2, in
+    // which case the gradient is zero
+    return energy;
+  }
+
+  // dE = powarea E / A dA + powdist E / |b|^2 b . db
+  const double dE_dA = powarea * energy / A;
+  const double dE_db = powdist * energy / b2;
+  for (int v = 0; v < 3; v++) {
+    grad_w[v] = dE_db * (b[0] * db_dw[v][0] + b[1] * db_dw[v][1]);
+    for (int a = 0; a < 2; a++) {
+      grad_x[v][a] = dE_dA * dA_dx[v][a] +
+                     dE_db * (b[0] * db_dx[v][a][0] + b[1] * db_dx[v][a][1]);
+    }
+  }
+  return energy;
+}
+
+/* triangle_Sb_divide_perim4, A |b|^2 / P^4, with its gradient, laid out as
+ * in triangle_Sb_grad */
+inline double triangle_Sb_divide_perim4_grad(const double x[3][2],
+                                             const double w[3],
+                                             double grad_x[3][2],
+                                             double grad_w[3]) {
+  for (int v = 0; v < 3; v++) {
+    grad_x[v][0] = grad_x[v][1] = 0.0;
+    grad_w[v] = 0.0;
+  }
+  double A, dA_dx[3][2], P, dP_dx[3][2], b[2], db_dx[3][2][2], db_dw[3][2];
+  if (!Sb_face_terms(x, w, A, dA_dx, P, dP_dx, b, db_dx, db_dw)) {
+    return 0.0;
+  }
+  const double b2 = b[0] * b[0] + b[1] * b[1];
+  const double inv_P4 = 1.0 / (P * P * P * P);
+  const double energy = A * b2 * inv_P4;
+
+  const double dE_dA = b2 * inv_P4;
+  const double dE_db = 2.0 * A * inv_P4;
+  const double dE_dP = -4.0 * energy / P;
+  for (int v = 0; v < 3; v++) {
+    grad_w[v] = dE_db * (b[0] * db_dw[v][0] + b[1] * db_dw[v][1]);
+    for (int a = 0; a < 2; a++) {
+      grad_x[v][a] = dE_dA * dA_dx[v][a] + dE_dP * dP_dx[v][a] +
+                     dE_db * (b[0] * db_dx[v][a][0] + b[1] * db_dx[v][a][1]);
+    }
+  }
+  return energy;
+}
+
+/* Face kernels for weighted_optimize in weighted_hot_optimize.hpp, giving
+ * the energies Sb and Sb_divide_perim */
+struct Sb_kernel {
+  double powdist, powarea;
+
+  Sb_kernel(double powdist = 2, double powarea = 1)
+      : powdist(powdist), powarea(powarea) {}
+
+  double operator()(const double x[3][2], const double w[3],
+                    double grad_x[3][2], double grad_w[3]) const {
+    return triangle_Sb_grad(x, w, powdist, powarea, grad_x, grad_w);
+  }
+};
+
+struct Sb_divide_perim_kernel {
+  double operator()(const double x[3][2], const double w[3],
+                    double grad_x[3][2], double grad_w[3]) const {
+    return triangle_Sb_divide_perim4_grad(x, w, grad_x, grad_w);
+  }
+};
+
+#endif // _ANALYTIC_SB_DERV_HPP_
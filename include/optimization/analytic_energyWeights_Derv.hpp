@@ -0,0 +1,209 @@
+#ifndef _ANALYTIC_ENERGYWEIGHTS_DERV_HPP_
+#define _ANALYTIC_ENERGYWEIGHTS_DERV_HPP_
+
+#include <cmath>
+
+#include "energyWeights.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  ENERGY DERIVATIVES FOR WEIGHTED TRIANGULATIONS //////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// The kernels in this file work on raw coordinates, x[vertex][coordinate],
+// and weights, w[vertex], of a single face, so they can be used by any of
+// the triangulation types without going through CGAL constructions.
+
+/* Computes the weighted circumcenter c of the face and, if the derivative
+ * arrays are non-null, its derivatives with respect to the vertex positions
+ * dc_dx[vertex][coordinate][c coordinate] and weights dc_dw[vertex][c
+ * coordinate].
+ *
+ * c is the solution of
+ *   (x1 - x0) . c = (|x1|^2 - |x0|^2 - w1 + w0) / 2
+ *   (x2 - x0) . c = (|x2|^2 - |x0|^2 - w2 + w0) / 2
+ * so every derivative is a solve with the same 2x2 matrix.
+ * Returns false for degenerate faces */
+inline bool weighted_circumcenter_derivs(const double x[3][2],
+                                         const double w[3], double c[2],
+                                         double dc_dx[3][2][2] = nullptr,
+                                         double dc_dw[3][2] = nullptr) {
+  const double r1[2] = {x[1][0] - x[0][0], x[1][1] - x[0][1]};
+  const double r2[2] = {x[2][0] - x[0][0], x[2][1] - x[0][1]};
+  const double det = r1[0] * r2[1] - r1[1] * r2[0];
+  if (det == 0.0) {
+    return false;
+  }
+  const double inv_det = 1.0 / det;
+  // Solve for c - x0, which is better conditioned than solving for c
+  const double b1 = 0.5 * (r1[0] * r1[0] + r1[1] * r1[1] - w[1] + w[0]);
+  const double b2 = 0.5 * (r2[0] * r2[0] + r2[1] * r2[1] - w[2] + w[0]);
+  const double u[2] = {(b1 * r2[1] - b2 * r1[1]) * inv_det,
+                       (b2 * r1[0] - b1 * r2[0]) * inv_det};
+  c[0] = x[0][0] + u[0];
+  c[1] = x[0][1] + u[1];
+
+  // A^{-1} applied to a right hand side (s1, s2)
+  auto solve = [&](double s1, double s2, double out[2]) {
+    out[0] = (s1 * r2[1] - s2 * r1[1]) * inv_det;
+    out[1] = (s2 * r1[0] - s1 * r2[0]) * inv_det;
+  };
+
+  if (dc_dw != nullptr) {
+    solve(0.5, 0.5, dc_dw[0]);
+    solve(-0.5, 0.0, dc_dw[1]);
+    solve(0.0, -0.5, dc_dw[2]);
+  }
+  if (dc_dx != nullptr) {
+    for (int a = 0; a < 2; a++) {
+      // Differentiating the rows gives (d row) . c + row . dc = d rhs
+      solve(u[a], u[a], dc_dx[0][a]);
+      solve(x[1][a] - c[a], 0.0, dc_dx[1][a]);
+      solve(0.0, x[2][a] - c[a], dc_dx[2][a]);
+    }
+  }
+  return true;
+}
+
+/* Same energy as triangle_energy_weights, along with its gradient with
+ * respect to the vertex positions grad_x[vertex][coordinate] and the vertex
+ * weights grad_w[vertex]. The gradients are overwritten, not accumulated.
+ *
+ * For the edge ij opposite k the energy is
+ *   subtri_energy_weights(dij, hk) + subtri_energy_weights(dji, hk)
+ * with dij = (|eij|^2 - wi + wj) / (2 |eij|), and hk the signed distance of
+ * the weighted circumcenter to eij, positive on the side of xk */
+template <int Wk, int star>
+double triangle_energy_weights_grad(const double x[3][2], const double w[3],
+                                    double grad_x[3][2], double grad_w[3]) {
+  for (int v = 0; v < 3; v++) {
+    grad_x[v][0] = grad_x[v][1] = 0.0;
+    grad_w[v] = 0.0;
+  }
+
+  double c[2], dc_dx[3][2][2], dc_dw[3][2];
+  if (!weighted_circumcenter_derivs(x, w, c, dc_dx, dc_dw)) {
+    return 0.0;
+  }
+  const double orient = (x[1][0] - x[0][0]) * (x[2][1] - x[0][1]) -
+                        (x[1][1] - x[0][1]) * (x[2][0] - x[0][0]);
+  const double s = orient > 0 ? 1.0 : -1.0;
+
+  double energy = 0.0;
+  for (int i = 0; i < 3; i++) {
+    const int j = (i + 1) % 3;
+
+    const double t[2] = {x[j][0] - x[i][0], x[j][1] - x[i][1]};
+    const double q[2] = {c[0] - x[i][0], c[1] - x[i][1]};
+    const double e2 = t[0] * t[0] + t[1] * t[1];
+    const double e = std::sqrt(e2);
+    const double cr = t[0] * q[1] - t[1] * q[0];
+    const double hk = s * cr / e;
+
+    const double dij = 0.5 * e + (w[j] - w[i]) / (2 * e);
+    const double dji = 0.5 * e + (w[i] - w[j]) / (2 * e);
+
+    energy += subtri_energy_weights<Wk, star>(dij, hk);
+    energy += subtri_energy_weights<Wk, star>(dji, hk);
+
+    // partials of the edge energy with respect to dij, dji and hk
+    double df_ddij, df_dhk_ij, df_ddji, df_dhk_ji;
+    subtri_energy_weights_deriv<Wk, star>(dij, hk, df_ddij, df_dhk_ij);
+    subtri_energy_weights_deriv<Wk, star>(dji, hk, df_ddji, df_dhk_ji);
+    const double df_dhk = df_dhk_ij + df_dhk_ji;
+
+    // dependence of dij and dji on e
+    const double ddij_de = 0.5 - (w[j] - w[i]) / (2 * e2);
+    const double ddji_de = 0.5 - (w[i] - w[j]) / (2 * e2);
+    const double df_de = df_ddij * ddij_de + df_ddji * ddji_de;
+
+    // weights enter dij and dji directly, and hk through c
+    grad_w[i] += (-df_ddij + df_ddji) / (2 * e);
+    grad_w[j] += (df_ddij - df_ddji) / (2 * e);
+
+    // hk = s cr / e, with cr = t x q
+    const double dhk_dcr = s / e;
+    const double dhk_de = -hk / e;
+    const double dcr_dc[2] = {-t[1], t[0]};
+    for (int v = 0; v < 3; v++) {
+      grad_w[v] += df_dhk * dhk_dcr *
+                   (dcr_dc[0] * dc_dw[v][0] + dcr_dc[1] * dc_dw[v][1]);
+      for (int a = 0; a < 2; a++) {
+        grad_x[v][a] +=
+            df_dhk * dhk_dcr *
+            (dcr_dc[0] * dc_dx[v][a][0] + dcr_dc[1] * dc_dx[v][a][1]);
+      }
+    }
+
+    // explicit dependence on xi and xj through t, q and e
+    const double dcr_dxi[2] = {t[1] - q[1], q[0] - t[0]};
+    const double dcr_dxj[2] = {q[1], -q[0]};
+    for (int a = 0; a < 2; a++) {
+      const double de_dxj = t[a] / e;
+      grad_x[i][a] += df_dhk * (dhk_dcr * dcr_dxi[a] - dhk_de * de_dxj) -
+                      df_de * de_dxj;
+      grad_x[j][a] += df_dhk * (dhk_dcr * dcr_dxj[a] + dhk_de * de_dxj) +
+                      df_de * de_dxj;
+    }
+  }
+  return energy;
+}
+
+typedef double (*triangle_energy_weights_grad_function)(const double x[3][2],
+                                                       const double w[3],
+                                                       double grad_x[3][2],
+                                                       double grad_w[3]);
+
+const triangle_energy_weights_grad_function
+    triangle_energy_weights_grad_table[3] = {
+        &triangle_energy_weights_grad<2, 0>,
+        &triangle_energy_weights_grad<2, 1>,
+        &triangle_energy_weights_grad<2, 2>};
+
+// Runtime star dispatch of triangle_energy_weights_grad, for Wk=2
+inline double triangle_energy_weights_grad(const double x[3][2],
+                                           const double w[3], int star,
+                                           double grad_x[3][2],
+                                           double grad_w[3]) {
+  return triangle_energy_weights_grad_table[weighted_star_index(star)](
+      x, w, grad_x, grad_w);
+}
+
+/* Face kernel for the *star-HOT_2 energy with star fixed at compile time,
+ * so it inlines into the face loop of OptimizedMesh. With zero weights it
+ * is the unweighted tri_energy<2,star> */
+template <int star> struct hot_face_kernel {
+  double operator()(const double x[3][2], const double w[3],
+                    double grad_x[3][2], double grad_w[3]) const {
+    return triangle_energy_weights_grad<2, star>(x, w, grad_x, grad_w);
+  }
+};
+
+// Copies a weighted face into the raw arrays used by the kernels above
+template <typename Face_handle>
+void weighted_face_coordinates(const Face_handle &face, double x[3][2],
+                               double w[3]) {
+  for (int v = 0; v < 3; v++) {
+    const auto &wp = face->vertex(v)->point();
+    x[v][0] = CGAL::to_double(wp.x());
+    x[v][1] = CGAL::to_double(wp.y());
+    w[v] = CGAL::to_double(wp.weight());
+  }
+}
+
+/* Derivatives of triangle_energy_weights with respect to the weights and
+ * positions of the face's vertices, indexed like face->vertex(i) */
+inline double triangle_energy_weights_deriv(const weighted_Face_handle &face,
+                                            int Wk, int star,
+                                            double grad_x[3][2],
+                                            double grad_w[3]) {
+  if (Wk != 2) {
+    HOT_WARN("triangle_energy_weights_deriv returning bogus answer because Wk "
+             "was not 2");
+    return -1;
+  }
+  double x[3][2], w[3];
+  weighted_face_coordinates(face, x, w);
+  return triangle_energy_weights_grad(x, w, star, grad_x, grad_w);
+}
+
+#endif // _ANALYTIC_ENERGYWEIGHTS_DERV_HPP_
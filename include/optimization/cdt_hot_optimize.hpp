@@ -0,0 +1,388 @@
+#ifndef _CDT_HOT_OPTIMIZE_HPP_
+#define _CDT_HOT_OPTIMIZE_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <queue>
+#include <vector>
+
+#include <CGAL/Constrained_Delaunay_triangulation_2.h>
+
+#include "OptimizedMesh.hpp"
+#include "hot_hessian.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  HOT OPTIMIZATION OF A CONSTRAINED DELAUNAY TRIANGULATION ////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// The domain is the region enclosed by the constraints, which need not be
+// convex. Its faces are marked with set_in_domain, so the face base must be
+// a mesher face base such as CGAL::Delaunay_mesh_face_base_2 (as in
+// lloydsCVT.cpp). Vertices off the constraints move freely, vertices in the
+// middle of a straight run of constraints slide along it, and every other
+// constrained vertex (corners, junctions) is fixed.
+
+/* Marks the faces of cdt which are inside the domain: those separated from
+ * the infinite face by an odd number of constraints */
+template <typename CDT> void mark_domain(CDT &cdt) {
+  std::map<typename CDT::Face_handle, int> level;
+  std::queue<typename CDT::Face_handle> next_level;
+  next_level.push(cdt.infinite_face());
+  level[cdt.infinite_face()] = 0;
+  // Flood fill each level through unconstrained edges, collecting the
+  // faces across constrained edges as the seeds of the next level
+  while (!next_level.empty()) {
+    std::queue<typename CDT::Face_handle> fill;
+    fill.push(next_level.front());
+    next_level.pop();
+    while (!fill.empty()) {
+      typename CDT::Face_handle face = fill.front();
+      fill.pop();
+      const int face_level = level[face];
+      for (int i = 0; i < 3; i++) {
+        typename CDT::Face_handle neighbor = face->neighbor(i);
+        if (level.count(neighbor) != 0) {
+          continue;
+        }
+        if (cdt.is_constrained(typename CDT::Edge(face, i))) {
+          level[neighbor] = face_level + 1;
+          next_level.push(neighbor);
+        } else {
+          level[neighbor] = face_level;
+          fill.push(neighbor);
+        }
+      }
+    }
+  }
+  for (auto face_itr = cdt.all_faces_begin(); face_itr != cdt.all_faces_end();
+       face_itr++) {
+    face_itr->set_in_domain(level[face_itr] % 2 == 1);
+  }
+}
+
+/* Whether edge i of an in-domain face is on the domain boundary */
+template <typename CDT>
+bool is_domain_boundary(const CDT &cdt, const typename CDT::Face_handle &face,
+                        int i) {
+  return cdt.is_constrained(typename CDT::Edge(face, i)) ||
+         !face->neighbor(i)->is_in_domain();
+}
+
+enum class cdt_vertex_kind { free, sliding, fixed };
+
+/* The number of constraints incident to v, with the other endpoints of the
+ * first two in ends. Unlike classify_cdt_vertex it doesn't read the domain
+ * marks, so it can be trusted in the middle of a step */
+template <typename CDT>
+int incident_constraint_ends(const CDT &cdt,
+                             const typename CDT::Vertex_handle &v,
+                             typename CDT::Vertex_handle ends[2]) {
+  int num_constraints = 0;
+  typename CDT::Edge_circulator ec = cdt.incident_edges(v), done(ec);
+  if (ec == nullptr) {
+    return 0;
+  }
+  do {
+    if (cdt.is_constrained(*ec)) {
+      if (num_constraints < 2) {
+        const typename CDT::Face_handle face = ec->first;
+        const int opposite = ec->second;
+        const typename CDT::Vertex_handle a =
+            face->vertex(face->cw(opposite));
+        const typename CDT::Vertex_handle b =
+            face->vertex(face->ccw(opposite));
+        ends[num_constraints] = a == v ? b : a;
+      }
+      num_constraints++;
+    }
+  } while (++ec != done);
+  return num_constraints;
+}
+
+/* Classifies a finite vertex. A sliding vertex has exactly two incident
+ * constraints, which are collinear; ends are then their other endpoints */
+template <typename CDT>
+cdt_vertex_kind classify_cdt_vertex(const CDT &cdt,
+                                    const typename CDT::Vertex_handle &v,
+                                    typename CDT::Vertex_handle ends[2]) {
+  bool in_domain = false, on_hull = false;
+  typename CDT::Edge_circulator ec = cdt.incident_edges(v), done(ec);
+  if (ec == nullptr) {
+    return cdt_vertex_kind::fixed;
+  }
+  do {
+    const typename CDT::Face_handle face = ec->first;
+    const typename CDT::Face_handle mirror = face->neighbor(ec->second);
+    in_domain = in_domain || face->is_in_domain() || mirror->is_in_domain();
+    on_hull = on_hull || cdt.is_infinite(face) || cdt.is_infinite(mirror);
+  } while (++ec != done);
+  const int num_constraints = incident_constraint_ends(cdt, v, ends);
+
+  if (!in_domain) {
+    return cdt_vertex_kind::fixed;
+  }
+  if (num_constraints == 0) {
+    return on_hull ? cdt_vertex_kind::fixed : cdt_vertex_kind::free;
+  }
+  if (num_constraints != 2) {
+    return cdt_vertex_kind::fixed;
+  }
+  const double px = CGAL::to_double(v->point().x()),
+               py = CGAL::to_double(v->point().y());
+  const double ax = CGAL::to_double(ends[0]->point().x()) - px,
+               ay = CGAL::to_double(ends[0]->point().y()) - py;
+  const double bx = CGAL::to_double(ends[1]->point().x()) - px,
+               by = CGAL::to_double(ends[1]->point().y()) - py;
+  // collinear and on opposite sides of v
+  const double cross = ax * by - ay * bx, dot = ax * bx + ay * by;
+  const double scale = (ax * ax + ay * ay) + (bx * bx + by * by);
+  return std::abs(cross) <= 1e-12 * scale && dot < 0
+             ? cdt_vertex_kind::sliding
+             : cdt_vertex_kind::fixed;
+}
+
+/* Moves a vertex on the constraint from a to b to p. If on_constraint, p
+ * must lie on the segment ab and the constraints a-v and v-b are kept;
+ * otherwise v leaves the constraint, which becomes a-b again. A move onto
+ * another vertex is refused, leaving v where it was with its constraints */
+template <typename CDT>
+typename CDT::Vertex_handle
+slide_cdt_vertex(CDT &cdt, typename CDT::Vertex_handle v,
+                 typename CDT::Vertex_handle a, typename CDT::Vertex_handle b,
+                 const typename CDT::Point &p, bool on_constraint = true) {
+  if (lands_on_other_vertex(cdt, v, p)) {
+    return v;
+  }
+  cdt.remove_incident_constraints(v);
+  cdt.remove(v);
+  typename CDT::Vertex_handle moved = cdt.insert(p, a->face());
+  if (on_constraint) {
+    cdt.insert_constraint(a, moved);
+    cdt.insert_constraint(moved, b);
+  } else {
+    cdt.insert_constraint(a, b);
+  }
+  return moved;
+}
+
+/* Signed height of the weighted circumcenter over edge i (from x[i] to
+ * x[i + 1]) of a face, positive on the side of the face */
+inline double hot_edge_height(const double x[3][2], const double w[3], int i) {
+  double c[2], s;
+  if (!hot_face_circumcenter(x, w, c, s)) {
+    return 0.0;
+  }
+  const int j = (i + 1) % 3;
+  const double tx = x[j][0] - x[i][0], ty = x[j][1] - x[i][1];
+  const double qx = c[0] - x[i][0], qy = c[1] - x[i][1];
+  return s * (tx * qy - ty * qx) / std::sqrt(tx * tx + ty * ty);
+}
+
+/* The *star-HOT_2 energy of the in-domain faces of cdt, as marked by
+ * mark_domain. As in energy_density_EMethod, a domain boundary edge only
+ * contributes when the circumcenter of its face is on the inside (h > 0);
+ * otherwise its dual edge lies outside the domain. If index is non-null,
+ * the gradient is scattered into grad (2 entries per vertex) for the
+ * vertices in index */
+template <int star, typename CDT>
+double cdt_hot_energy(
+    const CDT &cdt,
+    const std::map<typename CDT::Vertex_handle, int> *index = nullptr,
+    std::vector<double> *grad = nullptr) {
+  double energy = 0.0;
+  for (auto face_itr = cdt.finite_faces_begin();
+       face_itr != cdt.finite_faces_end(); face_itr++) {
+    if (!face_itr->is_in_domain()) {
+      continue;
+    }
+    double x[3][2], w[3], gx[3][2], gw[3];
+    mesh_traits<CDT>::face_coordinates(face_itr, x, w);
+    energy += hot_face_kernel<star>()(x, w, gx, gw);
+    for (int k = 0; k < 3; k++) {
+      // the edge opposite vertex k runs from x[k + 1] to x[k + 2]
+      const int i = (k + 1) % 3;
+      if (!is_domain_boundary(cdt, face_itr, k) ||
+          hot_edge_height(x, w, i) > 0) {
+        continue;
+      }
+      double edge_grad[6], edge_hess[6][6];
+      energy -= hot_edge_hessian<2, star>(x, w, i, edge_grad, edge_hess);
+      for (int a = 0; a < 6; a++) {
+        gx[a / 2][a % 2] -= edge_grad[a];
+      }
+    }
+    if (index == nullptr) {
+      continue;
+    }
+    for (int v = 0; v < 3; v++) {
+      auto idx_itr = index->find(face_itr->vertex(v));
+      if (idx_itr == index->end()) {
+        continue;
+      }
+      (*grad)[2 * idx_itr->second] += gx[v][0];
+      (*grad)[2 * idx_itr->second + 1] += gx[v][1];
+    }
+  }
+  return energy;
+}
+
+struct cdt_hot_params : mesh_optimize_params {
+  // sliding vertices stay at least this fraction of their constraint run
+  // away from its ends
+  double slide_margin = 0.05;
+};
+
+/* Projected gradient descent of the HOT energy of the domain of cdt, with
+ * a backtracking line search. Free vertices follow the gradient, sliding
+ * vertices its projection on their constraint line, and the constraints
+ * are kept. A step which would take a free vertex out of the domain or
+ * onto a constraint is treated like one which raises the energy */
+template <int star = 1, typename CDT>
+mesh_optimize_result
+cdt_hot_optimize(CDT &cdt, const cdt_hot_params &params = cdt_hot_params()) {
+  using Vertex_handle = typename CDT::Vertex_handle;
+  mark_domain(cdt);
+  mesh_optimize_result result = {0, cdt_hot_energy<star>(cdt)};
+
+  double step = params.step;
+  for (; result.iterations < params.max_iterations; result.iterations++) {
+    std::vector<Vertex_handle> verts;
+    std::vector<std::array<Vertex_handle, 2>> ends;
+    for (auto v_itr = cdt.finite_vertices_begin();
+         v_itr != cdt.finite_vertices_end(); v_itr++) {
+      Vertex_handle v_ends[2];
+      const cdt_vertex_kind kind = classify_cdt_vertex(cdt, v_itr, v_ends);
+      if (kind == cdt_vertex_kind::fixed) {
+        continue;
+      }
+      verts.push_back(v_itr);
+      if (kind == cdt_vertex_kind::free) {
+        v_ends[0] = v_ends[1] = Vertex_handle();
+      }
+      ends.push_back({{v_ends[0], v_ends[1]}});
+    }
+    if (verts.empty()) {
+      break;
+    }
+    std::map<Vertex_handle, int> index;
+    std::vector<double> initial(2 * verts.size());
+    for (size_t i = 0; i < verts.size(); i++) {
+      index[verts[i]] = i;
+      initial[2 * i] = CGAL::to_double(verts[i]->point().x());
+      initial[2 * i + 1] = CGAL::to_double(verts[i]->point().y());
+    }
+    std::vector<double> grad(2 * verts.size(), 0.0);
+    const double current = cdt_hot_energy<star>(cdt, &index, &grad);
+
+    // Project the sliding vertices' gradients onto their lines, and find
+    // how far along the line they may go
+    std::vector<double> slide_min(verts.size()), slide_max(verts.size());
+    for (size_t i = 0; i < verts.size(); i++) {
+      if (ends[i][0] == Vertex_handle()) {
+        continue;
+      }
+      const double ax = CGAL::to_double(ends[i][0]->point().x()),
+                   ay = CGAL::to_double(ends[i][0]->point().y());
+      const double bx = CGAL::to_double(ends[i][1]->point().x()),
+                   by = CGAL::to_double(ends[i][1]->point().y());
+      const double length = std::hypot(bx - ax, by - ay);
+      const double tx = (bx - ax) / length, ty = (by - ay) / length;
+      const double along = grad[2 * i] * tx + grad[2 * i + 1] * ty;
+      grad[2 * i] = along * tx;
+      grad[2 * i + 1] = along * ty;
+      const double t0 =
+          (initial[2 * i] - ax) * tx + (initial[2 * i + 1] - ay) * ty;
+      slide_min[i] = params.slide_margin * length - t0;
+      slide_max[i] = (1 - params.slide_margin) * length - t0;
+    }
+
+    auto move_to = [&](size_t i, double x, double y) {
+      if (ends[i][0] == Vertex_handle()) {
+        Vertex_handle split[2];
+        if (incident_constraint_ends(cdt, verts[i], split) == 2) {
+          // A rejected step left the vertex on a constraint, which it
+          // split; restore the constraint before moving it off. The domain
+          // marks are stale here, so this goes by the constraints alone
+          verts[i] = slide_cdt_vertex(cdt, verts[i], split[0], split[1],
+                                      typename CDT::Point(x, y), false);
+          return;
+        }
+        // refused if the vertex is still on a constraint
+        verts[i] = mesh_traits<CDT>::move(cdt, verts[i], x, y, 0.0);
+        return;
+      }
+      // clamp to the allowed part of the constraint run, measured from the
+      // starting position
+      const double ax = CGAL::to_double(ends[i][0]->point().x()),
+                   ay = CGAL::to_double(ends[i][0]->point().y());
+      const double bx = CGAL::to_double(ends[i][1]->point().x()),
+                   by = CGAL::to_double(ends[i][1]->point().y());
+      const double length = std::hypot(bx - ax, by - ay);
+      const double tx = (bx - ax) / length, ty = (by - ay) / length;
+      double t = (x - initial[2 * i]) * tx + (y - initial[2 * i + 1]) * ty;
+      t = std::min(std::max(t, slide_min[i]), slide_max[i]);
+      verts[i] = slide_cdt_vertex(
+          cdt, verts[i], ends[i][0], ends[i][1],
+          typename CDT::Point(initial[2 * i] + t * tx,
+                              initial[2 * i + 1] + t * ty));
+    };
+    // free vertices must stay strictly inside the domain
+    auto step_is_valid = [&]() {
+      for (size_t i = 0; i < verts.size(); i++) {
+        if (ends[i][0] != Vertex_handle()) {
+          continue;
+        }
+        if (cdt.are_there_incident_constraints(verts[i])) {
+          return false;
+        }
+        typename CDT::Face_circulator fc = cdt.incident_faces(verts[i]),
+                                      done(fc);
+        do {
+          if (cdt.is_infinite(fc) || !fc->is_in_domain()) {
+            return false;
+          }
+        } while (++fc != done);
+      }
+      return true;
+    };
+
+    double new_energy = current;
+    for (int backtrack = 0; backtrack < params.max_backtracks; backtrack++) {
+      for (size_t i = 0; i < verts.size(); i++) {
+        move_to(i, initial[2 * i] - step * grad[2 * i],
+                initial[2 * i + 1] - step * grad[2 * i + 1]);
+      }
+      mark_domain(cdt);
+      new_energy = step_is_valid() ? cdt_hot_energy<star>(cdt)
+                                   : std::numeric_limits<double>::infinity();
+      if (new_energy < current) {
+        step *= 1.5;
+        break;
+      }
+      // Undo the step and try a shorter one
+      for (size_t i = 0; i < verts.size(); i++) {
+        move_to(i, initial[2 * i], initial[2 * i + 1]);
+      }
+      mark_domain(cdt);
+      new_energy = current;
+      step *= 0.5;
+    }
+
+    result.energy = new_energy;
+    log_iteration({"cdt_hot_optimize", result.iterations, new_energy,
+                   std::sqrt(std::inner_product(grad.begin(), grad.end(),
+                                                grad.begin(), 0.0)),
+                   step, 0});
+    if (current - new_energy < params.min_delta_energy) {
+      result.iterations++;
+      break;
+    }
+  }
+  return result;
+}
+
+#endif // _CDT_HOT_OPTIMIZE_HPP_
@@ -0,0 +1,259 @@
+#ifndef _CVT_DENSITY_HPP_
+#define _CVT_DENSITY_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "lloyds.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  DENSITY WEIGHTED CVT CELLS ////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// Densities for lloyd_iterate, anderson_cvt and lbfgs_cvt. Each one turns a
+// clipped cell into its mass, center of mass, and \int rho |x - site|^2,
+// with work proportional to the number of cell edges (and, for a raster,
+// the pixels the edges cross), never to the area of the cell.
+
+/* Gauss-Legendre rule with n points on [0, 1], exact for degree 2n - 1 */
+inline void gauss_legendre(int n, std::vector<double> &nodes,
+                           std::vector<double> &weights) {
+  nodes.resize(n);
+  weights.resize(n);
+  for (int i = 0; i < n; i++) {
+    // Newton's method on P_n from the Chebyshev estimate of root i
+    double x = std::cos(M_PI * (i + 0.75) / (n + 0.5));
+    double dp = 1;
+    for (int iteration = 0; iteration < 100; iteration++) {
+      double p0 = 1, p1 = x;
+      for (int k = 2; k <= n; k++) {
+        const double p2 = ((2 * k - 1) * x * p1 - (k - 1) * p0) / k;
+        p0 = p1;
+        p1 = p2;
+      }
+      dp = n * (x * p1 - p0) / (x * x - 1);
+      const double dx = p1 / dp;
+      x -= dx;
+      if (std::abs(dx) < 1e-16) {
+        break;
+      }
+    }
+    nodes[i] = 0.5 * (1 - x);
+    weights[i] = 1.0 / ((1 - x * x) * dp * dp);
+  }
+}
+
+/* rho(x, y) = sum_{a + b <= degree} coefficient(a, b) x^a y^b.
+ * Cells are fanned into triangles from the site and each triangle is
+ * integrated exactly with a collapsed tensor Gauss rule, in coordinates
+ * relative to the site so that small cells don't lose precision */
+struct polynomial_density {
+  int degree;
+  std::vector<double> coefficients;
+  std::vector<double> nodes, weights;
+
+  explicit polynomial_density(int degree)
+      : degree(degree), coefficients((degree + 1) * (degree + 1), 0.0) {
+    // rho |x - site|^2 has degree + 2, and the collapse adds one more
+    gauss_legendre((degree + 5) / 2, nodes, weights);
+  }
+
+  double &coefficient(int a, int b) { return coefficients[a * (degree + 1) + b]; }
+
+  double value(double x, double y) const {
+    double sum = 0;
+    for (int a = degree; a >= 0; a--) {
+      double row = 0;
+      for (int b = degree - a; b >= 0; b--) {
+        row = row * y + coefficients[a * (degree + 1) + b];
+      }
+      sum = sum * x + row;
+    }
+    return sum;
+  }
+
+  cvt_cell_moments moments(const cvt_polygon &cell, double px,
+                           double py) const {
+    cvt_cell_moments m = {0, {px, py}, 0};
+    double mx = 0, my = 0;
+    const size_t n = cell.size();
+    const size_t q = nodes.size();
+    for (size_t i = 0; i < n; i++) {
+      const size_t j = (i + 1) % n;
+      // triangle (site, a, b) mapped from the unit square by
+      // u = s ((1 - t) a + t b), with Jacobian s (a x b)
+      const double ax = cell.x[i] - px, ay = cell.y[i] - py;
+      const double bx = cell.x[j] - px, by = cell.y[j] - py;
+      const double cross = ax * by - ay * bx;
+      if (cross == 0) {
+        continue;
+      }
+      for (size_t k = 0; k < q; k++) {
+        const double s = nodes[k];
+        for (size_t l = 0; l < q; l++) {
+          const double t = nodes[l];
+          const double ux = s * ((1 - t) * ax + t * bx);
+          const double uy = s * ((1 - t) * ay + t * by);
+          const double w = weights[k] * weights[l] * s * cross;
+          const double rho = value(px + ux, py + uy) * w;
+          m.area += rho;
+          mx += rho * ux;
+          my += rho * uy;
+          m.energy += rho * (ux * ux + uy * uy);
+        }
+      }
+    }
+    if (m.area > 0) {
+      m.centroid[0] = px + mx / m.area;
+      m.centroid[1] = py + my / m.area;
+    }
+    return m;
+  }
+};
+
+/* Piecewise constant density on an nx by ny grid of dx by dy pixels with
+ * lower left corner (x0, y0), values row major, zero outside the grid.
+ *
+ * By Green's theorem \int_cell rho x^a y^b = \oint y^b F_a(x, y) dy with
+ * F_a(x, y) = \int_{x0}^x rho(s, y) s^a ds, which is piecewise polynomial
+ * and is read from per-row summed-area tables (integral images). Each cell
+ * edge is split where it crosses the grid lines; on every piece rho is
+ * constant and the integrand is a cubic, so two Gauss points are exact.
+ * Coordinates are relative to (x0, y0) */
+struct raster_density {
+  double x0, y0, dx, dy;
+  int nx, ny;
+  std::vector<double> values;
+  // row_integrals[a][j * (nx + 1) + i] = F_a(x0 + i dx, in row j)
+  std::vector<double> row_integrals[3];
+
+  raster_density(double x0, double y0, double dx, double dy, int nx, int ny,
+                 const std::vector<double> &values)
+      : x0(x0), y0(y0), dx(dx), dy(dy), nx(nx), ny(ny), values(values) {
+    for (int a = 0; a < 3; a++) {
+      row_integrals[a].assign((nx + 1) * ny, 0.0);
+    }
+    for (int j = 0; j < ny; j++) {
+      for (int i = 0; i < nx; i++) {
+        const double rho = values[j * nx + i];
+        const double s0 = i * dx, s1 = (i + 1) * dx;
+        double p0 = 1, p1 = 1;
+        for (int a = 0; a < 3; a++) {
+          p0 *= s0;
+          p1 *= s1;
+          row_integrals[a][j * (nx + 1) + i + 1] =
+              row_integrals[a][j * (nx + 1) + i] + rho * (p1 - p0) / (a + 1);
+        }
+      }
+    }
+  }
+
+  double value(double x, double y) const {
+    const int i = grid_index((x - x0) / dx, nx);
+    const int j = grid_index((y - y0) / dy, ny);
+    if (i < 0 || i >= nx || j < 0 || j >= ny) {
+      return 0;
+    }
+    return values[j * nx + i];
+  }
+
+  /* floor(u) clamped to [-1, n], so far off coordinates don't overflow */
+  static int grid_index(double u, int n) {
+    return static_cast<int>(
+        std::floor(std::min(std::max(u, -1.0), static_cast<double>(n))));
+  }
+
+  /* Adds the integrals of F_0, F_1, F_2, y F_0 and y^2 F_0 dy along the
+   * edge from (ax, ay) to (bx, by), in grid relative coordinates, to
+   * sums. t is scratch space for the edge parameters of the grid crossings */
+  void add_edge(double ax, double ay, double bx, double by, double sums[5],
+                std::vector<double> &t) const {
+    if (ay == by) {
+      return;
+    }
+    t.clear();
+    // Only the grid lines 0..n split the edge; past them rho is 0 and F_a
+    // is constant, so a cell reaching far beyond the grid costs no more
+    auto add_crossings = [&](double a, double b, double h, int n) {
+      const double lo = std::min(a, b), hi = std::max(a, b);
+      for (double k = std::max(std::ceil(lo / h), 0.0); k <= n && k * h < hi;
+           k++) {
+        t.push_back((k * h - a) / (b - a));
+      }
+    };
+    if (ax != bx) {
+      add_crossings(ax, bx, dx, nx);
+    }
+    add_crossings(ay, by, dy, ny);
+    std::sort(t.begin(), t.end());
+    const int num_cuts = t.size();
+
+    static const double g = 0.5 / std::sqrt(3.0);
+    double t0 = 0;
+    for (int c = 0; c <= num_cuts; c++) {
+      const double t1 = c < num_cuts ? t[c] : 1.0;
+      if (t1 <= t0) {
+        continue;
+      }
+      const double tm = 0.5 * (t0 + t1);
+      const int j = grid_index((ay + tm * (by - ay)) / dy, ny);
+      if (j >= 0 && j < ny) {
+        const int i = grid_index((ax + tm * (bx - ax)) / dx, nx);
+        const double *F[3] = {&row_integrals[0][j * (nx + 1)],
+                              &row_integrals[1][j * (nx + 1)],
+                              &row_integrals[2][j * (nx + 1)]};
+        const double piece_dy = 0.5 * (t1 - t0) * (by - ay);
+        for (int side = -1; side <= 1; side += 2) {
+          const double tq = tm + side * g * (t1 - t0);
+          const double x = ax + tq * (bx - ax), y = ay + tq * (by - ay);
+          double f[3];
+          if (i < 0) {
+            f[0] = f[1] = f[2] = 0;
+          } else if (i >= nx) {
+            for (int a = 0; a < 3; a++) {
+              f[a] = F[a][nx];
+            }
+          } else {
+            const double rho = values[j * nx + i];
+            const double s0 = i * dx;
+            f[0] = F[0][i] + rho * (x - s0);
+            f[1] = F[1][i] + rho * (x * x - s0 * s0) / 2;
+            f[2] = F[2][i] + rho * (x * x * x - s0 * s0 * s0) / 3;
+          }
+          sums[0] += f[0] * piece_dy;
+          sums[1] += f[1] * piece_dy;
+          sums[2] += f[2] * piece_dy;
+          sums[3] += y * f[0] * piece_dy;
+          sums[4] += y * y * f[0] * piece_dy;
+        }
+      }
+      t0 = t1;
+    }
+  }
+
+  cvt_cell_moments moments(const cvt_polygon &cell, double px,
+                           double py) const {
+    cvt_cell_moments m = {0, {px, py}, 0};
+    // \int rho, rho x, rho x^2, rho y, rho y^2
+    double sums[5] = {0, 0, 0, 0, 0};
+    std::vector<double> cuts;
+    const size_t n = cell.size();
+    for (size_t i = 0; i < n; i++) {
+      const size_t j = (i + 1) % n;
+      add_edge(cell.x[i] - x0, cell.y[i] - y0, cell.x[j] - x0,
+               cell.y[j] - y0, sums, cuts);
+    }
+    m.area = sums[0];
+    if (m.area > 0) {
+      const double sx = px - x0, sy = py - y0;
+      m.centroid[0] = x0 + sums[1] / m.area;
+      m.centroid[1] = y0 + sums[3] / m.area;
+      m.energy = sums[2] + sums[4] - 2 * (sx * sums[1] + sy * sums[3]) +
+                 (sx * sx + sy * sy) * sums[0];
+    }
+    return m;
+  }
+};
+
+#endif // _CVT_DENSITY_HPP_
@@ -0,0 +1,122 @@
+// h_deriv_batch.hpp
+// Derivatives of the circumcenter heights of a face with respect to all three
+// of its vertices at once. The edge vectors, |eij|^2, twice the signed area
+// and the dot product are formed once and shared by all six derivatives. The
+// batch form takes faces in structure of arrays form, so the loop is branch
+// free and vectorizes (the build passes -fno-math-errno, without which sqrt
+// keeps GCC from vectorizing it), and it is split across threads.
+#ifndef _H_DERIV_BATCH_HPP_
+#define _H_DERIV_BATCH_HPP_
+
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+
+#include "cgal-kernel.h"
+#include "parallel.hpp"
+#include "wcirc_batch.hpp"
+
+/* The height h of edge (xi, xj) opposite xk, as signed_dist_circumcenters
+ * gives it: h = sqrt(L) C / (2 |D|), in the terms below */
+inline double h_kernel(double xi1, double xi2, double xj1, double xj2,
+                       double xk1, double xk2) {
+  const double eij1 = xi1 - xj1, eij2 = xi2 - xj2;
+  const double eik1 = xi1 - xk1, eik2 = xi2 - xk2;
+  const double ejk1 = xj1 - xk1, ejk2 = xj2 - xk2;
+  const double L = eij1 * eij1 + eij2 * eij2;
+  const double D = eik2 * ejk1 - eik1 * ejk2;
+  const double C = eik1 * ejk1 + eik2 * ejk2;
+  return 0.5 * std::sqrt(L) * C / std::fabs(D);
+}
+
+/* Derivatives of the height h of edge (xi, xj) opposite xk, the signed
+ * distance signed_dist_circumcenters gives from the circumcenter to the edge,
+ * with respect to xi, xj and xk. With C = (xi - xk) . (xj - xk),
+ * L = |xi - xj|^2 and D twice the signed area,
+ *   h = sqrt(L) C / (2 |D|)
+ *   h' = sqrt(L) (C' + C L' / (2 L) - C D' / D) / (2 |D|)
+ * One division serves all three ratios: t = 1 / (L D) */
+inline void h_derivs_kernel(double xi1, double xi2, double xj1, double xj2,
+                            double xk1, double xk2, double &di1, double &di2,
+                            double &dj1, double &dj2, double &dk1,
+                            double &dk2) {
+  const double eij1 = xi1 - xj1, eij2 = xi2 - xj2;
+  const double eik1 = xi1 - xk1, eik2 = xi2 - xk2;
+  const double ejk1 = xj1 - xk1, ejk2 = xj2 - xk2;
+  const double L = eij1 * eij1 + eij2 * eij2;
+  const double D = eik2 * ejk1 - eik1 * ejk2;
+  const double C = eik1 * ejk1 + eik2 * ejk2;
+  const double t = 1.0 / (L * D);
+  // sqrt(L) / (2 |D|), C / L and C / D
+  const double s = 0.5 * L * std::sqrt(L) * std::fabs(t);
+  const double q = C * D * t, r = C * L * t;
+  // dL/dxi = -dL/dxj = 2 eij; dD/dxi = (-ejk2, ejk1), dD/dxj = (eik2, -eik1),
+  // and every derivative sums to 0 over the three vertices
+  di1 = s * (ejk1 + q * eij1 + r * ejk2);
+  di2 = s * (ejk2 + q * eij2 - r * ejk1);
+  dj1 = s * (eik1 - q * eij1 - r * eik2);
+  dj2 = s * (eik2 - q * eij2 + r * eik1);
+  dk1 = -(di1 + dj1);
+  dk2 = -(di2 + dj2);
+}
+
+/* compute_h_deriv(xi, xj, xk, v + 1, h_derv[v]) for v = 0, 1, 2 */
+inline void compute_h_derivs(const Point &xi, const Point &xj, const Point &xk,
+                             double h_derv[3][2]) {
+  h_derivs_kernel(xi.x(), xi.y(), xj.x(), xj.y(), xk.x(), xk.y(), h_derv[0][0],
+                  h_derv[0][1], h_derv[1][0], h_derv[1][1], h_derv[2][0],
+                  h_derv[2][1]);
+}
+
+/* Faces in structure of arrays form, as edge (0, 1) opposite vertex 2, along
+ * with the derivatives of their heights with respect to each vertex */
+struct h_deriv_batch {
+  std::vector<double> x0, y0, x1, y1, x2, y2;
+  std::vector<double> dx0, dy0, dx1, dy1, dx2, dy2;
+
+  std::size_t size() const { return x0.size(); }
+
+  void resize(std::size_t n) {
+    for (std::vector<double> *column : {&x0, &y0, &x1, &y1, &x2, &y2, &dx0,
+                                        &dy0, &dx1, &dy1, &dx2, &dy2}) {
+      column->resize(n);
+    }
+  }
+};
+
+/* Computes the height derivatives of faces [begin, end) */
+inline void h_derivs_soa(
+    const double *HOT_RESTRICT x0, const double *HOT_RESTRICT y0,
+    const double *HOT_RESTRICT x1, const double *HOT_RESTRICT y1,
+    const double *HOT_RESTRICT x2, const double *HOT_RESTRICT y2,
+    double *HOT_RESTRICT dx0, double *HOT_RESTRICT dy0,
+    double *HOT_RESTRICT dx1, double *HOT_RESTRICT dy1,
+    double *HOT_RESTRICT dx2, double *HOT_RESTRICT dy2, std::size_t begin,
+    std::size_t end) {
+  for (std::size_t i = begin; i < end; i++) {
+    // Through locals, so the stores don't look like they alias the loads
+    double d[6];
+    h_derivs_kernel(x0[i], y0[i], x1[i], y1[i], x2[i], y2[i], d[0], d[1],
+                    d[2], d[3], d[4], d[5]);
+    dx0[i] = d[0];
+    dy0[i] = d[1];
+    dx1[i] = d[2];
+    dy1[i] = d[3];
+    dx2[i] = d[4];
+    dy2[i] = d[5];
+  }
+}
+
+/* Height derivatives of every face in the batch, in parallel */
+inline void compute_h_derivs(h_deriv_batch &batch) {
+  parallel_for(batch.size(), [&](int, std::size_t begin, std::size_t end) {
+    h_derivs_soa(batch.x0.data(), batch.y0.data(), batch.x1.data(),
+                 batch.y1.data(), batch.x2.data(), batch.y2.data(),
+                 batch.dx0.data(), batch.dy0.data(), batch.dx1.data(),
+                 batch.dy1.data(), batch.dx2.data(), batch.dy2.data(), begin,
+                 end);
+  });
+}
+
+#endif // _H_DERIV_BATCH_HPP_
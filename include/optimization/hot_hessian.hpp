@@ -0,0 +1,227 @@
+#ifndef _HOT_HESSIAN_HPP_
+#define _HOT_HESSIAN_HPP_
+
+#include <cmath>
+
+#include "energyWeights.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  SECOND DERIVATIVES OF THE HOT ENERGY ////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// The energy of a face is written once, generic in the scalar type, and its
+// Hessian with respect to the 6 vertex coordinates comes from evaluating it
+// with second order forward mode numbers (jet2). The weights are constants,
+// so the same kernels serve DT (zero weights) and RegT with fixed weights.
+
+/* Value, gradient and Hessian of a function of N variables */
+template <int N> struct jet2 {
+  double v;
+  double g[N];
+  double h[N][N];
+
+  jet2(double value = 0.0) : v(value) {
+    for (int a = 0; a < N; a++) {
+      g[a] = 0.0;
+      for (int b = 0; b < N; b++) {
+        h[a][b] = 0.0;
+      }
+    }
+  }
+
+  // The independent variable number index, with the given value
+  static jet2 variable(double value, int index) {
+    jet2 x(value);
+    x.g[index] = 1.0;
+    return x;
+  }
+};
+
+/* f(x) from f(x.v), f'(x.v) and f''(x.v) by the chain rule */
+template <int N>
+jet2<N> jet_chain(const jet2<N> &x, double f, double df, double d2f) {
+  jet2<N> r(f);
+  for (int a = 0; a < N; a++) {
+    r.g[a] = df * x.g[a];
+    for (int b = 0; b < N; b++) {
+      r.h[a][b] = df * x.h[a][b] + d2f * x.g[a] * x.g[b];
+    }
+  }
+  return r;
+}
+
+template <int N> jet2<N> operator+(const jet2<N> &x, const jet2<N> &y) {
+  jet2<N> r(x.v + y.v);
+  for (int a = 0; a < N; a++) {
+    r.g[a] = x.g[a] + y.g[a];
+    for (int b = 0; b < N; b++) {
+      r.h[a][b] = x.h[a][b] + y.h[a][b];
+    }
+  }
+  return r;
+}
+
+template <int N> jet2<N> operator*(double s, const jet2<N> &x) {
+  return jet_chain(x, s * x.v, s, 0.0);
+}
+
+template <int N> jet2<N> operator*(const jet2<N> &x, double s) {
+  return s * x;
+}
+
+template <int N> jet2<N> operator-(const jet2<N> &x) { return -1.0 * x; }
+
+template <int N> jet2<N> operator-(const jet2<N> &x, const jet2<N> &y) {
+  return x + (-y);
+}
+
+template <int N> jet2<N> operator+(const jet2<N> &x, double s) {
+  jet2<N> r(x);
+  r.v += s;
+  return r;
+}
+
+template <int N> jet2<N> operator+(double s, const jet2<N> &x) {
+  return x + s;
+}
+
+template <int N> jet2<N> operator-(const jet2<N> &x, double s) {
+  return x + (-s);
+}
+
+template <int N> jet2<N> operator-(double s, const jet2<N> &x) {
+  return (-x) + s;
+}
+
+template <int N> jet2<N> operator*(const jet2<N> &x, const jet2<N> &y) {
+  jet2<N> r(x.v * y.v);
+  for (int a = 0; a < N; a++) {
+    r.g[a] = x.v * y.g[a] + y.v * x.g[a];
+    for (int b = 0; b < N; b++) {
+      r.h[a][b] = x.v * y.h[a][b] + y.v * x.h[a][b] + x.g[a] * y.g[b] +
+                  y.g[a] * x.g[b];
+    }
+  }
+  return r;
+}
+
+template <int N> jet2<N> jet_inverse(const jet2<N> &x) {
+  const double inv = 1.0 / x.v;
+  return jet_chain(x, inv, -inv * inv, 2 * inv * inv * inv);
+}
+
+template <int N> jet2<N> operator/(const jet2<N> &x, const jet2<N> &y) {
+  return x * jet_inverse(y);
+}
+
+template <int N> jet2<N> operator/(const jet2<N> &x, double s) {
+  return (1.0 / s) * x;
+}
+
+template <int N> jet2<N> operator/(double s, const jet2<N> &x) {
+  return s * jet_inverse(x);
+}
+
+template <int N> jet2<N> sqrt(const jet2<N> &x) {
+  const double r = std::sqrt(x.v);
+  return jet_chain(x, r, 0.5 / r, -0.25 / (r * x.v));
+}
+
+inline double jet_value(double x) { return x; }
+template <int N> double jet_value(const jet2<N> &x) { return x.v; }
+
+/* The energy subtri_energy_weights(dij, hk) + subtri_energy_weights(dji, hk)
+ * of the edge from x[i] to x[i + 1] with weighted circumcenter c, as in
+ * triangle_energy_weights_grad. s is the orientation sign of the face */
+template <int Wk, int star, typename T>
+T hot_edge_energy(const T x[3][2], const T c[2], const double w[3], double s,
+                  int i) {
+  using std::sqrt;
+  const int j = (i + 1) % 3;
+  const T tx = x[j][0] - x[i][0], ty = x[j][1] - x[i][1];
+  const T qx = c[0] - x[i][0], qy = c[1] - x[i][1];
+  const T e = sqrt(tx * tx + ty * ty);
+  const T hk = s * (tx * qy - ty * qx) / e;
+  const T dij = 0.5 * e + (w[j] - w[i]) / (2.0 * e);
+  const T dji = 0.5 * e + (w[i] - w[j]) / (2.0 * e);
+  const double c1 = weighted_star_constant<Wk, star>::constant1;
+  const double c2 = weighted_star_constant<Wk, star>::constant2;
+  const T hk3 = hk * hk * hk;
+  return (dij * dij * dij + dji * dji * dji) * hk / c1 + (dij + dji) * hk3 / c2;
+}
+
+/* Weighted circumcenter and orientation sign of a face, generic in the
+ * scalar type. Returns false for degenerate faces */
+template <typename T>
+bool hot_face_circumcenter(const T x[3][2], const double w[3], T c[2],
+                           double &s) {
+  const T r1x = x[1][0] - x[0][0], r1y = x[1][1] - x[0][1];
+  const T r2x = x[2][0] - x[0][0], r2y = x[2][1] - x[0][1];
+  const T det = r1x * r2y - r1y * r2x;
+  if (jet_value(det) == 0.0) {
+    return false;
+  }
+  s = jet_value(det) > 0 ? 1.0 : -1.0;
+  const T b1 = 0.5 * (r1x * r1x + r1y * r1y) + 0.5 * (w[0] - w[1]);
+  const T b2 = 0.5 * (r2x * r2x + r2y * r2y) + 0.5 * (w[0] - w[2]);
+  c[0] = x[0][0] + (b1 * r2y - b2 * r1y) / det;
+  c[1] = x[0][1] + (b2 * r1x - b1 * r2x) / det;
+  return true;
+}
+
+// Seeds jets with the face coordinates, variable 2 v + a for x[v][a]
+template <int N>
+void hot_jet_coordinates(const double x[3][2], jet2<N> xj[3][2]) {
+  for (int v = 0; v < 3; v++) {
+    for (int a = 0; a < 2; a++) {
+      xj[v][a] = jet2<N>::variable(x[v][a], 2 * v + a);
+    }
+  }
+}
+
+/* Energy of edge i (from x[i] to x[i + 1]) of a face with its gradient
+ * grad[2 v + a] and Hessian hess[2 v + a][2 u + b] with respect to the
+ * positions. The gradient and Hessian are overwritten */
+template <int Wk, int star>
+double hot_edge_hessian(const double x[3][2], const double w[3], int i,
+                        double grad[6], double hess[6][6]) {
+  jet2<6> xj[3][2], c[2];
+  hot_jet_coordinates(x, xj);
+  double s;
+  jet2<6> energy;
+  if (hot_face_circumcenter(xj, w, c, s)) {
+    energy = hot_edge_energy<Wk, star>(xj, c, w, s, i);
+  }
+  for (int a = 0; a < 6; a++) {
+    grad[a] = energy.g[a];
+    for (int b = 0; b < 6; b++) {
+      hess[a][b] = energy.h[a][b];
+    }
+  }
+  return energy.v;
+}
+
+/* triangle_energy_weights<Wk, star> of a face, with its gradient and
+ * Hessian with respect to the positions laid out as in hot_edge_hessian */
+template <int Wk, int star>
+double hot_face_hessian(const double x[3][2], const double w[3],
+                        double grad[6], double hess[6][6]) {
+  jet2<6> xj[3][2], c[2];
+  hot_jet_coordinates(x, xj);
+  double s;
+  jet2<6> energy;
+  if (hot_face_circumcenter(xj, w, c, s)) {
+    for (int i = 0; i < 3; i++) {
+      energy = energy + hot_edge_energy<Wk, star>(xj, c, w, s, i);
+    }
+  }
+  for (int a = 0; a < 6; a++) {
+    grad[a] = energy.g[a];
+    for (int b = 0; b < 6; b++) {
+      hess[a][b] = energy.h[a][b];
+    }
+  }
+  return energy.v;
+}
+
+#endif // _HOT_HESSIAN_HPP_
@@ -6,6 +6,15 @@
 #ifndef _LLOYDS_HPP_
 #define _LLOYDS_HPP_
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "bulk_build.hpp"
+#include "checkpoint.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
 
 // requires the points to be in order around the perimeter of the polygon. polygon need not be convex 
 Point center_mass_polygon( std::vector<Point> points){
@@ -16,67 +25,322 @@ Point center_mass_polygon( std::vector<Point> points){
 	int size=points.size(); 
 	for(int i=0; i <size; i++){
 		double scale_i=points[i].x()*points[(i+1)%size].y()-points[(i+1)%size].x()*points[i].y();
-		std::cout<<scale_i <<std::endl; 
+		HOT_TRACE(scale_i); 
 		scale_total+=scale_i; 
 		x_coor+=scale_i*(points[i].x()+points[(i+1)%size].x()); 
 		y_coor+=scale_i*(points[i].y()+points[(i+1)%size].y()); 
 	}
 	x_coor=x_coor/(3*scale_total);
 	y_coor=y_coor/(3*scale_total);
-	std::cout<<"center of mass: " << x_coor <<", " << y_coor <<std::endl; 
+	HOT_TRACE("center of mass: " << x_coor <<", " << y_coor); 
 	return Point(x_coor, y_coor);
 }
 
-std::vector<Point> lloyds_CVT(std::vector<Point> points, int CVT_iterations, double x_min, double x_max, double y_min, double y_max){
-	std::vector<Point> new_sites; 
-	while(CVT_iterations >0){
-		Voronoi_diagram vd;
-		for(auto point:points){
-			vd.insert(point);
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CVT engine. Each Voronoi cell is the domain clipped by the bisectors with the site's Delaunay neighbors,
+// so the cells, their centroids and the CVT energy all come from one pass over the vertex stars of a DT,
+// and the sites are moved in place in the same DT.
+
+// Convex domain the Voronoi cells are clipped to, vertices counterclockwise
+struct cvt_domain{
+	std::vector<double> x, y; 
+
+	cvt_domain(){}
+
+	// vertices of a convex polygon, in either orientation
+	explicit cvt_domain(const std::vector<Point> &polygon){
+		for(const Point &p: polygon){
+			x.push_back(CGAL::to_double(p.x())); 
+			y.push_back(CGAL::to_double(p.y())); 
 		}
-		int num_bounded_faces=0;
-		std::vector<Point> centroids_Voronoi_regions; 
-		for(auto face_itr=vd.bounded_faces_begin(); face_itr!=vd.bounded_faces_end(); face_itr++){
-			num_bounded_faces++;
-			std::vector<Point> points_in_face;
-			
-			Voronoi_diagram::Ccb_halfedge_circulator ec_start = (face_itr)->ccb();
-			Voronoi_diagram::Ccb_halfedge_circulator ec=ec_start;  
-			do{
-				points_in_face.push_back(ec ->source() ->point()); 	
-			}while(++ec!=ec_start); 
-			
-			std::cout <<"points in face " << num_bounded_faces <<std::endl;
-			for(auto point: points_in_face){std::cout <<point.x() << ", " <<point.y() <<std::endl; 
-			}
-			
-			
-		new_sites.push_back(center_mass_polygon(points_in_face)); 
-		}	
+		double twice_area=0; 
+		for(size_t i=0; i<x.size(); i++){
+			size_t j=(i+1)%x.size(); 
+			twice_area+=x[i]*y[j]-x[j]*y[i]; 
+		}
+		if(twice_area<0){
+			std::reverse(x.begin(), x.end()); 
+			std::reverse(y.begin(), y.end()); 
+		}
+	}
 
-	
-		for(auto unbounded_face_itr=vd.unbounded_faces_begin(); unbounded_face_itr!=vd.unbounded_faces_end(); unbounded_face_itr ++){
-			std::vector<Point> points_in_face;
-			Voronoi_diagram::Ccb_halfedge_circulator ec_start=(unbounded_face_itr)->ccb(); 
-			Voronoi_diagram::Ccb_halfedge_circulator ec=ec_start; 
-			do{
-				if(ec->is_segment()){
-					points_in_face.push_back(ec-> source()->point());
+	static cvt_domain box(double x_min, double x_max, double y_min, double y_max){
+		return cvt_domain({Point(x_min,y_min), Point(x_max,y_min), Point(x_max,y_max), Point(x_min,y_max)}); 
+	}
+}; 
+
+// Scratch polygon for clipping, kept as separate coordinate arrays
+struct cvt_polygon{
+	std::vector<double> x, y; 
+
+	void clear(){ x.clear(); y.clear(); }
+	size_t size() const { return x.size(); }
+	void push_back(double px, double py){ x.push_back(px); y.push_back(py); }
+}; 
+
+/* Sutherland-Hodgman step: keeps the part of in where a*x+b*y <= c */
+inline void clip_halfplane(const cvt_polygon &in, double a, double b, double c, cvt_polygon &out){
+	out.clear(); 
+	const size_t n=in.size(); 
+	for(size_t i=0; i<n; i++){
+		const size_t j=(i+1)%n; 
+		const double fi=a*in.x[i]+b*in.y[i]-c; 
+		const double fj=a*in.x[j]+b*in.y[j]-c; 
+		if(fi<=0){
+			out.push_back(in.x[i], in.y[i]); 
+		}
+		if((fi<0 && fj>0) || (fi>0 && fj<0)){
+			const double t=fi/(fi-fj); 
+			out.push_back(in.x[i]+t*(in.x[j]-in.x[i]), in.y[i]+t*(in.y[j]-in.y[i])); 
+		}
+	}
+}
+
+/* Voronoi cell of site (px, py) within the domain: the domain clipped by the bisector with each of the
+ * neighbors (qx[k], qy[k]). Uses cell and scratch as buffers; the result is left in cell */
+inline void clipped_voronoi_cell(double px, double py, const std::vector<double> &qx, const std::vector<double> &qy,
+				  const cvt_domain &domain, cvt_polygon &cell, cvt_polygon &scratch){
+	cell.x=domain.x; 
+	cell.y=domain.y; 
+	for(size_t k=0; k<qx.size() && cell.size()>0; k++){
+		// |x-p|^2 <= |x-q|^2, written relative to p to keep the constant small
+		const double a=qx[k]-px, b=qy[k]-py; 
+		const double c=a*px+b*py+0.5*(a*a+b*b); 
+		clip_halfplane(cell, a, b, c, scratch); 
+		std::swap(cell, scratch); 
+	}
+}
+
+// Mass properties of a cell with respect to its site
+struct cvt_cell_moments{
+	double area; 
+	double centroid[2]; 
+	// \int_cell |x - site|^2
+	double energy; 
+}; 
+
+/* Area, centroid and second moment about the site of a counterclockwise polygon, by summing the signed
+ * triangles (site, v_i, v_{i+1}) */
+inline cvt_cell_moments polygon_moments(const cvt_polygon &cell, double px, double py){
+	cvt_cell_moments m={0, {px, py}, 0}; 
+	double mx=0, my=0; 
+	const size_t n=cell.size(); 
+	for(size_t i=0; i<n; i++){
+		const size_t j=(i+1)%n; 
+		const double xi=cell.x[i]-px, yi=cell.y[i]-py; 
+		const double xj=cell.x[j]-px, yj=cell.y[j]-py; 
+		const double cross=xi*yj-xj*yi; 
+		m.area+=cross; 
+		mx+=cross*(xi+xj); 
+		my+=cross*(yi+yj); 
+		m.energy+=cross*(xi*xi+xi*xj+xj*xj+yi*yi+yi*yj+yj*yj); 
+	}
+	m.area*=0.5; 
+	m.energy/=12.0; 
+	if(m.area>0){
+		m.centroid[0]=px+mx/(6*m.area); 
+		m.centroid[1]=py+my/(6*m.area); 
+	}
+	return m; 
+}
+
+// Constant density, the moments of polygon_moments. Other densities (cvt_density.hpp) provide the same
+// moments function, with area the mass of the cell and centroid its center of mass
+struct uniform_density{
+	cvt_cell_moments moments(const cvt_polygon &cell, double px, double py) const { return polygon_moments(cell, px, py); }
+}; 
+
+struct cvt_params{
+	int max_iterations=100; 
+	// stop when an iteration lowers the energy by less than this fraction
+	double energy_tolerance=1e-9; 
+	// stop when no site moves further than this
+	double displacement_tolerance=0; 
+	// if set, the state is handed to it whenever it is due
+	checkpoint_writer *checkpoints=nullptr; 
+	// if set, the run carries on from here. The sites must already be at its points, e.g. by restore_triangulation
+	const checkpoint *resume=nullptr; 
+}; 
+
+struct cvt_result{
+	int iterations; 
+	// CVT energy of the sites before the last move
+	double energy; 
+	double max_displacement; 
+}; 
+
+/* Clipped Voronoi cells of every finite vertex of dt, in the order of sites. The work is split over
+ * threads; dt is only read */
+template<typename Density>
+void cvt_cell_moments_all(const DT &dt, const std::vector<DT::Vertex_handle> &sites, const cvt_domain &domain,
+			  const Density &density, std::vector<cvt_cell_moments> &moments){
+	moments.resize(sites.size()); 
+	parallel_for(sites.size(), [&](int, size_t begin, size_t end){
+		std::vector<double> qx, qy; 
+		cvt_polygon cell, scratch; 
+		for(size_t i=begin; i<end; i++){
+			const DT::Vertex_handle v=sites[i]; 
+			const double px=CGAL::to_double(v->point().x()), py=CGAL::to_double(v->point().y()); 
+			qx.clear(); 
+			qy.clear(); 
+			if(dt.dimension()==2){
+				DT::Vertex_circulator vc=dt.incident_vertices(v), done(vc); 
+				do{
+					if(!dt.is_infinite(vc)){
+						qx.push_back(CGAL::to_double(vc->point().x())); 
+						qy.push_back(CGAL::to_double(vc->point().y())); 
+					}
+				}while(++vc!=done); 
+			}else{
+				// no stars to walk, so clip against everything
+				for(const DT::Vertex_handle &u: sites){
+					if(u!=v){
+						qx.push_back(CGAL::to_double(u->point().x())); 
+						qy.push_back(CGAL::to_double(u->point().y())); 
+					}
 				}
-				
-			}while(++ec!=ec_start);
+			}
+			clipped_voronoi_cell(px, py, qx, qy, domain, cell, scratch); 
+			moments[i]=density.moments(cell, px, py); 
 		}
-	CVT_iterations--;
-	std::cout <<"num bouned faces: " << num_bounded_faces <<std::endl; 
+	}, 1024); 
+}
+
+/* Lloyd's iterations on the vertices of dt, moving each site to the centroid of its Voronoi cell clipped
+ * to the domain, with respect to the density. Sites are moved in place with DT::move_if_no_collision, so
+ * the triangulation is only repaired locally. Sites whose cell is empty (outside the domain, or where
+ * the density vanishes) stay put */
+template<typename Density=uniform_density>
+cvt_result lloyd_iterate(DT &dt, const cvt_domain &domain, const cvt_params &params=cvt_params(),
+			 const Density &density=Density()){
+	cvt_result result={0, 0, 0}; 
+	std::vector<DT::Vertex_handle> sites; 
+	std::vector<cvt_cell_moments> moments; 
+	double previous_energy=std::numeric_limits<double>::infinity(); 
+	if(params.resume!=nullptr && params.resume->solver=="lloyd" && !params.resume->scalars.empty()){
+		result.iterations=params.resume->iteration; 
+		previous_energy=params.resume->scalars[0]; 
+	}
+
+	for(; result.iterations<params.max_iterations; result.iterations++){
+		if(params.checkpoints!=nullptr && params.checkpoints->due()){
+			checkpoint c; 
+			c.solver="lloyd"; 
+			c.iteration=result.iterations; 
+			c.points=checkpoint_points(dt); 
+			c.scalars.push_back(previous_energy); 
+			params.checkpoints->submit(std::move(c)); 
+		}
+		sites.clear(); 
+		for(auto v_itr=dt.finite_vertices_begin(); v_itr!=dt.finite_vertices_end(); v_itr++){
+			sites.push_back(v_itr); 
+		}
+		cvt_cell_moments_all(dt, sites, domain, density, moments); 
+
+		const double energy=parallel_sum(moments.size(), [&](size_t i){ return moments[i].energy; }); 
+		result.energy=energy; 
+		if(previous_energy-energy<params.energy_tolerance*energy){
+			break; 
+		}
+		previous_energy=energy; 
+
+		result.max_displacement=0; 
+		for(size_t i=0; i<sites.size(); i++){
+			if(moments[i].area<=0){
+				continue; 
+			}
+			const Point p=sites[i]->point(); 
+			const double dx=moments[i].centroid[0]-CGAL::to_double(p.x()); 
+			const double dy=moments[i].centroid[1]-CGAL::to_double(p.y()); 
+			result.max_displacement=std::max(result.max_displacement, std::sqrt(dx*dx+dy*dy)); 
+			dt.move_if_no_collision(sites[i], Point(moments[i].centroid[0], moments[i].centroid[1])); 
+		}
+		log_iteration({"lloyd", result.iterations, energy, 0, 1, result.max_displacement}); 
+		if(result.max_displacement<=params.displacement_tolerance){
+			result.iterations++; 
+			break; 
+		}
+	}
+	return result; 
+}
+
+/* Face kernel for the CVT energy restricted to the triangulated region. Each face splits into the kites
+ * (x_i, midpoint of x_i x_j, circumcenter, midpoint of x_k x_i) of its vertices, which are the pieces of
+ * the Voronoi cells inside the face. The gradient is 2 m (x_i - c) of each kite, holding the kites fixed:
+ * the terms from moving kite boundaries cancel between neighboring kites, since they lie on bisectors,
+ * so summed over the faces around a vertex this is the exact CVT gradient. Weights are ignored */
+struct cvt_kite_kernel{
+	double operator()(const double x[3][2], const double w[3], double grad_x[3][2], double grad_w[3]) const {
+		double energy=0; 
+		const double r1x=x[1][0]-x[0][0], r1y=x[1][1]-x[0][1]; 
+		const double r2x=x[2][0]-x[0][0], r2y=x[2][1]-x[0][1]; 
+		const double det=r1x*r2y-r1y*r2x; 
+		for(int v=0; v<3; v++){
+			grad_x[v][0]=grad_x[v][1]=0; 
+			grad_w[v]=0; 
+		}
+		if(det==0){
+			return 0; 
+		}
+		// circumcenter relative to x0
+		const double b1=0.5*(r1x*r1x+r1y*r1y), b2=0.5*(r2x*r2x+r2y*r2y); 
+		const double ux=(b1*r2y-b2*r1y)/det, uy=(b2*r1x-b1*r2x)/det; 
+		const double cx=x[0][0]+ux, cy=x[0][1]+uy; 
+		// signed areas below are positive for counterclockwise faces
+		const double orientation=det>0 ? 1.0 : -1.0; 
+		for(int i=0; i<3; i++){
+			const int j=(i+1)%3, k=(i+2)%3; 
+			// kite corners relative to x_i, counterclockwise for a counterclockwise face
+			const double corner[3][2]={
+				{0.5*(x[j][0]-x[i][0]), 0.5*(x[j][1]-x[i][1])}, 
+				{cx-x[i][0], cy-x[i][1]}, 
+				{0.5*(x[k][0]-x[i][0]), 0.5*(x[k][1]-x[i][1])}}; 
+			double area=0, mx=0, my=0; 
+			for(int t=0; t<2; t++){
+				const double *a=corner[t], *b=corner[t+1]; 
+				const double cross=orientation*(a[0]*b[1]-a[1]*b[0]); 
+				area+=cross/2; 
+				mx+=cross*(a[0]+b[0])/6; 
+				my+=cross*(a[1]+b[1])/6; 
+				energy+=cross*(a[0]*a[0]+a[0]*b[0]+b[0]*b[0]+a[1]*a[1]+a[1]*b[1]+b[1]*b[1])/12; 
+			}
+			// 2 \int_kite (x_i - x) = -2 (first moment relative to x_i)
+			grad_x[i][0]=-2*mx; 
+			grad_x[i][1]=-2*my; 
+		}
+		return energy; 
+	}
+}; 
+
+// CVT_iterations of Lloyd's algorithm in the box, returning the final sites. With a resume checkpoint the
+// sites are rebuilt from it and points is ignored
+std::vector<Point> lloyds_CVT(std::vector<Point> points, int CVT_iterations, double x_min, double x_max, double y_min, double y_max, 
+			      checkpoint_writer *checkpoints=nullptr, const checkpoint *resume=nullptr){
+	DT dt; 
+	if(resume!=nullptr){
+		restore_triangulation(dt, *resume); 
+	}else{
+		dt.insert(points.begin(), points.end()); 
+	}
+
+	cvt_params params; 
+	params.max_iterations=CVT_iterations; 
+	params.energy_tolerance=-std::numeric_limits<double>::infinity(); 
+	params.displacement_tolerance=-1; 
+	params.checkpoints=checkpoints; 
+	params.resume=resume; 
+	lloyd_iterate(dt, cvt_domain::box(x_min, x_max, y_min, y_max), params); 
+
+	std::vector<Point> new_sites; 
+	for(auto v_itr=dt.finite_vertices_begin(); v_itr!=dt.finite_vertices_end(); v_itr++){
+		new_sites.push_back(v_itr->point()); 
 	}
-	
-	
 	return new_sites; 
 }
 
 RegT build_reg_triangulation(std::vector<Point> points,  int CVT_iterations, double x_min, double x_max, double y_min, double y_max ){
 
-	if(CVT_iterations >0) std::vector<Point> updated_sties=lloyds_CVT(points, CVT_iterations, x_min,  x_max,  y_min,  y_max); 
+	if(CVT_iterations >0) points=lloyds_CVT(points, CVT_iterations, x_min,  x_max,  y_min,  y_max); 
 
 	RegT rt;
 
@@ -0,0 +1,226 @@
+#ifndef _MULTILEVEL_HOT_HPP_
+#define _MULTILEVEL_HOT_HPP_
+
+#include <utility>
+#include <vector>
+
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+
+#include "HotOptimizedMesh.hpp"
+#include "log.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  COARSE TO FINE HOT OPTIMIZATION /////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// A gradient step moves each vertex about as far as its neighbours allow, so
+// on a large mesh a smooth error takes many iterations to spread out. Here the
+// mesh is decimated into a hierarchy of coarser meshes, the coarsest is
+// optimized, and the result is carried back to the finer levels: each removed
+// vertex returns at its barycentric coordinates in the coarse face that held
+// it, and a few iterations on each level smooth what the coarse mesh missed.
+
+// Delaunay triangulation with the index of each vertex in the fine mesh
+using Level_Gt = DT::Geom_traits;
+using Level_DT = CGAL::Delaunay_triangulation_2<
+    Level_Gt, CGAL::Triangulation_data_structure_2<
+                  CGAL::Triangulation_vertex_base_with_info_2<int, Level_Gt>>>;
+
+struct multilevel_params {
+  // stop coarsening once a level has at most this many free vertices
+  int coarsest_free_vertices = 1000;
+  // 0 for no cap. A level keeps about 3/4 of the free vertices, so a mesh
+  // with n free vertices takes about log(n / coarsest) / log(4 / 3) levels,
+  // over 30 for a million vertices
+  int max_levels = 0;
+  // for the coarsest level, or the whole mesh if it is already that coarse
+  mesh_optimize_params coarse;
+  // for each finer level, after prolongation
+  mesh_optimize_params smooth;
+
+  multilevel_params() { smooth.max_iterations = 10; }
+};
+
+struct multilevel_result {
+  int levels;
+  // summed over the levels
+  int iterations;
+  double energy;
+};
+
+/* A vertex removed from a level, and the face of the next coarser level, by
+ * fine index, in which it lies */
+struct prolongation {
+  int vertex;
+  int face[3];
+  double weight[3];
+};
+
+/* Removes a greedy independent set of the free vertices of dt, so that each
+ * remaining face of the new level covers a few removed vertices, and records
+ * the barycentric coordinates of each removed vertex in the new level. Hull
+ * vertices stay, so the hull is the same on every level and each removed
+ * vertex lands in a finite face. mark has an entry per fine vertex, all 0 */
+inline void coarsen_level(Level_DT &dt, std::vector<char> &mark,
+                          std::vector<prolongation> &removed) {
+  std::vector<Level_DT::Vertex_handle> chosen;
+  for (auto v_itr = dt.finite_vertices_begin();
+       v_itr != dt.finite_vertices_end(); v_itr++) {
+    if (mark[v_itr->info()] || is_hull_vertex(dt, v_itr)) {
+      continue;
+    }
+    chosen.push_back(v_itr);
+    mark[v_itr->info()] = 1;
+    auto vc = dt.incident_vertices(v_itr), done(vc);
+    do {
+      if (!dt.is_infinite(vc)) {
+        mark[vc->info()] = 1;
+      }
+    } while (++vc != done);
+  }
+  for (auto v_itr = dt.finite_vertices_begin();
+       v_itr != dt.finite_vertices_end(); v_itr++) {
+    mark[v_itr->info()] = 0;
+  }
+
+  std::vector<std::pair<Level_DT::Point, int>> points;
+  points.reserve(chosen.size());
+  for (const Level_DT::Vertex_handle &v : chosen) {
+    points.push_back(std::make_pair(v->point(), v->info()));
+    dt.remove(v);
+  }
+
+  removed.resize(points.size());
+  Level_DT::Face_handle hint;
+  for (size_t i = 0; i < points.size(); i++) {
+    prolongation &r = removed[i];
+    r.vertex = points[i].second;
+    const Level_DT::Face_handle f = dt.locate(points[i].first, hint);
+    if (dt.is_infinite(f)) {
+      // only from rounding on the hull: snap to the nearest vertex
+      const int nearest = dt.nearest_vertex(points[i].first)->info();
+      for (int k = 0; k < 3; k++) {
+        r.face[k] = nearest;
+        r.weight[k] = 1.0 / 3;
+      }
+      continue;
+    }
+    hint = f;
+    const double px = CGAL::to_double(points[i].first.x());
+    const double py = CGAL::to_double(points[i].first.y());
+    double x[3], y[3];
+    for (int k = 0; k < 3; k++) {
+      r.face[k] = f->vertex(k)->info();
+      x[k] = CGAL::to_double(f->vertex(k)->point().x());
+      y[k] = CGAL::to_double(f->vertex(k)->point().y());
+    }
+    const double area =
+        (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    for (int k = 0; k < 3; k++) {
+      const int a = (k + 1) % 3, b = (k + 2) % 3;
+      r.weight[k] =
+          ((x[a] - px) * (y[b] - py) - (x[b] - px) * (y[a] - py)) / area;
+    }
+  }
+}
+
+/* Optimizes the *star-HOT_2 energy of a DT or Indexed_DT in place, coarse to
+ * fine. The fine mesh keeps its vertex handles; only the last smoothing pass
+ * runs on it, the coarser levels run on copies */
+template <int star = 1, typename Mesh>
+multilevel_result
+multilevel_hot_optimize(Mesh &mesh,
+                        const multilevel_params &params = multilevel_params()) {
+  using traits = mesh_traits<Mesh>;
+  static_assert(!traits::weighted,
+                "weights are not carried between the levels");
+
+  std::vector<typename Mesh::Vertex_handle> handles;
+  std::vector<std::pair<Level_DT::Point, int>> points;
+  std::vector<char> hull;
+  int free = 0;
+  for (auto v_itr = mesh.finite_vertices_begin();
+       v_itr != mesh.finite_vertices_end(); v_itr++) {
+    double x[2], w;
+    traits::vertex_coordinates(v_itr, x, w);
+    points.push_back(
+        std::make_pair(Level_DT::Point(x[0], x[1]), int(handles.size())));
+    handles.push_back(v_itr);
+    hull.push_back(is_hull_vertex(mesh, v_itr));
+    free += !hull.back();
+  }
+  const int n = handles.size();
+
+  Level_DT dt;
+  dt.insert(points.begin(), points.end());
+  std::vector<std::vector<prolongation>> removed;
+  std::vector<char> mark(n, 0);
+  while (free > params.coarsest_free_vertices &&
+         (params.max_levels <= 0 ||
+          int(removed.size()) + 1 < params.max_levels)) {
+    removed.push_back(std::vector<prolongation>());
+    coarsen_level(dt, mark, removed.back());
+    if (removed.back().empty()) {
+      removed.pop_back();
+      break;
+    }
+    free -= removed.back().size();
+  }
+
+  multilevel_result result;
+  result.levels = removed.size() + 1;
+  result.iterations = 0;
+  if (removed.empty()) {
+    const mesh_optimize_result fine =
+        HotOptimizedMesh<Mesh, star>(mesh).optimize(params.coarse);
+    result.iterations = fine.iterations;
+    result.energy = fine.energy;
+    return result;
+  }
+
+  std::vector<double> position(2 * n);
+  for (int level = removed.size(); level > 0; level--) {
+    HotOptimizedMesh<Level_DT, star> coarse(dt);
+    const mesh_optimize_result r = coarse.optimize(
+        level == int(removed.size()) ? params.coarse : params.smooth);
+    result.iterations += r.iterations;
+    HOT_DEBUG("multilevel: level " << level << ", "
+                                   << dt.number_of_vertices()
+                                   << " vertices, energy " << r.energy);
+    for (auto v_itr = dt.finite_vertices_begin();
+         v_itr != dt.finite_vertices_end(); v_itr++) {
+      position[2 * v_itr->info()] = CGAL::to_double(v_itr->point().x());
+      position[2 * v_itr->info() + 1] = CGAL::to_double(v_itr->point().y());
+    }
+
+    points.clear();
+    for (const prolongation &p : removed[level - 1]) {
+      double x = 0, y = 0;
+      for (int k = 0; k < 3; k++) {
+        x += p.weight[k] * position[2 * p.face[k]];
+        y += p.weight[k] * position[2 * p.face[k] + 1];
+      }
+      position[2 * p.vertex] = x;
+      position[2 * p.vertex + 1] = y;
+      points.push_back(std::make_pair(Level_DT::Point(x, y), p.vertex));
+    }
+    if (level > 1) {
+      dt.insert(points.begin(), points.end());
+    }
+  }
+
+  // Every vertex has a position now; hull vertices never moved
+  for (int i = 0; i < n; i++) {
+    if (!hull[i]) {
+      handles[i] =
+          traits::move(mesh, handles[i], position[2 * i], position[2 * i + 1], 0);
+    }
+  }
+  const mesh_optimize_result fine =
+      HotOptimizedMesh<Mesh, star>(mesh).optimize(params.smooth);
+  result.iterations += fine.iterations;
+  result.energy = fine.energy;
+  return result;
+}
+
+#endif // _MULTILEVEL_HOT_HPP_
@@ -0,0 +1,543 @@
+#ifndef _PARTITIONED_HOT_HPP_
+#define _PARTITIONED_HOT_HPP_
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "multilevel_hot.hpp"
+
+// for posix_spawn, which unistd.h need not declare
+extern char **environ;
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  DOMAIN DECOMPOSED HOT OPTIMIZATION //////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// The free vertices are split into blocks by k-d cuts. Each round, every block
+// is triangulated together with a halo of ghost vertices, the rings around it,
+// and only its own vertices move. The blocks run in hot_block_worker processes
+// spawned up front and fed over socket pairs. This process keeps the positions
+// of all the vertices and a neighbor list for each; the lists start as the
+// edges of the input mesh, and each block sends back the neighbors of its own
+// vertices in its triangulation, where they are surrounded by ghosts. So no
+// global triangulation is built between rounds, and the input mesh is only
+// moved once, at the end.
+
+/* The triangulation of a block. Vertex info is the index into the block's
+ * coordinates, owned vertices first and then the ghosts */
+class Block_DT : public Level_DT {
+public:
+  explicit Block_DT(int owned) : owned(owned) {}
+
+  int owned;
+};
+
+/* As a Delaunay triangulation, but the ghosts are pinned */
+template <> struct mesh_traits<Block_DT> : mesh_traits<Level_DT> {
+  static bool is_free(const Block_DT &mesh, const Block_DT::Vertex_handle &v) {
+    return v->info() < mesh.owned;
+  }
+};
+
+struct partitioned_params {
+  // number of blocks, or 0 for one per worker
+  int blocks = 0;
+  // worker processes; with 0 the blocks are optimized in this process
+  int workers = 4;
+  // the worker executable; a bare name is looked for next to the running
+  // executable, then on the PATH
+  std::string worker = "hot_block_worker";
+  // how many rings of neighbors around a block are its ghosts
+  int halo_rings = 2;
+  int rounds = 10;
+  // for each block in each round
+  mesh_optimize_params block;
+
+  partitioned_params() { block.max_iterations = 10; }
+};
+
+struct partitioned_result {
+  int blocks;
+  int rounds;
+  double energy;
+};
+
+/* Assigns block[id] for the ids in [begin, end), splitting them into count
+ * blocks from first on. Each cut is across the wider side of the bounding
+ * box, at the quantile which leaves the blocks on either side equal sizes */
+inline void kd_partition(const std::vector<double> &position,
+                         std::vector<int> &ids, size_t begin, size_t end,
+                         int count, int first, std::vector<int> &block) {
+  if (count <= 1 || end - begin < 2) {
+    for (size_t i = begin; i < end; i++) {
+      block[ids[i]] = first;
+    }
+    return;
+  }
+  double lo[2] = {position[2 * ids[begin]], position[2 * ids[begin] + 1]};
+  double hi[2] = {lo[0], lo[1]};
+  for (size_t i = begin; i < end; i++) {
+    for (int c = 0; c < 2; c++) {
+      lo[c] = std::min(lo[c], position[2 * ids[i] + c]);
+      hi[c] = std::max(hi[c], position[2 * ids[i] + c]);
+    }
+  }
+  const int axis = hi[0] - lo[0] >= hi[1] - lo[1] ? 0 : 1;
+  const int left = count / 2;
+  const size_t mid = begin + (end - begin) * left / count;
+  std::nth_element(ids.begin() + begin, ids.begin() + mid, ids.begin() + end,
+                   [&](int a, int b) {
+                     return position[2 * a + axis] < position[2 * b + axis];
+                   });
+  kd_partition(position, ids, begin, mid, left, first, block);
+  kd_partition(position, ids, mid, end, count - left, first + left, block);
+}
+
+/* The owned vertices of a block followed by its ghosts, the other vertices
+ * within rings edges of them in neighbors, ring by ring. linked gets the
+ * number of leading vertices whose neighbors are all in the block: the
+ * owned ones and the ghosts short of the last ring. stamp marks the ids
+ * already taken; mark must differ between calls */
+inline std::vector<int>
+block_vertices(const std::vector<std::vector<int>> &neighbors,
+               const std::vector<int> &owned, int rings,
+               std::vector<int> &stamp, int mark, int &linked) {
+  std::vector<int> local(owned);
+  for (int id : owned) {
+    stamp[id] = mark;
+  }
+  linked = owned.size();
+  size_t ring_begin = 0;
+  for (int ring = 0; ring < rings; ring++) {
+    linked = local.size();
+    const size_t ring_end = local.size();
+    for (size_t i = ring_begin; i < ring_end; i++) {
+      for (int id : neighbors[local[i]]) {
+        if (stamp[id] != mark) {
+          stamp[id] = mark;
+          local.push_back(id);
+        }
+      }
+    }
+    ring_begin = ring_end;
+  }
+  return local;
+}
+
+/* Optimizes the first owned of the vertices in coords, two coordinates per
+ * vertex, with the rest pinned, and writes their new positions back. links
+ * gets, for each of the first linked vertices (at least the owned ones),
+ * its number of neighbors in the block triangulation followed by their
+ * indices in coords (none if the vertex was merged into another) */
+template <int star>
+void optimize_block(std::vector<double> &coords, int owned, int linked,
+                    const mesh_optimize_params &params,
+                    std::vector<std::int32_t> &links) {
+  std::vector<std::pair<Level_DT::Point, int>> points;
+  points.reserve(coords.size() / 2);
+  for (size_t i = 0; i < coords.size() / 2; i++) {
+    points.push_back(
+        std::make_pair(Level_DT::Point(coords[2 * i], coords[2 * i + 1]), i));
+  }
+  Block_DT dt(owned);
+  dt.insert(points.begin(), points.end());
+  HotOptimizedMesh<Block_DT, star>(dt).optimize(params);
+  std::vector<Block_DT::Vertex_handle> vertex(linked);
+  for (auto v_itr = dt.finite_vertices_begin();
+       v_itr != dt.finite_vertices_end(); v_itr++) {
+    if (v_itr->info() < owned) {
+      coords[2 * v_itr->info()] = CGAL::to_double(v_itr->point().x());
+      coords[2 * v_itr->info() + 1] = CGAL::to_double(v_itr->point().y());
+    }
+    if (v_itr->info() < linked) {
+      vertex[v_itr->info()] = v_itr;
+    }
+  }
+  links.clear();
+  for (int i = 0; i < linked; i++) {
+    const size_t degree = links.size();
+    links.push_back(0);
+    if (vertex[i] != Block_DT::Vertex_handle()) {
+      auto vc = dt.incident_vertices(vertex[i]), done(vc);
+      do {
+        if (!dt.is_infinite(vc)) {
+          links.push_back(vc->info());
+        }
+      } while (++vc != done);
+    }
+    links[degree] = links.size() - degree - 1;
+  }
+}
+
+/* optimize_block for a star known only at run time, false if it's not one
+ * the workers are built for */
+inline bool optimize_block(int star, std::vector<double> &coords, int owned,
+                           int linked, const mesh_optimize_params &params,
+                           std::vector<std::int32_t> &links) {
+  switch (star) {
+  case 0:
+    optimize_block<0>(coords, owned, linked, params, links);
+    return true;
+  case 1:
+    optimize_block<1>(coords, owned, linked, params, links);
+    return true;
+  case 2:
+    optimize_block<2>(coords, owned, linked, params, links);
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* Whether links, from a worker, is laid out as optimize_block makes it for
+ * linked vertices out of total */
+inline bool valid_links(const std::vector<std::int32_t> &links, int linked,
+                        int total) {
+  size_t l = 0;
+  for (int i = 0; i < linked; i++) {
+    if (l >= links.size() || links[l] < 0 ||
+        size_t(links[l]) > links.size() - l - 1) {
+      return false;
+    }
+    const size_t end = l + 1 + links[l];
+    for (l++; l < end; l++) {
+      if (links[l] < 0 || links[l] >= total) {
+        return false;
+      }
+    }
+  }
+  return l == links.size();
+}
+
+/* Replaces the neighbors of the linked vertices of a block, the first ones
+ * of local, with those in links, and updates the other end of each link
+ * which came or went, so the lists of the vertices past them stay
+ * symmetric. A vertex with no neighbors in the block was merged into
+ * another one, and keeps the ones it had */
+inline void update_neighbors(const std::vector<int> &local, int linked,
+                             const std::vector<std::int32_t> &links,
+                             std::vector<std::vector<int>> &neighbors) {
+  std::vector<int> adjacent;
+  size_t l = 0;
+  for (int i = 0; i < linked; i++) {
+    const int degree = links[l++];
+    if (degree == 0) {
+      continue;
+    }
+    const int id = local[i];
+    adjacent.clear();
+    for (int k = 0; k < degree; k++) {
+      adjacent.push_back(local[links[l++]]);
+    }
+    std::vector<int> &old = neighbors[id];
+    for (int other : old) {
+      if (std::find(adjacent.begin(), adjacent.end(), other) ==
+          adjacent.end()) {
+        std::vector<int> &back = neighbors[other];
+        back.erase(std::remove(back.begin(), back.end(), id), back.end());
+      }
+    }
+    for (int other : adjacent) {
+      std::vector<int> &back = neighbors[other];
+      if (std::find(back.begin(), back.end(), id) == back.end()) {
+        back.push_back(id);
+      }
+    }
+    old.swap(adjacent);
+  }
+}
+
+inline bool socket_write_all(int fd, const void *data, size_t size) {
+  const char *c = static_cast<const char *>(data);
+  while (size > 0) {
+    // MSG_NOSIGNAL: a dead worker is an error here, not a SIGPIPE
+    const ssize_t n = ::send(fd, c, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    c += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool socket_read_all(int fd, void *data, size_t size) {
+  char *c = static_cast<char *>(data);
+  while (size > 0) {
+    const ssize_t n = ::read(fd, c, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    c += n;
+    size -= n;
+  }
+  return true;
+}
+
+/* The block protocol. A request is the star and the vertex counts (owned,
+ * linked, total), the optimizer parameters and the coordinates; the reply
+ * is the coordinates of the owned vertices, then the number of links and
+ * the links from optimize_block. Serves the requests on fd until it is
+ * closed; this is the main loop of hot_block_worker */
+inline void serve_blocks(int fd) {
+  std::uint64_t header[4];
+  mesh_optimize_params params;
+  std::vector<double> coords;
+  std::vector<std::int32_t> links;
+  while (socket_read_all(fd, header, sizeof(header)) &&
+         socket_read_all(fd, &params, sizeof(params))) {
+    if (header[1] > header[2] || header[2] > header[3]) {
+      break;
+    }
+    coords.resize(2 * header[3]);
+    if (!socket_read_all(fd, coords.data(), coords.size() * sizeof(double))) {
+      break;
+    }
+    if (!optimize_block(header[0], coords, header[1], header[2], params,
+                        links)) {
+      HOT_WARN("hot_block_worker: no *" << header[0] << "-HOT_2 energy");
+      break;
+    }
+    const std::uint64_t count = links.size();
+    if (!socket_write_all(fd, coords.data(), 2 * header[1] * sizeof(double)) ||
+        !socket_write_all(fd, &count, sizeof(count)) ||
+        !socket_write_all(fd, links.data(), count * sizeof(std::int32_t))) {
+      break;
+    }
+  }
+  ::close(fd);
+}
+
+/* Where to run worker from: as given if it has a slash, else next to the
+ * running executable if it's there (Linux), else worker itself, to be
+ * found on the PATH */
+inline std::string block_worker_path(const std::string &worker) {
+  if (worker.find('/') != std::string::npos) {
+    return worker;
+  }
+  char self[PATH_MAX];
+  const ssize_t size = ::readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (size > 0) {
+    std::string path(self, size);
+    path = path.substr(0, path.rfind('/') + 1) + worker;
+    if (::access(path.c_str(), X_OK) == 0) {
+      return path;
+    }
+  }
+  return worker;
+}
+
+/* Worker processes, each a separate hot_block_worker executable serving on
+ * its standard input, which is one end of a socket pair. They are started
+ * with posix_spawn rather than fork, which is safe with threads running (a
+ * forked child of a threaded process may only make async-signal-safe
+ * calls). A worker exits when its socket is closed */
+class block_workers {
+public:
+  block_workers(const std::string &worker, int count) {
+    const std::string path = block_worker_path(worker);
+    char *argv[] = {const_cast<char *>(path.c_str()), nullptr};
+    for (int w = 0; w < count; w++) {
+      int fds[2];
+      if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        HOT_WARN("can't create a socket pair, " << w << " workers started");
+        return;
+      }
+      // neither end may leak into the other workers; dup2 clears the flag
+      // on the worker's standard input
+      ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+      ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+      posix_spawn_file_actions_t actions;
+      ::posix_spawn_file_actions_init(&actions);
+      ::posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+      pid_t pid;
+      const int error =
+          path.find('/') != std::string::npos
+              ? ::posix_spawn(&pid, path.c_str(), &actions, nullptr, argv,
+                              environ)
+              : ::posix_spawnp(&pid, path.c_str(), &actions, nullptr, argv,
+                               environ);
+      ::posix_spawn_file_actions_destroy(&actions);
+      ::close(fds[1]);
+      if (error != 0) {
+        HOT_WARN("can't start " << path << ", " << w << " workers started");
+        ::close(fds[0]);
+        return;
+      }
+      sockets_.push_back(fds[0]);
+      pids_.push_back(pid);
+    }
+  }
+
+  block_workers(const block_workers &) = delete;
+  block_workers &operator=(const block_workers &) = delete;
+
+  ~block_workers() {
+    for (int fd : sockets_) {
+      ::close(fd);
+    }
+    for (pid_t pid : pids_) {
+      ::waitpid(pid, nullptr, 0);
+    }
+  }
+
+  int size() const { return sockets_.size(); }
+
+  bool send(int worker, int star, const std::vector<double> &coords,
+            int owned, int linked, const mesh_optimize_params &params) {
+    const std::uint64_t header[4] = {std::uint64_t(star), std::uint64_t(owned),
+                                     std::uint64_t(linked),
+                                     std::uint64_t(coords.size() / 2)};
+    return socket_write_all(sockets_[worker], header, sizeof(header)) &&
+           socket_write_all(sockets_[worker], &params, sizeof(params)) &&
+           socket_write_all(sockets_[worker], coords.data(),
+                            coords.size() * sizeof(double));
+  }
+
+  bool receive(int worker, std::vector<double> &coords, int owned,
+               int linked, std::vector<std::int32_t> &links) {
+    std::uint64_t count;
+    if (!socket_read_all(sockets_[worker], coords.data(),
+                         2 * owned * sizeof(double)) ||
+        !socket_read_all(sockets_[worker], &count, sizeof(count)) ||
+        count > std::uint64_t(linked) * (coords.size() / 2 + 1)) {
+      return false;
+    }
+    links.resize(count);
+    return socket_read_all(sockets_[worker], links.data(),
+                           count * sizeof(std::int32_t)) &&
+           valid_links(links, linked, coords.size() / 2);
+  }
+
+private:
+  std::vector<int> sockets_;
+  std::vector<pid_t> pids_;
+};
+
+/* Optimizes the *star-HOT_2 energy of a DT or Indexed_DT in place, block by
+ * block. The worker processes are started on entry and reaped on return; a
+ * block whose worker fails, or every block if none could be started, is
+ * optimized in this process instead */
+template <int star = 1, typename Mesh>
+partitioned_result
+partitioned_hot_optimize(Mesh &mesh,
+                         const partitioned_params &params = partitioned_params()) {
+  using traits = mesh_traits<Mesh>;
+  static_assert(!traits::weighted, "ghost weights are not exchanged");
+
+  std::vector<typename Mesh::Vertex_handle> handles;
+  std::map<typename Mesh::Vertex_handle, int> ids;
+  std::vector<double> position;
+  std::vector<int> free;
+  for (auto v_itr = mesh.finite_vertices_begin();
+       v_itr != mesh.finite_vertices_end(); v_itr++) {
+    double x[2], w;
+    traits::vertex_coordinates(v_itr, x, w);
+    if (!is_hull_vertex(mesh, v_itr)) {
+      free.push_back(handles.size());
+    }
+    ids[v_itr] = handles.size();
+    handles.push_back(v_itr);
+    position.push_back(x[0]);
+    position.push_back(x[1]);
+  }
+  const int n = handles.size();
+  std::vector<std::vector<int>> neighbors(n);
+  for (int id = 0; id < n; id++) {
+    auto vc = mesh.incident_vertices(handles[id]), done(vc);
+    do {
+      if (!mesh.is_infinite(vc)) {
+        neighbors[id].push_back(ids[vc]);
+      }
+    } while (++vc != done);
+  }
+
+  partitioned_result result;
+  result.blocks = params.blocks > 0 ? params.blocks
+                                    : std::max(1, params.workers);
+  result.blocks = std::max(1, std::min<int>(result.blocks, free.size()));
+  result.rounds = 0;
+  std::vector<int> block(n, -1);
+  kd_partition(position, free, 0, free.size(), result.blocks, 0, block);
+  std::vector<std::vector<int>> owned(result.blocks);
+  for (int id : free) {
+    owned[block[id]].push_back(id);
+  }
+
+  block_workers workers(params.worker, std::max(0, params.workers));
+  const int batch = std::max(1, workers.size());
+  std::vector<int> stamp(n, -1);
+  std::vector<std::vector<double>> coords(batch);
+  std::vector<std::vector<std::int32_t>> links(batch);
+  for (; result.rounds < params.rounds && !free.empty(); result.rounds++) {
+    // A batch of blocks goes out, one per worker, before any reply is read.
+    // Later batches see the positions and neighbors the earlier ones left
+    for (int first = 0; first < result.blocks; first += batch) {
+      const int count = std::min(batch, result.blocks - first);
+      std::vector<std::vector<int>> local(count);
+      std::vector<int> linked(count);
+      std::vector<char> sent(count, 0);
+      for (int k = 0; k < count; k++) {
+        const int b = first + k;
+        local[k] = block_vertices(neighbors, owned[b], params.halo_rings,
+                                  stamp, result.rounds * result.blocks + b,
+                                  linked[k]);
+        coords[k].resize(2 * local[k].size());
+        for (size_t i = 0; i < local[k].size(); i++) {
+          coords[k][2 * i] = position[2 * local[k][i]];
+          coords[k][2 * i + 1] = position[2 * local[k][i] + 1];
+        }
+        sent[k] = workers.size() > 0 &&
+                  workers.send(k, star, coords[k], owned[b].size(),
+                               linked[k], params.block);
+      }
+      for (int k = 0; k < count; k++) {
+        const int b = first + k;
+        if (!sent[k] ||
+            !workers.receive(k, coords[k], owned[b].size(), linked[k],
+                             links[k])) {
+          if (workers.size() > 0) {
+            HOT_WARN("worker " << k << " failed, optimizing block " << b
+                               << " here");
+          }
+          optimize_block<star>(coords[k], owned[b].size(), linked[k],
+                               params.block, links[k]);
+        }
+        for (size_t i = 0; i < owned[b].size(); i++) {
+          position[2 * owned[b][i]] = coords[k][2 * i];
+          position[2 * owned[b][i] + 1] = coords[k][2 * i + 1];
+        }
+        update_neighbors(local[k], linked[k], links[k], neighbors);
+      }
+    }
+    HOT_DEBUG("partitioned: round " << result.rounds << " done");
+  }
+
+  for (int id : free) {
+    handles[id] =
+        traits::move(mesh, handles[id], position[2 * id], position[2 * id + 1], 0);
+  }
+  result.energy = HotOptimizedMesh<Mesh, star>(mesh).energy();
+  return result;
+}
+
+#endif // _PARTITIONED_HOT_HPP_
@@ -0,0 +1,193 @@
+#ifndef _SPARSE_NEWTON_HPP_
+#define _SPARSE_NEWTON_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "parallel.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  SPARSE HESSIANS AND TRUST REGION STEPS //////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+// A mesh energy couples each vertex only with its 1-ring, so its Hessian is
+// assembled into compressed sparse rows and Newton steps are solved with
+// a Jacobi preconditioned conjugate gradient, with no external solver.
+
+/* Square sparse matrix in compressed sparse row form. The pattern is fixed
+ * by set_pattern, after which entries are accumulated with add */
+struct csr_matrix {
+  int rows = 0;
+  std::vector<int> row_start;
+  std::vector<int> columns;
+  std::vector<double> values;
+
+  /* Builds the pattern from (row, column) pairs, which may repeat, and
+   * zeroes the values. entries is sorted in place */
+  void set_pattern(int num_rows, std::vector<std::pair<int, int>> &entries) {
+    rows = num_rows;
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    row_start.assign(rows + 1, 0);
+    columns.resize(entries.size());
+    for (size_t k = 0; k < entries.size(); k++) {
+      row_start[entries[k].first + 1]++;
+      columns[k] = entries[k].second;
+    }
+    for (int r = 0; r < rows; r++) {
+      row_start[r + 1] += row_start[r];
+    }
+    values.assign(entries.size(), 0.0);
+  }
+
+  // (row, column) must be in the pattern
+  void add(int row, int column, double value) {
+    const auto begin = columns.begin() + row_start[row];
+    const auto end = columns.begin() + row_start[row + 1];
+    values[std::lower_bound(begin, end, column) - columns.begin()] += value;
+  }
+
+  /* y = A x, rows split across threads */
+  void multiply(const std::vector<double> &x, std::vector<double> &y) const {
+    y.resize(rows);
+    parallel_for(rows, [&](int, std::size_t begin, std::size_t end) {
+      for (std::size_t r = begin; r < end; r++) {
+        double sum = 0.0;
+        for (int k = row_start[r]; k < row_start[r + 1]; k++) {
+          sum += values[k] * x[columns[k]];
+        }
+        y[r] = sum;
+      }
+    });
+  }
+
+  double diagonal(int row) const {
+    for (int k = row_start[row]; k < row_start[row + 1]; k++) {
+      if (columns[k] == row) {
+        return values[k];
+      }
+    }
+    return 0.0;
+  }
+};
+
+inline double sparse_dot(const std::vector<double> &a,
+                         const std::vector<double> &b) {
+  double sum = 0.0;
+  for (size_t i = 0; i < a.size(); i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+struct steihaug_result {
+  int iterations;
+  // the step was cut off at the trust region boundary
+  bool on_boundary;
+  // a direction of non-positive curvature was found
+  bool negative_curvature;
+};
+
+/* Approximately minimizes the model g.p + p.H p / 2 over |p|_M <= radius by
+ * Steihaug's truncated preconditioned CG, where M is the Jacobi
+ * preconditioner scaled to mean 1 and |p|_M^2 = p.M p. The CG iterates grow
+ * monotonically in that norm, so the first one to leave the region, or a
+ * direction of negative curvature, is followed to the boundary and the
+ * step stops there. With an infinite radius and positive definite H this is
+ * plain PCG for H p = -g. Stops once |H p + g| <= tolerance. p is always a
+ * descent direction unless g is zero */
+inline steihaug_result steihaug_cg(const csr_matrix &H,
+                                   const std::vector<double> &g,
+                                   double radius, double tolerance,
+                                   int max_iterations, std::vector<double> &p) {
+  const int n = H.rows;
+  steihaug_result result = {0, false, false};
+  p.assign(n, 0.0);
+
+  std::vector<double> m(n);
+  double mean = 0.0;
+  for (int i = 0; i < n; i++) {
+    m[i] = std::abs(H.diagonal(i));
+    mean += m[i];
+  }
+  mean = n > 0 && mean > 0 ? mean / n : 1.0;
+  for (int i = 0; i < n; i++) {
+    m[i] = m[i] > 1e-12 * mean ? m[i] / mean : 1.0;
+  }
+  auto m_dot = [&](const std::vector<double> &a, const std::vector<double> &b) {
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+      sum += m[i] * a[i] * b[i];
+    }
+    return sum;
+  };
+  // p + tau d on the boundary, with tau >= 0
+  auto to_boundary = [&](const std::vector<double> &d) {
+    const double a = m_dot(d, d), b = 2 * m_dot(p, d),
+                 c = m_dot(p, p) - radius * radius;
+    const double tau =
+        (-b + std::sqrt(std::max(0.0, b * b - 4 * a * c))) / (2 * a);
+    for (int i = 0; i < n; i++) {
+      p[i] += tau * d[i];
+    }
+    result.on_boundary = true;
+  };
+
+  std::vector<double> r(g), z(n), d(n), Hd(n);
+  if (std::sqrt(sparse_dot(r, r)) <= tolerance) {
+    return result;
+  }
+  for (int i = 0; i < n; i++) {
+    z[i] = r[i] / m[i];
+    d[i] = -z[i];
+  }
+  double rz = sparse_dot(r, z);
+  for (; result.iterations < max_iterations; result.iterations++) {
+    H.multiply(d, Hd);
+    const double curvature = sparse_dot(d, Hd);
+    if (curvature <= 0) {
+      result.negative_curvature = true;
+      if (std::isfinite(radius)) {
+        to_boundary(d);
+      } else if (result.iterations == 0) {
+        // p is still zero, so fall back to the preconditioned gradient
+        p = d;
+      }
+      result.iterations++;
+      break;
+    }
+    const double alpha = rz / curvature;
+    std::vector<double> next(p);
+    for (int i = 0; i < n; i++) {
+      next[i] += alpha * d[i];
+    }
+    if (m_dot(next, next) >= radius * radius) {
+      to_boundary(d);
+      result.iterations++;
+      break;
+    }
+    p.swap(next);
+    for (int i = 0; i < n; i++) {
+      r[i] += alpha * Hd[i];
+    }
+    if (std::sqrt(sparse_dot(r, r)) <= tolerance) {
+      result.iterations++;
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      z[i] = r[i] / m[i];
+    }
+    const double rz_next = sparse_dot(r, z);
+    const double beta = rz_next / rz;
+    rz = rz_next;
+    for (int i = 0; i < n; i++) {
+      d[i] = -z[i] + beta * d[i];
+    }
+  }
+  return result;
+}
+
+#endif // _SPARSE_NEWTON_HPP_
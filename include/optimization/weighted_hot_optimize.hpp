@@ -0,0 +1,56 @@
+#ifndef _WEIGHTED_HOT_OPTIMIZE_HPP_
+#define _WEIGHTED_HOT_OPTIMIZE_HPP_
+
+#include "OptimizedMesh.hpp"
+#include "analytic_energyWeights_Derv.hpp"
+#include "hot.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////
+/////////////  JOINT POSITION AND WEIGHT OPTIMIZATION OF A RegT ////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+/* A face kernel maps the raw coordinates and weights of a face to its
+ * energy, writing the gradient with respect to the positions and weights.
+ * weighted_hot_kernel is the *2-HOT energy of energy_weights */
+struct weighted_hot_kernel {
+  int star;
+
+  explicit weighted_hot_kernel(int star) : star(star) {}
+
+  double operator()(const double x[3][2], const double w[3],
+                    double grad_x[3][2], double grad_w[3]) const {
+    return triangle_energy_weights_grad(x, w, star, grad_x, grad_w);
+  }
+};
+
+/* weighted_optimize takes the OptimizedMesh parameters; optimize_positions
+ * and optimize_weights select what moves */
+using weighted_optimize_params = mesh_optimize_params;
+
+struct weighted_optimize_result {
+  int iterations;
+  double energy;
+  int hidden_vertices;
+};
+
+/* Gradient descent on the vertex positions and weights of rt together,
+ * with a backtracking line search; OptimizedMesh::optimize on rt with the
+ * kernel for its face energy. The triangulation is updated in place one
+ * vertex at a time, so connectivity changes (flips, vertices becoming
+ * hidden or reappearing) are handled incrementally by CGAL.
+ * FaceKernel is e.g. weighted_hot_kernel */
+template <typename FaceKernel>
+weighted_optimize_result
+weighted_optimize(RegT &rt, const FaceKernel &kernel,
+                  const weighted_optimize_params &params =
+                      weighted_optimize_params()) {
+  const mesh_optimize_result optimized =
+      KernelOptimizedMesh<RegT, FaceKernel>(rt, kernel).optimize(params);
+  weighted_optimize_result result;
+  result.iterations = optimized.iterations;
+  result.energy = optimized.energy;
+  result.hidden_vertices = rt.number_of_hidden_vertices();
+  return result;
+}
+
+#endif // _WEIGHTED_HOT_OPTIMIZE_HPP_
@@ -1,10 +1,12 @@
 // energy.cpp
 #include <fstream>
+#include <memory>
 
 #include "hot.hpp"
 #include "analytic_HOT_energy_Derv.hpp"
 #include "energyNOweights.hpp"
 #include "ply_writer.hpp"
+#include "result_sink.hpp"
 //#include <build_triangulation.hpp>
 
 void test_tri_w2() {
@@ -63,7 +65,7 @@ int main(int argc, char **argv) {
 	
 	energy_gradient(right_tri,2,2, vertex_iterator, gradient_v, false);
 
-	std::list<DT::Vertex_handle> internal_verts=internal_vertices(right_tri);
+	std::vector<DT::Vertex_handle> internal_verts=internal_vertices(right_tri);
 	compute_gradient<2>(right_tri, internal_verts); 
 
 	Triangle tri(Point(0,0), Point(1,0), Point(0,1));
@@ -101,7 +103,7 @@ int main(int argc, char **argv) {
 
 		std::cout << std::setw(15)<< energyT << std::setw(15) <<energyE << std::setw(15) << "(" << energy_grad[0] <<"," << energy_grad[1] <<")" << std::endl;
 
-		std::list<DT::Vertex_handle> internal_verts;
+		std::vector<DT::Vertex_handle> internal_verts;
 		int i=0; 
 		for(auto v_itr = dt.finite_vertices_begin(); v_itr != dt.finite_vertices_end(); v_itr++, i++){
 			internal_verts.push_back(v_itr); 
@@ -148,119 +150,44 @@ int main(int argc, char **argv) {
 	
 	std::vector<double> heights_NDT_less_DT;
 
-	std::ofstream outputFile; 
 	
-	outputFile.open("NDTvDT/NDTvDT_exp1_star0.txt"); 
-
 	std::cout<< "Set-up 1 "<< std::endl;
 	std:: cout<< " Results for Wk=" << Wk << ", star=" <<star << std::endl; 
         std::cout << std:: setw(6) << "" << std::setw(10) << "Tri 1" << std::setw(10) << "Tri 2" << std::setw(10) << "sum" << std::endl; 
-	double height=1;
 
-	//star 0	
+	// stars 0, 1 and 2 in one sweep, with a file for each star
+	std::ofstream star_files[3]; 
+	const int star_file_width[3]={15,10,10};
+	std::vector<double> heights_NDT_less_DT_star[3];
+	for(int s=0; s<3; s++)
+		star_files[s].open("NDTvDT/NDTvDT_exp1_star"+std::to_string(s)+".txt"); 
+	double height=1;
 	while( height>0){
 		Triangle DTtri1(Point(-1,0), Point(0,-1), Point(0,height));
 		Triangle DTtri2(Point(0,height), Point(1,0), Point(0,-1));
-		
-		K_real DTtri1_energy=tri_energy<2,0>(DTtri1);
-		K_real DTtri2_energy=tri_energy<2,0>(DTtri2);
-		K_real DT_energy=DTtri1_energy+DTtri2_energy; 
-		
-	
-	
 		Triangle NDTtri1(Point(-1,0), Point(0,height), Point(1,0));
 		Triangle NDTtri2(Point(-1,0), Point(0,-1), Point(1,0));
 
-		K_real NDTtri1_energy=tri_energy<2,0>(NDTtri1); 
-		K_real NDTtri2_energy=tri_energy<2,0>(NDTtri2); 
-		K_real NDT_energy=NDTtri1_energy + NDTtri2_energy; 
-
-		//outFile<< std::setw(8) <<"height: "<< std::setw(10) << height <<std::endl;
-		//outFile <<std::setw(8) << "DT: "<<  std::setw(10) << DTtri1_energy << std::setw(10) << DTtri2_energy << std::setw(10) << DT_energy << std::endl;
-		//outFile << std::setw(8) << "NDT: " << std::setw(10) << NDTtri1_energy << std::setw(10) << NDTtri2_energy << std::setw(10) << NDT_energy << std::endl<<std::endl;
-	
-		outputFile<< std::setw(8) << height << std::setw(15) << DT_energy << std::setw(15) << NDT_energy << std::endl;
+		const std::array<double,3> DTtri1_energy=tri_energies_all_stars(DTtri1);
+		const std::array<double,3> DTtri2_energy=tri_energies_all_stars(DTtri2);
+		const std::array<double,3> NDTtri1_energy=tri_energies_all_stars(NDTtri1); 
+		const std::array<double,3> NDTtri2_energy=tri_energies_all_stars(NDTtri2); 
 
-		height-=.01;
-		
-		if(NDT_energy <DT_energy)
-			heights_NDT_less_DT.push_back(height); 
+		for(int s=0; s<3; s++){
+			K_real DT_energy=DTtri1_energy[s]+DTtri2_energy[s]; 
+			K_real NDT_energy=NDTtri1_energy[s]+NDTtri2_energy[s]; 
+			star_files[s]<< std::setw(8) << height << std::setw(star_file_width[s]) << DT_energy << std::setw(star_file_width[s]) << NDT_energy << std::endl;
 		
-	
-	}
-	outputFile.close(); 
-
-
-	//star 1
-	outputFile.open("NDTvDT/NDTvDT_exp1_star1.txt"); 
-	height=1;
-	while( height>0){
-		Triangle DTtri1(Point(-1,0), Point(0,-1), Point(0,height));
-		Triangle DTtri2(Point(0,height), Point(1,0), Point(0,-1));
-		
-		K_real DTtri1_energy=tri_energy<2,1>(DTtri1);
-		K_real DTtri2_energy=tri_energy<2,1>(DTtri2);
-		K_real DT_energy=DTtri1_energy+DTtri2_energy; 
-		
-	
-	
-		Triangle NDTtri1(Point(-1,0), Point(0,height), Point(1,0));
-		Triangle NDTtri2(Point(-1,0), Point(0,-1), Point(1,0));
-
-		K_real NDTtri1_energy=tri_energy<2,1>(NDTtri1); 
-		K_real NDTtri2_energy=tri_energy<2,1>(NDTtri2); 
-		K_real NDT_energy=NDTtri1_energy + NDTtri2_energy; 
-
-		//outFile<< std::setw(8) <<"height: "<< std::setw(10) << height <<std::endl;
-		//outFile <<std::setw(8) << "DT: "<<  std::setw(10) << DTtri1_energy << std::setw(10) << DTtri2_energy << std::setw(10) << DT_energy << std::endl;
-		//outFile << std::setw(8) << "NDT: " << std::setw(10) << NDTtri1_energy << std::setw(10) << NDTtri2_energy << std::setw(10) << NDT_energy << std::endl<<std::endl;
-	
-		outputFile<< std::setw(8) << height << std::setw(10) << DT_energy << std::setw(10) << NDT_energy << std::endl;
-
+			// the height of the next step, as before
+			if(NDT_energy <DT_energy)
+				heights_NDT_less_DT_star[s].push_back(height-.01); 
+		}
 		height-=.01;
-		
-		if(NDT_energy <DT_energy)
-			heights_NDT_less_DT.push_back(height); 
-		
-	
 	}
-	outputFile.close(); 
-
-	
-	//star 2
-	outputFile.open("NDTvDT/NDTvDT_exp1_star2.txt"); 
-	height=1;
-	while( height>0){
-		
-		Triangle DTtri1(Point(-1,0), Point(0,-1), Point(0,height));
-		Triangle DTtri2(Point(0,height), Point(1,0), Point(0,-1));
-		
-		K_real DTtri1_energy=tri_energy<2,2>(DTtri1);
-		K_real DTtri2_energy=tri_energy<2,2>(DTtri2);
-		K_real DT_energy=DTtri1_energy+DTtri2_energy; 
-		
-	
-		Triangle NDTtri1(Point(-1,0), Point(0,height), Point(1,0));
-		Triangle NDTtri2(Point(-1,0), Point(0,-1), Point(1,0));
-
-		K_real NDTtri1_energy=tri_energy<2,2>(NDTtri1); 
-		K_real NDTtri2_energy=tri_energy<2,2>(NDTtri2); 
-		K_real NDT_energy=NDTtri1_energy + NDTtri2_energy; 
-
-		//outFile<< std::setw(8) <<"height: "<< std::setw(10) << height <<std::endl;
-		//outFile <<std::setw(8) << "DT: "<<  std::setw(10) << DTtri1_energy << std::setw(10) << DTtri2_energy << std::setw(10) << DT_energy << std::endl;
-		//outFile << std::setw(8) << "NDT: " << std::setw(10) << NDTtri1_energy << std::setw(10) << NDTtri2_energy << std::setw(10) << NDT_energy << std::endl<<std::endl;
-	
-		outputFile<< std::setw(8) << height << std::setw(10) << DT_energy << std::setw(10) << NDT_energy << std::endl;
-
-		height-=.01;
-		
-		if(NDT_energy <DT_energy)
-			heights_NDT_less_DT.push_back(height); 
-		
-	
+	for(int s=0; s<3; s++){
+		star_files[s].close(); 
+		heights_NDT_less_DT.insert(heights_NDT_less_DT.end(), heights_NDT_less_DT_star[s].begin(), heights_NDT_less_DT_star[s].end());
 	}
-	outputFile.close(); 
 
 	std::cout<< "Heights where NDT <DT :" <<std::endl;
 	std::vector<double>::iterator height_iter=heights_NDT_less_DT.begin();
@@ -307,85 +234,30 @@ int main(int argc, char **argv) {
  //Expirement 2 
 
 
-	//star 0	
-	outputFile.open("NDTvDT/NDTvDT_exp2_star0.txt"); 
+	// stars 0, 1 and 2 in one sweep, with a file for each star
+	for(int s=0; s<3; s++)
+		star_files[s].open("NDTvDT/NDTvDT_exp2_star"+std::to_string(s)+".txt"); 
 	height=1;
 	while( height>0){
 		Triangle DTtri1(Point(-1,0), Point(-1,height), Point(0,-.5));
 		Triangle DTtri2(Point(-1,height), Point (1,0), Point(0,-.5)); 
-		
-		K_real DTtri1_energy=tri_energy<2,0>(DTtri1);
-		K_real DTtri2_energy=tri_energy<2,0>(DTtri2);
-		K_real DT_energy=DTtri1_energy+DTtri2_energy; 
-	
-		Triangle NDTtri1(Point(-1,0), Point(1,0), Point(-1,height)); 
-		Triangle NDTtri2(Point(-1,0), Point(0,-.5), Point(1,0)); 
-
-		K_real NDTtri1_energy=tri_energy<2,1>(NDTtri1); 
-		K_real NDTtri2_energy=tri_energy<2,1>(NDTtri2); 
-		K_real NDT_energy=NDTtri1_energy + NDTtri2_energy; 
-	
-		outputFile<< std::setw(8) << height << std::setw(15) << DT_energy << std::setw(15) << NDT_energy << std::endl;
-
-		height-=.01;
-
-	}
-	outputFile.close(); 
-
-
-	//star 1
-	
-	outputFile.open("NDTvDT/NDTvDT_exp2_star1.txt"); 
-	height=1;	
-	while( height>0){
-		Triangle DTtri1(Point(-1,0), Point(-1,height), Point(0,-.5));
-		Triangle DTtri2(Point(-1,height), Point (1,0), Point(0,-.5)); 
-		
-		K_real DTtri1_energy=tri_energy<2,1>(DTtri1);
-		K_real DTtri2_energy=tri_energy<2,1>(DTtri2);
-		K_real DT_energy=DTtri1_energy+DTtri2_energy; 
-	
-		Triangle NDTtri1(Point(-1,0), Point(1,0), Point(-1,height)); 
-		Triangle NDTtri2(Point(-1,0), Point(0,-.5), Point(1,0)); 
-
-		K_real NDTtri1_energy=tri_energy<2,1>(NDTtri1); 
-		K_real NDTtri2_energy=tri_energy<2,1>(NDTtri2); 
-		K_real NDT_energy=NDTtri1_energy + NDTtri2_energy; 
-	
-		outputFile<< std::setw(8) << height << std::setw(15) << DT_energy << std::setw(15) << NDT_energy << std::endl;
-
-		height-=.01;
-
-	}
-	outputFile.close(); 
-
-	//star 1
-	
-	outputFile.open("NDTvDT/NDTvDT_exp2_star2.txt"); 
-	height=1;	
-	while( height>0){
-		Triangle DTtri1(Point(-1,0), Point(-1,height), Point(0,-.5));
-		Triangle DTtri2(Point(-1,height), Point (1,0), Point(0,-.5)); 
-		
-		K_real DTtri1_energy=tri_energy<2,2>(DTtri1);
-		K_real DTtri2_energy=tri_energy<2,2>(DTtri2);
-		K_real DT_energy=DTtri1_energy+DTtri2_energy; 
-		
-	
-	
 		Triangle NDTtri1(Point(-1,0), Point(1,0), Point(-1,height)); 
 		Triangle NDTtri2(Point(-1,0), Point(0,-.5), Point(1,0)); 
 
-		K_real NDTtri1_energy=tri_energy<2,2>(NDTtri1); 
-		K_real NDTtri2_energy=tri_energy<2,2>(NDTtri2); 
-		K_real NDT_energy=NDTtri1_energy + NDTtri2_energy; 
-	
-		outputFile<< std::setw(8) << height << std::setw(15) << DT_energy << std::setw(15) << NDT_energy << std::endl;
+		const std::array<double,3> DTtri1_energy=tri_energies_all_stars(DTtri1);
+		const std::array<double,3> DTtri2_energy=tri_energies_all_stars(DTtri2);
+		const std::array<double,3> NDTtri1_energy=tri_energies_all_stars(NDTtri1); 
+		const std::array<double,3> NDTtri2_energy=tri_energies_all_stars(NDTtri2); 
 
+		for(int s=0; s<3; s++){
+			K_real DT_energy=DTtri1_energy[s]+DTtri2_energy[s]; 
+			K_real NDT_energy=NDTtri1_energy[s]+NDTtri2_energy[s]; 
+			star_files[s]<< std::setw(8) << height << std::setw(15) << DT_energy << std::setw(15) << NDT_energy << std::endl;
+		}
 		height-=.01;
-
 	}
-	outputFile.close(); 
+	for(int s=0; s<3; s++)
+		star_files[s].close(); 
 
 //////////////////////////////////////////////////////////////
 /////////////////////////////////////////////
@@ -397,8 +269,8 @@ int main(int argc, char **argv) {
 
 	std::cout<<std::endl<< "hexagon with free vertex experiment: "<< std::endl;
 	
-	//std::ofstream outputFile;
-	outputFile.open("total_hex_energy.txt");
+	const std::vector<result_column> hex_columns={{"x", column_type::float64}, {"y", column_type::float64}, {"energy", column_type::float64}}; 
+	result_block hex_rows(hex_columns); 
 
 	// hexgon perimeter points
 	
@@ -438,7 +310,8 @@ int main(int argc, char **argv) {
 				total_hex_energy+=tri_energy<Wk,star>(triangle_array[i]);
 			}
 			std::cout<< std::setw(10) << std::setprecision(5) << stepsize <<std::setw(10)<< std::setprecision(5) << total_hex_energy << std::endl;
-			outputFile<< std::setw(15) <<std::setprecision(5)<<freept.x() << std::setw(15) <<std::setprecision(5)<< freept.y() << std::setw(15) << std::setprecision(5) << total_hex_energy <<std::endl; 
+			const double row[]={CGAL::to_double(freept.x()), CGAL::to_double(freept.y()), total_hex_energy}; 
+			hex_rows.add_row(row); 
 			stepsize+=1; 
 			//std::cout<<"THis is the value of stepsize: "<< stepsize <<std::endl;
 			if(total_hex_energy >max_energy){
@@ -451,7 +324,9 @@ int main(int argc, char **argv) {
 		
 		angle+=anglestep;
 	}
-	outputFile.close();
+	std::unique_ptr<result_sink> hex_sink=open_result_sink("total_hex_energy.txt", "text", hex_columns); 
+	if(!hex_sink || !hex_sink->write(hex_rows) || !hex_sink->close())
+		return 1; 
 	std::cout<< "min: " << min_energy << " max: " << max_energy <<std::endl;
 	std::cout << "max angle: " << max_angle << " max stepsize: " << stepsize <<std::endl;
 	
@@ -0,0 +1,14 @@
+// hot_block_worker.cpp
+// The worker process of partitioned_hot_optimize (partitioned_hot.hpp). It
+// optimizes the blocks sent over its standard input, one end of a socket
+// pair, and exits when the socket is closed
+
+#include <unistd.h>
+
+#include "hot.hpp"
+#include "partitioned_hot.hpp"
+
+int main() {
+  serve_blocks(STDIN_FILENO);
+  return 0;
+}
@@ -2,12 +2,16 @@
 
 #include <fstream>
 #include <iostream>
+#include <string>
 
 #define CGAL_MESH_2_OPTIMIZER_VERBOSE
 //#define CGAL_MESH_2_OPTIMIZERS_DEBUG
 //#define CGAL_MESH_2_SIZING_FIELD_USE_BARYCENTRIC_COORDINATES
 
 #include "hot.hpp"
+#include "accelerated_cvt.hpp"
+#include "cvt_density.hpp"
+#include "cdt_hot_optimize.hpp"
 #include "ply_writer.hpp"
 
 #include <CGAL/Constrained_Delaunay_triangulation_2.h>
@@ -62,84 +66,161 @@ int main(int argc, char **argv) {
 	  CDT cdt;
 
 	const int num_points = 100;
+
+	// lloydsCVT [checkpoint]: with a checkpoint path the Lloyd stage is our own lloyd_iterate in the box, which
+	// is checkpointed to the path and resumed from it if it holds one. CGAL's optimizer can't be, since its
+	// convergence test and move bookkeeping live in the optimizer object. A resumed run starts at that stage
+	const std::string checkpoint_path=argc>1 ? argv[1] : ""; 
+	checkpoint resume; 
+	const bool resumed=!checkpoint_path.empty() && read_checkpoint(checkpoint_path, resume) && resume.solver=="lloyd"; 
+
+	std::vector<double> original_x_coor; 
+	std::vector<double> original_y_coor;
+	int face_num=0; 
+	if(!resumed){
+	  	//generate_rand_dt(num_points, dt);
+		generate_rand_t(num_points,cdt);
 	
-  	//generate_rand_dt(num_points, dt);
-	generate_rand_t(num_points,cdt);
-	
-	// insert boundary vertices
-	CDT::Vertex_handle va=cdt.insert(Point(10,10));
-	CDT::Vertex_handle vb=cdt.insert(Point(20,10));
-	CDT::Vertex_handle vc=cdt.insert(Point(20,20));
-	CDT::Vertex_handle vd=cdt.insert(Point(10,20));
-
-	cdt.insert(Point(10.5,11.8));
-	cdt.insert(Point(17.5,10.9));
-	cdt.insert(Point(16.3,14.3));
-	cdt.insert(Point(11,12.8));
-
-	cdt.insert_constraint(va,vb);
-	cdt.insert_constraint(vb,vc);
-	cdt.insert_constraint(vc,vd);
-	cdt.insert_constraint(vd,va);	
+		// insert boundary vertices
+		CDT::Vertex_handle va=cdt.insert(Point(10,10));
+		CDT::Vertex_handle vb=cdt.insert(Point(20,10));
+		CDT::Vertex_handle vc=cdt.insert(Point(20,20));
+		CDT::Vertex_handle vd=cdt.insert(Point(10,20));
+
+		cdt.insert(Point(10.5,11.8));
+		cdt.insert(Point(17.5,10.9));
+		cdt.insert(Point(16.3,14.3));
+		cdt.insert(Point(11,12.8));
+
+		cdt.insert_constraint(va,vb);
+		cdt.insert_constraint(vb,vc);
+		cdt.insert_constraint(vc,vd);
+		cdt.insert_constraint(vd,va);	
 	
-	int num_constrained_edges=0;
+		int num_constrained_edges=0;
 
-	for(auto ei=cdt.finite_edges_begin();ei!=cdt.finite_edges_end(); ei++){
-		if(cdt.is_constrained(*ei))  num_constrained_edges++;
-	}
-	//Observations: when inserting vertices, no constraints are added. it is not assume that the convex hull boundary edges are constrained. 
-	//For now we manually insert a boundary box of constrained edges. 
+		for(auto ei=cdt.finite_edges_begin();ei!=cdt.finite_edges_end(); ei++){
+			if(cdt.is_constrained(*ei))  num_constrained_edges++;
+		}
+		//Observations: when inserting vertices, no constraints are added. it is not assume that the convex hull boundary edges are constrained. 
+		//For now we manually insert a boundary box of constrained edges. 
 		
 
 	
-	std::cout<<"Num constrained edges: " << num_constrained_edges << std::endl; 
-
-
-
-  	//CDT::Vertex_handle va = cdt.insert(Point(-2,0));
-  	//CDT::Vertex_handle vb = cdt.insert(Point(0,-2));
-  	//CDT::Vertex_handle vc = cdt.insert(Point(2,0));
-  	//CDT::Vertex_handle vd = cdt.insert(Point(0,1));
-  	//cdt.insert(Point(2, 0.6));
-  	//cdt.insert_constraint(va, vb);
-  	//cdt.insert_constraint(vb, vc);
-  //cdt.insert_constraint(vc, vd);
-  //cdt.insert_constraint(vd, va);
-  //std::cout << "Number of vertices: " << cdt.number_of_vertices() << std::endl;
-  //std::cout << "Number of faces: " << cdt.number_of_faces() << std::endl;
-  std::cout << "Meshing..." << std::endl;
-  Mesher mesher(cdt);
-  mesher.set_criteria(Criteria(0.125, 0.000005));
-  mesher.refine_mesh();
+		std::cout<<"Num constrained edges: " << num_constrained_edges << std::endl; 
+
+
+
+	  	//CDT::Vertex_handle va = cdt.insert(Point(-2,0));
+	  	//CDT::Vertex_handle vb = cdt.insert(Point(0,-2));
+	  	//CDT::Vertex_handle vc = cdt.insert(Point(2,0));
+	  	//CDT::Vertex_handle vd = cdt.insert(Point(0,1));
+	  	//cdt.insert(Point(2, 0.6));
+	  	//cdt.insert_constraint(va, vb);
+	  	//cdt.insert_constraint(vb, vc);
+	  //cdt.insert_constraint(vc, vd);
+	  //cdt.insert_constraint(vd, va);
+	  //std::cout << "Number of vertices: " << cdt.number_of_vertices() << std::endl;
+	  //std::cout << "Number of faces: " << cdt.number_of_faces() << std::endl;
+	  std::cout << "Meshing..." << std::endl;
+	  Mesher mesher(cdt);
+	  mesher.set_criteria(Criteria(0.125, 0.000005));
+	  mesher.refine_mesh();
   
-  std::cout << "Number of vertices: " << cdt.number_of_vertices() << std::endl;
-  std::cout <<"Number of faces: " <<cdt.number_of_faces()<<std::endl;
+	  std::cout << "Number of vertices: " << cdt.number_of_vertices() << std::endl;
+	  std::cout <<"Number of faces: " <<cdt.number_of_faces()<<std::endl;
 
 
-int face_num=0; 
-	for(auto face_itr = cdt.finite_faces_begin(); face_itr != cdt.finite_faces_end(); face_itr++, face_num++){
-		//Triangle face = CDT::face_to_tri(*face_itr);
-		//CDT::Face tri=*face_itr;
-		Point point0=((*face_itr).vertex(0))->point(); 
-		Point point1=((*face_itr).vertex(1))->point();
-		Point point2=((*face_itr).vertex(2))->point(); 
+		for(auto face_itr = cdt.finite_faces_begin(); face_itr != cdt.finite_faces_end(); face_itr++, face_num++){
+			//Triangle face = CDT::face_to_tri(*face_itr);
+			//CDT::Face tri=*face_itr;
+			Point point0=((*face_itr).vertex(0))->point(); 
+			Point point1=((*face_itr).vertex(1))->point();
+			Point point2=((*face_itr).vertex(2))->point(); 
 	 
-		//std::cout<<face_num <<std::endl; 
-		//std::cout<<"("<<point0.x() << ", " <<point0.y() <<")" << std::endl; 
-		//std::cout<<"("<<point1.x() << ", " <<point1.y() <<")" << std::endl; 
-		//std::cout <<"("<<point2.x() << ", " <<point2.y() <<")" << std::endl<<std::endl; 
-	}
+			//std::cout<<face_num <<std::endl; 
+			//std::cout<<"("<<point0.x() << ", " <<point0.y() <<")" << std::endl; 
+			//std::cout<<"("<<point1.x() << ", " <<point1.y() <<")" << std::endl; 
+			//std::cout <<"("<<point2.x() << ", " <<point2.y() <<")" << std::endl<<std::endl; 
+		}
 
-	std::vector<double> original_x_coor; 
-	std::vector<double> original_y_coor;
-	for(auto vertex_itr=cdt.finite_vertices_begin(); vertex_itr!=cdt.finite_vertices_end(); vertex_itr++){
-		original_x_coor.push_back((vertex_itr->point()).x());
-		original_y_coor.push_back((vertex_itr->point()).y());
-	}
+		for(auto vertex_itr=cdt.finite_vertices_begin(); vertex_itr!=cdt.finite_vertices_end(); vertex_itr++){
+			original_x_coor.push_back((vertex_itr->point()).x());
+			original_y_coor.push_back((vertex_itr->point()).y());
+		}
 	
 	
+		// the same sites, relaxed by our own CVT with and without acceleration
+		std::vector<Point> mesh_sites; 
+		for(auto vertex_itr=cdt.finite_vertices_begin(); vertex_itr!=cdt.finite_vertices_end(); vertex_itr++){
+			mesh_sites.push_back(vertex_itr->point()); 
+		}
+		{
+			const cvt_domain box=cvt_domain::box(10,20,10,20); 
+			cvt_params params; 
+			params.max_iterations=10000; 
+			params.energy_tolerance=0; 
+			params.displacement_tolerance=.000001; 
+			DT lloyd_dt(mesh_sites.begin(), mesh_sites.end()); 
+			DT anderson_dt(mesh_sites.begin(), mesh_sites.end()); 
+			DT lbfgs_dt(mesh_sites.begin(), mesh_sites.end()); 
+			cvt_result lloyd=lloyd_iterate(lloyd_dt, box, params); 
+			cvt_result anderson=anderson_cvt(anderson_dt, box, params); 
+			cvt_result lbfgs=lbfgs_cvt(lbfgs_dt, box, params); 
+			std::cout << "CVT iterations to displacement " << params.displacement_tolerance << ": Lloyd " << lloyd.iterations << " (energy " << lloyd.energy << "), Anderson " << anderson.iterations << " (energy " << anderson.energy << "), L-BFGS " << lbfgs.iterations << " (energy " << lbfgs.energy << ")" << std::endl; 
+
+			// adaptive: rho = 1 + (20 - x)^2 packs the sites toward x = 10
+			polynomial_density graded(2); 
+			graded.coefficient(0,0)=401; 
+			graded.coefficient(1,0)=-40; 
+			graded.coefficient(2,0)=1; 
+			DT graded_dt(mesh_sites.begin(), mesh_sites.end()); 
+			cvt_result graded_result=lbfgs_cvt(graded_dt, box, params, 5, graded); 
+			std::cout << "Density weighted CVT: " << graded_result.iterations << " L-BFGS iterations, energy " << graded_result.energy << std::endl; 
+		}
+	}
+
 	std::cout << "Run Lloyd optimization for CDT...";
-	CGAL::lloyd_optimize_mesh_2(cdt, CGAL::parameters::freeze_bound=0,CGAL::parameters::convergence=.000001);
+	if(checkpoint_path.empty()){
+		CGAL::lloyd_optimize_mesh_2(cdt, CGAL::parameters::freeze_bound=0,CGAL::parameters::convergence=.000001);
+	}else{
+		checkpoint_writer checkpoints(checkpoint_path, 60); 
+		DT sites_dt; 
+		if(resumed){
+			restore_triangulation(sites_dt, resume); 
+			std::cout << " resumed after " << resume.iteration << " iterations from " << checkpoint_path << "..."; 
+		}else{
+			std::vector<Point> sites; 
+			for(auto vertex_itr=cdt.finite_vertices_begin(); vertex_itr!=cdt.finite_vertices_end(); vertex_itr++){
+				sites.push_back(vertex_itr->point()); 
+			}
+			sites_dt.insert(sites.begin(), sites.end()); 
+		}
+		cvt_params params; 
+		params.max_iterations=10000; 
+		params.energy_tolerance=0; 
+		params.displacement_tolerance=.000001; 
+		params.checkpoints=&checkpoints; 
+		params.resume=resumed ? &resume : nullptr; 
+		const cvt_result lloyd=lloyd_iterate(sites_dt, cvt_domain::box(10,20,10,20), params); 
+		std::cout << " " << lloyd.iterations << " iterations..."; 
+
+		// the box constraints first, which the sites on the box edges split
+		cdt.clear(); 
+		CDT::Vertex_handle va=cdt.insert(Point(10,10));
+		CDT::Vertex_handle vb=cdt.insert(Point(20,10));
+		CDT::Vertex_handle vc=cdt.insert(Point(20,20));
+		CDT::Vertex_handle vd=cdt.insert(Point(10,20));
+		cdt.insert_constraint(va,vb);
+		cdt.insert_constraint(vb,vc);
+		cdt.insert_constraint(vc,vd);
+		cdt.insert_constraint(vd,va);	
+		std::vector<Point> sites; 
+		for(auto vertex_itr=sites_dt.finite_vertices_begin(); vertex_itr!=sites_dt.finite_vertices_end(); vertex_itr++){
+			sites.push_back(vertex_itr->point()); 
+		}
+		cdt.insert(sites.begin(), sites.end()); 
+	}
 	//  CGAL::parameters::max_iteration_number = 100
 	std::cout << " done." << std::endl;
 	std::cout << "Number of vertices: " << cdt.number_of_vertices() << std::endl;
@@ -163,6 +244,12 @@ int face_num=0;
 
 	}
 	std::cout<< "Num unmoved vertices: " << num_unmoved_vertices <<std::endl; 
+
+	// HOT on the box domain, with the vertices on the box edges sliding along them
+	mark_domain(cdt); 
+	const double cdt_hot_initial=cdt_hot_energy<1>(cdt); 
+	mesh_optimize_result cdt_hot=cdt_hot_optimize<1>(cdt); 
+	std::cout << "Constrained HOT: energy " << cdt_hot_initial << " -> " << cdt_hot.energy << " in " << cdt_hot.iterations << " iterations" << std::endl; 
 	face_num=0; 
 	for(auto face_itr = cdt.finite_faces_begin(); face_itr != cdt.finite_faces_end(); face_itr++, face_num++){
 		//Triangle face = CDT::face_to_tri(*face_itr);
@@ -1,5 +1,5 @@
 // exp5_horseV_DT.cpp
-#include <fstream>
+#include <memory>
 
 // use exact predicates
 // if using Cartesian, then can get a crash with freepoint being outside domain inconsistency
@@ -9,9 +9,19 @@
 
 #include "Sb.hpp"
 #include "ply_writer.hpp"
+#include "result_sink.hpp"
+
+// writes the rows of a sweep to path as text, with the given column names
+bool write_sweep(const std::string &path, const std::vector<result_column> &columns, const result_block &rows){
+	std::unique_ptr<result_sink> sink=open_result_sink(path, "text", columns); 
+	return sink && sink->write(rows) && sink->close(); 
+}
 
 int main(int argc, char **argv) {
-	std::ofstream outputFile; 
+	const std::vector<result_column> vertical_columns={{"y", column_type::float64}, {"energy", column_type::float64}}; 
+	const std::vector<result_column> horizontal_columns={{"x", column_type::float64}, {"energy", column_type::float64}}; 
+	const std::vector<result_column> mesh_columns={{"x", column_type::float64}, {"y", column_type::float64}, {"energy", column_type::float64}}; 
+	bool written=true; 
 
 	double fig_height=8;
 	double fig_width=2; 
@@ -27,7 +37,7 @@ int main(int argc, char **argv) {
 ///////////////////// Exp 5a: HOT ///////////////////////////////
 /////////////////////////////////////////////////////////////
 	//star 0
-	outputFile.open("exp5a_horseV_DT_star_2_1.txt"); 
+	result_block vertical(vertical_columns); 
 		y_coor=fig_height/2; 
 		while(y_coor<fig_height){
 			Point freept(0, y_coor); 
@@ -38,11 +48,11 @@ int main(int argc, char **argv) {
 			dt.insert(points[2]);
 			dt.insert(points[3]); 
 			dt.insert(freept);
-			std::cout <<"y= " << y_coor <<std::endl;
-			std::cout <<"vertices: " <<std::endl;
+			HOT_DEBUG("y= " << y_coor);
+			HOT_TRACE("vertices: ");
 			for(auto vertex_itr = dt.finite_vertices_begin(); vertex_itr != dt.finite_vertices_end(); vertex_itr++) {
 				Point vertex=vertex_itr->point(); 
-				std::cout<< "(" <<vertex.x() <<", " << vertex.y()<<")"<<std::endl; 
+				HOT_TRACE("(" <<vertex.x() <<", " << vertex.y()<<")"); 
 			}
 
 			double energy=0; 
@@ -51,23 +61,23 @@ int main(int argc, char **argv) {
 				Point p0=(f_itr->vertex(0))->point(); 
 				Point p1=(f_itr->vertex(1))->point(); 
 				Point p2=(f_itr->vertex(2))->point(); 
-				std::cout<< "("<< p0.x() <<", " << p0.y() <<"), (" <<p1.x() <<", " <<p1.y()<< "), "  <<"(" <<p2.x() <<", " <<p2.y()<< ")"  <<std::endl; 
+				HOT_TRACE("("<< p0.x() <<", " << p0.y() <<"), (" <<p1.x() <<", " <<p1.y()<< "), "  <<"(" <<p2.x() <<", " <<p2.y()<< ")"); 
 
 				energy+= tri_energy<2,1>(face_to_tri(*f_itr)); 
 			
 			}
-			std::cout<<"mesh energy: " << energy <<std::endl; 
-			std::cout <<std::endl; 
-			outputFile<< std::setw(15) << y_coor << std::setw(15) << energy <<std::endl; 
+			HOT_DEBUG("mesh energy: " << energy); 
+			const double row[]={y_coor, energy}; 
+			vertical.add_row(row); 
 			
 
 			
 		y_coor+=step_size; 
 		}
 	
-	outputFile.close(); 
+	written=write_sweep("exp5a_horseV_DT_star_2_1.txt", vertical_columns, vertical) && written; 
 //varry horizontal coordinate
-		outputFile.open("exp5a_horseV_DT_star_2_1_hor.txt"); 
+		result_block horizontal(horizontal_columns); 
 		step_size=.01;
 		y_coor=6;
 		x_coor= -.25; 
@@ -81,10 +91,10 @@ int main(int argc, char **argv) {
 			dt.insert(points[3]); 
 			dt.insert(freept);
 			//std::cout <<"y= " << y_coor <<std::endl;
-			std::cout <<"vertices: " <<std::endl;
+			HOT_TRACE("vertices: ");
 			for(auto vertex_itr = dt.finite_vertices_begin(); vertex_itr != dt.finite_vertices_end(); vertex_itr++) {
 				Point vertex=vertex_itr->point(); 
-				std::cout<< "(" <<vertex.x() <<", " << vertex.y()<<")"<<std::endl; 
+				HOT_TRACE("(" <<vertex.x() <<", " << vertex.y()<<")"); 
 			}
 
 			double energy=0; 
@@ -100,17 +110,18 @@ int main(int argc, char **argv) {
 			}
 			//std::cout<<"mesh energy: " << energy <<std::endl; 
 			//std::cout <<std::endl; 
-			outputFile<< std::setw(15) << x_coor << std::setw(15) << energy <<std::endl; 
+			const double row[]={x_coor, energy}; 
+			horizontal.add_row(row); 
 			
 
 			
 		x_coor+=step_size; 
 		}
 	
-	outputFile.close(); 
+	written=write_sweep("exp5a_horseV_DT_star_2_1_hor.txt", horizontal_columns, horizontal) && written; 
 
 // as vertex is moved, update to DT
-	outputFile.open("exp5a_horseV_DTmesh_star_2_1.txt"); 
+	result_block mesh(mesh_columns); 
 	Point boundary_pts[]={Point(-fig_width/2,0),Point(fig_width/2,0), Point(0,fig_height)};	
 	x_coor= -fig_width/2+.01;
 	y_coor= .01;
@@ -140,13 +151,14 @@ int main(int argc, char **argv) {
 			for(auto face_itr=dt.finite_faces_begin(); face_itr!=dt.finite_faces_end();face_itr++){
 				total_energy+=tri_energy<2,1>(face_to_tri(*face_itr));
 			}
-			outputFile<< std::setw(15) <<std::setprecision(5)<<freept.x() << std::setw(15) <<std::setprecision(5)<< freept.y() << std::setw(15) << std::setprecision(5) << total_energy <<std::endl;
+			const double row[]={freept.x(), freept.y(), total_energy}; 
+			mesh.add_row(row); 
 		y_coor+=step_size; 
 		}
 		x_coor+=step_size;
 	}
-	outputFile.close(); 
+	written=write_sweep("exp5a_horseV_DTmesh_star_2_1.txt", mesh_columns, mesh) && written; 
 
 
-	return 0; 
+	return written ? 0 : 1; 
 }
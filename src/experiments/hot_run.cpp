@@ -0,0 +1,26 @@
+// hot_run.cpp
+// runs the experiments described by spec files, e.g.
+//   hot_run examples/experiments/exp4a_hex_patch.json
+
+#include <iostream>
+
+// use exact predicates, as the hand written experiments do; the sweeps
+// triangulate near degenerate configurations
+#define CGAL_EI
+
+#include "experiment.hpp"
+
+int main(int argc, char **argv) {
+	if(argc<2){
+		std::cerr << "usage: " << argv[0] << " spec.json [spec.json ...]" << std::endl;
+		return 1;
+	}
+	int failed=0;
+	for(int i=1; i<argc; i++){
+		spec_value spec;
+		experiment e;
+		if(!read_spec(argv[i], spec) || !experiment_from_spec(spec, e) || !run_experiment(e))
+			failed++;
+	}
+	return failed==0 ? 0 : 1;
+}
@@ -27,17 +27,14 @@ void aggregate_simplices(const DT &mesh, std::list<Point> &points,
   }
 }
 
-void write_ply(const char *fname, const DT &mesh) {
+template <typename Points, typename Faces>
+void write_ply_simplices(const char *fname, const Points &points,
+                         const Faces &faces) {
   std::ofstream output(fname);
   static constexpr const char *header = "ply\n"
                                         "format ascii 1.0";
   output << header << std::endl;
 
-  //
-  std::list<Point> points;
-  std::list<std::array<int, tri_verts> > faces;
-  aggregate_simplices(mesh, points, faces);
-
   static constexpr const char *vertex_props = "property float x\n"
                                               "property float y\n"
                                               "property float z";
@@ -52,7 +49,7 @@ void write_ply(const char *fname, const DT &mesh) {
   output << "end_header" << std::endl;
 
   // Output the vertices
-  for(const Point &p : points) {
+  for(const auto &p : points) {
     output << p << ' ' << 0 << std::endl;
   }
   for (const std::array<int, tri_verts> &f : faces) {
@@ -63,3 +60,18 @@ void write_ply(const char *fname, const DT &mesh) {
     output << std::endl;
   }
 }
+
+void write_ply(const char *fname, const DT &mesh) {
+  std::list<Point> points;
+  std::list<std::array<int, tri_verts> > faces;
+  aggregate_simplices(mesh, points, faces);
+  write_ply_simplices(fname, points, faces);
+}
+
+void write_ply(const char *fname, const Indexed_DT &mesh) {
+  std::vector<Indexed_DT::Point> points(mesh.number_of_indexed_vertices());
+  for (int i = 0; i < mesh.number_of_indexed_vertices(); i++) {
+    points[i] = mesh.indexed_vertex(i)->point();
+  }
+  write_ply_simplices(fname, points, mesh.indexed_triangles());
+}
@@ -6,6 +6,8 @@
 #include "Sb.hpp"
 #include "energyWeights.hpp"
 #include "lloyds.hpp"
+#include "weighted_hot_optimize.hpp"
+#include "analytic_Sb_Derv.hpp"
 #include "ply_writer.hpp"
 //#include "build_triangulation.hpp"
 
@@ -26,12 +28,12 @@ int main(int argc, char **argv) {
 	std::vector <Point> intial_points={Point(0,0), Point(2,0), Point(2,2), Point(0,2), Point(1,1),Point(4,0), Point(3,1), Point(4,2)};
 	int num_lloyds_iterations=5;  
 	double x_min=-1, y_min=-1, y_max=3, x_max=5 ; 
-	RegT rt=build_reg_triangulation(intial_points, 10, x_min,y_min,y_max,x_max);
+	RegT rt=build_reg_triangulation(intial_points, num_lloyds_iterations, x_min,x_max,y_min,y_max);
 	std::cout<<"Vertices in final trinagulation after Lloyds iterations : " <<std::endl; 
 	for(auto v_itr=rt.finite_vertices_begin(); v_itr!=rt.finite_vertices_end(); v_itr++){
 		std::cout << "(" << v_itr->point().x()<<", "  << v_itr->point().y() <<")" <<std::endl; 
 	}
-// because the center of mass of the Voronoi regions of our intial set of points were the initial sites, running Lloyds does not move the points! 
+// the sites spread out to fill the [x_min,x_max]x[y_min,y_max] box
 
 
 
@@ -43,6 +45,16 @@ int main(int argc, char **argv) {
 	std::cout <<"*2-HOT_{2,2}/AREA: " << energy_weights_dividebyArea(random_RT,2,2) <<std::endl; 
 	std::cout << "*2-HOT_{2,2}:" << energy_weights(random_RT,2,2) <<std::endl; 
 
+// optimize the weights and positions of random_RT together
+	RegT optimized_RT=random_RT; 
+	weighted_optimize_result opt=weighted_optimize(optimized_RT, weighted_hot_kernel(2)); 
+	std::cout << "*2-HOT_{2,2} after " << opt.iterations << " weighted_optimize iterations: " << opt.energy << ", hidden vertices: " << opt.hidden_vertices <<std::endl; 
+
+// minimize Sb directly, as a cheaper proxy for HOT
+	RegT Sb_RT=random_RT; 
+	weighted_optimize_result Sb_opt=weighted_optimize(Sb_RT, Sb_kernel(2,1)); 
+	std::cout << "Sb energy 2,1 after " << Sb_opt.iterations << " weighted_optimize iterations: " << Sb_opt.energy << ", *2-HOT_{2,2}: " << energy_weights(Sb_RT,2,2) <<std::endl; 
+
 // check our weighted_circumcenter function works
 	// 1:
 	RegT::Face_handle face_handle=random_RT.finite_faces_begin(); 
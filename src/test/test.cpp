@@ -1,17 +1,38 @@
 
 #include <cmath>
+#include <cstdio>
 #include <limits>
 #include <algorithm>
 #include <random>
 
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 
+#include <CGAL/Constrained_Delaunay_triangulation_2.h>
+#include <CGAL/Delaunay_mesh_face_base_2.h>
+#include <CGAL/Delaunay_mesh_vertex_base_2.h>
 #include <CGAL/Triangulation_data_structure_2.h>
 
 #include "array.hpp"
 #include "hot.hpp"
+#include "analytic_Sb_Derv.hpp"
+#include "accelerated_cvt.hpp"
+#include "cvt_density.hpp"
+#include "HotOptimizedMesh.hpp"
+#include "weighted_hot_optimize.hpp"
+#include "multilevel_hot.hpp"
+#include "partitioned_hot.hpp"
+#include "indexed_triangulation.hpp"
+#include "bulk_build.hpp"
+#include "mesh_io.hpp"
+#include "cdt_hot_optimize.hpp"
 #include "ply_writer.hpp"
+#include "soup_energy.hpp"
+#include "experiment.hpp"
+#include "analytic_HOT_energy_Derv.hpp"
+#include "checkpoint.hpp"
 
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
@@ -169,7 +190,7 @@ TEST_CASE("Single Point Mesh Gradient Descent Local Minimum", "[HOT]") {
 
   dt.insert(DT::Point(initial_internal_x, initial_internal_y));
 
-  std::list<DT::Vertex_handle> internal_verts = internal_vertices(dt);
+  std::vector<DT::Vertex_handle> internal_verts = internal_vertices(dt);
 
   SECTION("Internal Vertices") {
     // Verify there's only 1 internal vertex
@@ -198,7 +219,7 @@ TEST_CASE("Single Point Mesh Gradient Descent Local Minimum", "[HOT]") {
 
   SECTION("Vertex Gradient Descent") {
     DT optimized = hot_optimize<2>(dt);
-    std::list<DT::Vertex_handle> optimized_verts = internal_vertices(optimized);
+    std::vector<DT::Vertex_handle> optimized_verts = internal_vertices(optimized);
     REQUIRE(optimized_verts.size() == 1);
     DT::Vertex_handle vertex = optimized_verts.front();
     REQUIRE(std::abs(vertex->point()[0] - initial_internal_x) <= max_rel_error);
@@ -228,7 +249,7 @@ TEST_CASE("Single Point Mesh Gradient Descent", "[HOT]") {
 
   dt.insert(DT::Point(initial_internal_x, initial_internal_y));
 
-  std::list<DT::Vertex_handle> internal_verts = internal_vertices(dt);
+  std::vector<DT::Vertex_handle> internal_verts = internal_vertices(dt);
 
   SECTION("Internal Vertices") {
     // Verify there's only 1 internal vertex
@@ -239,6 +260,14 @@ TEST_CASE("Single Point Mesh Gradient Descent", "[HOT]") {
     REQUIRE(vertex->point()[1] == initial_internal_y);
   }
 
+  SECTION("Internal Vertices After Hull Change") {
+    // Moving the internal vertex outside the triangle puts it on the hull
+    DT::Vertex_handle vertex = internal_verts.front();
+    dt.move(vertex, DT::Point(2.0, 0.0));
+    REQUIRE(is_hull_vertex(dt, vertex));
+    REQUIRE(internal_vertices(dt).empty());
+  }
+
   SECTION("Vertex Gradient") {
     // This is a local minimum, so the energy should be iso
     std::vector<finite_diffs> f_diffs = compute_gradient<2>(dt, internal_verts);
@@ -253,12 +282,1106 @@ TEST_CASE("Single Point Mesh Gradient Descent", "[HOT]") {
 
   SECTION("Vertex Gradient Descent") {
     DT optimized = hot_optimize<2>(dt);
-    std::list<DT::Vertex_handle> optimized_verts = internal_vertices(optimized);
+    std::vector<DT::Vertex_handle> optimized_verts = internal_vertices(optimized);
     REQUIRE(optimized_verts.size() == 1);
     DT::Vertex_handle vertex = optimized_verts.front();
     REQUIRE(vertex->point()[0] < initial_internal_x);
     REQUIRE(std::abs(vertex->point()[1] - initial_internal_y) <= max_rel_error);
   }
+
+  SECTION("Asynchronous Vertex Relaxation") {
+    constexpr const long max_relaxations = 100;
+    DT optimized = hot_optimize_async<2>(dt, 1e-6, 1e-2, max_relaxations);
+    std::vector<DT::Vertex_handle> optimized_verts = internal_vertices(optimized);
+    REQUIRE(optimized_verts.size() == 1);
+    DT::Vertex_handle vertex = optimized_verts.front();
+    REQUIRE(vertex->point()[0] < initial_internal_x);
+    REQUIRE(std::abs(vertex->point()[1] - initial_internal_y) <= 1e-6);
+  }
+}
+
+TEST_CASE("Asynchronous Relaxation Of Several Vertices", "[HOT]") {
+  // A jittered 5x5 grid with 9 free vertices; relaxing them one at a time
+  // must never raise the energy, keep the hull, and end at least as low as
+  // the synchronous descent
+  RNG rng(7);
+  std::uniform_real_distribution<double> jitter(-0.15, 0.15);
+  DT dt;
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 5; j++) {
+      const bool boundary = i == 0 || i == 4 || j == 0 || j == 4;
+      dt.insert(Point(i + (boundary ? 0.0 : jitter(rng)),
+                      j + (boundary ? 0.0 : jitter(rng))));
+    }
+  }
+  REQUIRE(internal_vertices(dt).size() == 9);
+  const double initial = CGAL::to_double(hot_energy<2>(dt));
+
+  // enough relaxations that every vertex is popped many times, including
+  // after its neighbours' moves re-keyed it
+  DT async = hot_optimize_async<2>(dt, 1e-9, 1e-2, 2000);
+  DT sync = hot_optimize<2>(dt);
+  REQUIRE(async.number_of_vertices() == dt.number_of_vertices());
+  REQUIRE(internal_vertices(async).size() == 9);
+  const double async_energy = CGAL::to_double(hot_energy<2>(async));
+  const double sync_energy = CGAL::to_double(hot_energy<2>(sync));
+  REQUIRE(async_energy < initial);
+  REQUIRE(async_energy <= sync_energy * (1.0 + 1e-6));
+}
+
+TEST_CASE("Sb Analytic Gradient", "[Sb]") {
+  // A scalene face with distinct weights, so no derivative vanishes by
+  // symmetry
+  const double x[3][2] = {{0.0, 0.0}, {1.0, 0.125}, {0.25, 0.75}};
+  const double w[3] = {0.01, -0.02, 0.03};
+  constexpr const double h = 1e-6;
+  constexpr const double tolerance = 1e-6;
+
+  auto check = [&](std::function<double(const double[3][2], const double[3],
+                                        double[3][2], double[3])>
+                       kernel) {
+    double grad_x[3][2], grad_w[3], unused_x[3][2], unused_w[3];
+    kernel(x, w, grad_x, grad_w);
+    for (int v = 0; v < 3; v++) {
+      for (int a = 0; a < 3; a++) {
+        double xp[3][2], xm[3][2], wp[3], wm[3];
+        std::copy(&x[0][0], &x[0][0] + 6, &xp[0][0]);
+        std::copy(&x[0][0], &x[0][0] + 6, &xm[0][0]);
+        std::copy(w, w + 3, wp);
+        std::copy(w, w + 3, wm);
+        // a = 0, 1 are the coordinates, a = 2 the weight
+        (a < 2 ? xp[v][a] : wp[v]) += h;
+        (a < 2 ? xm[v][a] : wm[v]) -= h;
+        const double fd = (kernel(xp, wp, unused_x, unused_w) -
+                           kernel(xm, wm, unused_x, unused_w)) /
+                          (2 * h);
+        const double analytic = a < 2 ? grad_x[v][a] : grad_w[v];
+        REQUIRE(std::abs(fd - analytic) <=
+                tolerance * std::max(1.0, std::abs(analytic)));
+      }
+    }
+  };
+
+  SECTION("Energy") {
+    // Against the weighted circumcenter CGAL constructs, rather than the
+    // kernel the batches and the gradients share
+    RegT rt;
+    for (int v = 0; v < 3; v++) {
+      rt.insert(Wpt(Point(x[v][0], x[v][1]), w[v]));
+    }
+    REQUIRE(rt.number_of_vertices() == 3);
+    const RegT::Face_handle face = rt.finite_faces_begin();
+    const Point wcirc = rt.weighted_circumcenter(face);
+    const Triangle tri(Point(x[0][0], x[0][1]), Point(x[1][0], x[1][1]),
+                       Point(x[2][0], x[2][1]));
+    double grad_x[3][2], grad_w[3];
+    REQUIRE(triangle_Sb_grad(x, w, 2, 1, grad_x, grad_w) ==
+            Approx(triangle_Sb(tri, wcirc, 2, 1)));
+    REQUIRE(triangle_Sb_divide_perim4_grad(x, w, grad_x, grad_w) ==
+            Approx(triangle_Sb_divide_perim4(tri, wcirc)));
+    REQUIRE(Sb(rt, 2, 1) == Approx(triangle_Sb(tri, wcirc, 2, 1)));
+    REQUIRE(Sb_divide_perim(rt) ==
+            Approx(triangle_Sb_divide_perim4(tri, wcirc)));
+    for (int star = 0; star < 3; star++) {
+      REQUIRE(energy_weights(rt, 2, star) ==
+              Approx(triangle_energy_weights(face, wcirc, 2, star)));
+      REQUIRE(triangle_energy_weights_grad(x, w, star, grad_x, grad_w) ==
+              Approx(triangle_energy_weights(face, wcirc, 2, star)));
+    }
+  }
+
+  SECTION("Sb") { check(Sb_kernel(2, 1)); }
+
+  SECTION("Sb over area") { check(Sb_kernel(2, -1)); }
+
+  SECTION("Sb over perimeter") { check(Sb_divide_perim_kernel()); }
+
+  // the *star-HOT_2 energy of energy_weights, by position and by weight
+  SECTION("Weighted HOT") {
+    check(&triangle_energy_weights_grad<2, 1>);
+    for (int star = 0; star < 3; star++) {
+      check(weighted_hot_kernel(star));
+    }
+  }
+}
+
+TEST_CASE("Triangle Energies In One Pass", "[HOT]") {
+  const Triangle tri(Point(0.0, 0.0), Point(1.0, 0.125), Point(0.25, 0.75));
+  double zero[3] = {0, 0, 0};
+  const Point circumcenter = weighted_circumcenter(tri, zero);
+  const std::array<double, 7> e =
+      tri_energies<star_energy<2, 0>, star_energy<2, 1>, star_energy<2, 2>,
+                   star_energy_divideArea<2, 1, 2>, Sb_energy,
+                   Sb_divide_perim4_energy, star_energy<2, 0>>(tri);
+  REQUIRE(e[0] == Approx(tri_energy<2, 0>(tri)));
+  REQUIRE(e[1] == Approx(tri_energy<2, 1>(tri)));
+  REQUIRE(e[2] == Approx(tri_energy<2, 2>(tri)));
+  REQUIRE(e[3] == Approx(tri_energy_divideArea<2, 1>(tri, 2)));
+  REQUIRE(e[4] == Approx(triangle_Sb(tri, circumcenter, 2, 1)));
+  REQUIRE(e[5] == Approx(triangle_Sb_divide_perim4(tri, circumcenter)));
+  REQUIRE(e[6] == e[0]);
+}
+
+TEST_CASE("Height Derivatives", "[HOT]") {
+  // Faces well away from degenerate, where central differences are accurate
+  RNG rng(5);
+  std::uniform_real_distribution<double> coordinate(-1, 1);
+  constexpr const double step = 1e-6;
+  h_deriv_batch batch;
+  std::vector<std::array<double, 6>> expected;
+  while (batch.size() < 1000) {
+    double x[3][2];
+    for (int v = 0; v < 3; v++) {
+      x[v][0] = coordinate(rng);
+      x[v][1] = coordinate(rng);
+    }
+    const Point xi(x[0][0], x[0][1]), xj(x[1][0], x[1][1]), xk(x[2][0], x[2][1]);
+    if (std::abs(CGAL::area(xi, xj, xk)) < 0.025) {
+      continue;
+    }
+    double h_derv[3][2];
+    compute_h_derivs(xi, xj, xk, h_derv);
+    for (int v = 0; v < 3; v++) {
+      double single[2];
+      compute_h_deriv(xi, xj, xk, v + 1, single);
+      for (int c = 0; c < 2; c++) {
+        REQUIRE(single[c] == h_derv[v][c]);
+        // the height of edge (xi, xj) is at vertex 2, xk, of the triangle
+        double xp[3][2], xm[3][2];
+        std::copy(&x[0][0], &x[0][0] + 6, &xp[0][0]);
+        std::copy(&x[0][0], &x[0][0] + 6, &xm[0][0]);
+        xp[v][c] += step;
+        xm[v][c] -= step;
+        const double fd =
+            (signed_dist_circumcenters(Triangle(Point(xp[0][0], xp[0][1]), Point(xp[1][0], xp[1][1]),
+                                                Point(xp[2][0], xp[2][1])), 2) -
+             signed_dist_circumcenters(Triangle(Point(xm[0][0], xm[0][1]), Point(xm[1][0], xm[1][1]),
+                                                Point(xm[2][0], xm[2][1])), 2)) /
+            (2 * step);
+        REQUIRE(std::abs(fd - h_derv[v][c]) <= 1e-6 * std::max(1.0, std::abs(fd)));
+      }
+    }
+    batch.x0.push_back(xi.x());
+    batch.y0.push_back(xi.y());
+    batch.x1.push_back(xj.x());
+    batch.y1.push_back(xj.y());
+    batch.x2.push_back(xk.x());
+    batch.y2.push_back(xk.y());
+    expected.push_back({{h_derv[0][0], h_derv[0][1], h_derv[1][0],
+                         h_derv[1][1], h_derv[2][0], h_derv[2][1]}});
+  }
+  batch.resize(batch.x0.size());
+  compute_h_derivs(batch);
+  // the same arithmetic, up to how the compiler contracts it
+  for (std::size_t i = 0; i < batch.size(); i++) {
+    const double computed[6] = {batch.dx0[i], batch.dy0[i], batch.dx1[i],
+                                batch.dy1[i], batch.dx2[i], batch.dy2[i]};
+    for (int c = 0; c < 6; c++) {
+      REQUIRE(computed[c] == Approx(expected[i][c]).epsilon(1e-14));
+    }
+  }
+}
+
+TEST_CASE("HOT Energy Gradient", "[HOT]") {
+  // A jittered 5x5 grid; the runtime dispatched energy_gradient for every
+  // star, with and without the corrected formulas, against central
+  // differences of the energy. The points move without changing the
+  // connectivity, which stays Delaunay for so small a step
+  RNG rng(7);
+  std::uniform_real_distribution<double> jitter(-0.15, 0.15);
+  DT dt;
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 5; j++) {
+      const bool boundary = i == 0 || i == 4 || j == 0 || j == 4;
+      dt.insert(Point(i + (boundary ? 0.0 : jitter(rng)),
+                      j + (boundary ? 0.0 : jitter(rng))));
+    }
+  }
+  double (*const energy[3])(const DT &, bool) = {
+      &energy_density_EMethod<2, 0, DT>, &energy_density_EMethod<2, 1, DT>,
+      &energy_density_EMethod<2, 2, DT>};
+  constexpr const double step = 1e-6;
+  for (int star = 0; star < 3; star++) {
+    for (bool corrected : {false, true}) {
+      for (auto v = dt.finite_vertices_begin(); v != dt.finite_vertices_end();
+           ++v) {
+        const Point p = v->point();
+        double gradient[2];
+        energy_gradient(dt, 2, star, v, gradient, corrected);
+        for (int c = 0; c < 2; c++) {
+          v->set_point(Point(p.x() + (c == 0 ? step : 0),
+                             p.y() + (c == 1 ? step : 0)));
+          const double forward = energy[star](dt, corrected);
+          v->set_point(Point(p.x() - (c == 0 ? step : 0),
+                             p.y() - (c == 1 ? step : 0)));
+          const double backward = energy[star](dt, corrected);
+          v->set_point(p);
+          const double fd = (forward - backward) / (2 * step);
+          REQUIRE(std::abs(gradient[c] - fd) <=
+                  1e-5 * std::max(1.0, std::abs(fd)));
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Optimized Mesh", "[HOT]") {
+  // A jittered 5x5 grid, so there are 9 free vertices off the hull
+  RNG rng(7);
+  std::uniform_real_distribution<double> jitter(-0.15, 0.15);
+  DT dt;
+  RegT rt;
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 5; j++) {
+      const bool boundary = i == 0 || i == 4 || j == 0 || j == 4;
+      const Point p(i + (boundary ? 0.0 : jitter(rng)),
+                    j + (boundary ? 0.0 : jitter(rng)));
+      dt.insert(p);
+      rt.insert(Wpt(p, 0.0));
+    }
+  }
+
+  SECTION("HOT Energy") {
+    HotOptimizedMesh<DT, 1> hot(dt);
+    REQUIRE(hot.free_vertices().size() == 9);
+    REQUIRE(hot.energy() == Approx(energy_density_TMethod<2, 1>(dt)));
+    const double initial = hot.energy();
+    const mesh_optimize_result result = hot.optimize();
+    REQUIRE(result.energy < initial);
+    REQUIRE(result.energy == Approx(hot.energy()));
+  }
+
+  SECTION("Face Hessian") {
+    const double x[3][2] = {{0.0, 0.0}, {1.0, 0.125}, {0.25, 0.75}};
+    const double w[3] = {0.0, 0.0, 0.0};
+    constexpr const double h = 1e-6;
+    double grad[6], hess[6][6], grad_x[3][2], grad_w[3];
+    REQUIRE(hot_face_hessian<2, 1>(x, w, grad, hess) ==
+            Approx(hot_face_kernel<1>()(x, w, grad_x, grad_w)));
+    for (int a = 0; a < 6; a++) {
+      REQUIRE(grad[a] == Approx(grad_x[a / 2][a % 2]));
+      double xp[3][2], xm[3][2], gp[3][2], gm[3][2];
+      std::copy(&x[0][0], &x[0][0] + 6, &xp[0][0]);
+      std::copy(&x[0][0], &x[0][0] + 6, &xm[0][0]);
+      xp[a / 2][a % 2] += h;
+      xm[a / 2][a % 2] -= h;
+      hot_face_kernel<1>()(xp, w, gp, grad_w);
+      hot_face_kernel<1>()(xm, w, gm, grad_w);
+      for (int b = 0; b < 6; b++) {
+        const double fd = (gp[b / 2][b % 2] - gm[b / 2][b % 2]) / (2 * h);
+        REQUIRE(std::abs(fd - hess[a][b]) <=
+                1e-6 * std::max(1.0, std::abs(hess[a][b])));
+      }
+    }
+  }
+
+  SECTION("Newton") {
+    HotOptimizedMesh<DT, 1> hot(dt);
+    const double initial = hot.energy();
+    const newton_result result = hot.newton_optimize();
+    REQUIRE(result.energy < initial);
+    REQUIRE(result.energy == Approx(hot.energy()));
+  }
+
+  SECTION("Weighted HOT") {
+    HotOptimizedMesh<RegT, 1> hot(rt);
+    const double initial = hot.energy();
+    REQUIRE(hot.optimize().energy < initial);
+  }
+
+  SECTION("Pluggable Kernels") {
+    auto sb = make_optimized_mesh(rt, Sb_kernel(2, 1));
+    const double initial_sb = sb.energy();
+    REQUIRE(sb.optimize().energy < initial_sb);
+
+    auto cvt = make_optimized_mesh(dt, cvt_kite_kernel());
+    // The kites of a triangulation of the box are its clipped Voronoi cells
+    // as long as no circumcenter leaves the box
+    const double initial_cvt = cvt.energy();
+    REQUIRE(initial_cvt > 0);
+    REQUIRE(cvt.optimize().energy < initial_cvt);
+  }
+
+  SECTION("Multilevel") {
+    // A jittered 20x20 grid under a smooth warp, which is the error a flat
+    // descent is slowest to remove, coarsened down to a handful of free
+    // vertices
+    const double pi = std::acos(-1.0);
+    DT fine;
+    for (int i = 0; i < 20; i++) {
+      for (int j = 0; j < 20; j++) {
+        const bool boundary = i == 0 || i == 19 || j == 0 || j == 19;
+        const double warp =
+            1.5 * std::sin(pi * i / 19) * std::sin(pi * j / 19);
+        fine.insert(Point(i + (boundary ? 0.0 : warp + jitter(rng)),
+                          j + (boundary ? 0.0 : jitter(rng))));
+      }
+    }
+    DT flat(fine);
+    HotOptimizedMesh<DT, 1> hot(fine);
+    const double initial = hot.energy();
+    multilevel_params params;
+    params.coarsest_free_vertices = 20;
+    const multilevel_result result = multilevel_hot_optimize<1>(fine, params);
+    REQUIRE(result.levels > 2);
+    REQUIRE(fine.number_of_vertices() == 400);
+    REQUIRE(hot.free_vertices().size() == 18 * 18);
+    REQUIRE(result.energy < initial);
+    REQUIRE(result.energy == Approx(hot.energy()));
+
+    // The same number of iterations, all of them on the fine mesh, doesn't
+    // get as far
+    mesh_optimize_params flat_params;
+    flat_params.max_iterations = result.iterations;
+    const mesh_optimize_result flat_result =
+        HotOptimizedMesh<DT, 1>(flat).optimize(flat_params);
+    REQUIRE(result.energy < flat_result.energy);
+  }
+
+  SECTION("Partitioned") {
+    // The same grid, in 4 blocks run by 2 worker processes
+    DT fine;
+    for (int i = 0; i < 20; i++) {
+      for (int j = 0; j < 20; j++) {
+        const bool boundary = i == 0 || i == 19 || j == 0 || j == 19;
+        fine.insert(Point(i + (boundary ? 0.0 : jitter(rng)),
+                          j + (boundary ? 0.0 : jitter(rng))));
+      }
+    }
+    HotOptimizedMesh<DT, 1> hot(fine);
+    const double initial = hot.energy();
+    partitioned_params params;
+    params.workers = 2;
+    params.blocks = 4;
+    params.rounds = 3;
+    const partitioned_result result = partitioned_hot_optimize<1>(fine, params);
+    REQUIRE(result.rounds == 3);
+    REQUIRE(fine.number_of_vertices() == 400);
+    REQUIRE(hot.free_vertices().size() == 18 * 18);
+    REQUIRE(result.energy < initial);
+    REQUIRE(result.energy == Approx(hot.energy()));
+
+    // The blocks of a k-d partition differ in size by at most one
+    std::vector<double> position;
+    std::vector<int> ids;
+    for (int i = 0; i < 10; i++) {
+      position.push_back(i % 5);
+      position.push_back(i / 5);
+      ids.push_back(i);
+    }
+    std::vector<int> block(10, -1);
+    kd_partition(position, ids, 0, ids.size(), 3, 0, block);
+    std::vector<int> sizes(3, 0);
+    for (int b : block) {
+      REQUIRE(b >= 0);
+      sizes[b]++;
+    }
+    REQUIRE(*std::max_element(sizes.begin(), sizes.end()) -
+                *std::min_element(sizes.begin(), sizes.end()) <=
+            1);
+
+    // A square whose diagonal flips from 0-2 to 1-3 in a block where 2 is
+    // the only vertex without links: its list loses 0 from the other end
+    std::vector<std::vector<int>> neighbors = {
+        {1, 2, 3}, {0, 2}, {0, 1, 3}, {0, 2}};
+    const std::vector<int> local = {1, 3, 0, 2};
+    const std::vector<std::int32_t> links = {3, 2, 3, 1, 3, 2, 0, 3, 2, 0, 1};
+    REQUIRE(valid_links(links, 3, local.size()));
+    update_neighbors(local, 3, links, neighbors);
+    const std::vector<std::vector<int>> flipped = {
+        {1, 3}, {0, 2, 3}, {1, 3}, {0, 1, 2}};
+    for (size_t id = 0; id < neighbors.size(); id++) {
+      std::sort(neighbors[id].begin(), neighbors[id].end());
+      REQUIRE(neighbors[id] == flipped[id]);
+    }
+  }
+}
+
+TEST_CASE("Newton On Fixed Connectivity", "[HOT]") {
+  // A 5x5 patch of the equilateral lattice with its 9 interior vertices
+  // jittered. The lattice is a critical point by symmetry, and its Delaunay
+  // edges are far from flipping, so Newton converges with the connectivity
+  // fixed and the convergence must be quadratic
+  RNG rng(7);
+  std::uniform_real_distribution<double> jitter(-0.05, 0.05);
+  const double row_height = std::sqrt(3.0) / 2;
+  DT dt;
+  for (int j = 0; j < 5; j++) {
+    for (int i = 0; i < 5; i++) {
+      const bool boundary = i == 0 || i == 4 || j == 0 || j == 4;
+      dt.insert(Point(i + 0.5 * j + (boundary ? 0.0 : jitter(rng)),
+                      j * row_height + (boundary ? 0.0 : jitter(rng))));
+    }
+  }
+  HotOptimizedMesh<DT, 1> hot(dt);
+  REQUIRE(hot.free_vertices().size() == 9);
+
+  newton_params params;
+  params.gradient_tolerance = 1e-9;
+  params.max_iterations = 12;
+  const newton_result result = hot.newton_optimize(params);
+  REQUIRE(result.gradient_norm <= params.gradient_tolerance);
+  REQUIRE(result.iterations < params.max_iterations);
+  for (DT::Vertex_handle v : hot.free_vertices()) {
+    REQUIRE(dt.degree(v) == 6);
+    const double j = std::round(v->point().y() / row_height);
+    const double i = std::round(v->point().x() - 0.5 * j);
+    REQUIRE(std::abs(v->point().x() - (i + 0.5 * j)) <= 1e-6);
+    REQUIRE(std::abs(v->point().y() - j * row_height) <= 1e-6);
+  }
+}
+
+TEST_CASE("Steihaug CG", "[HOT]") {
+  auto matrix = [](int n, const std::vector<double> &dense) {
+    std::vector<std::pair<int, int>> entries;
+    for (int r = 0; r < n; r++) {
+      for (int c = 0; c < n; c++) {
+        if (dense[r * n + c] != 0.0) {
+          entries.push_back(std::make_pair(r, c));
+        }
+      }
+    }
+    csr_matrix H;
+    H.set_pattern(n, entries);
+    for (int r = 0; r < n; r++) {
+      for (int c = 0; c < n; c++) {
+        if (dense[r * n + c] != 0.0) {
+          H.add(r, c, dense[r * n + c]);
+        }
+      }
+    }
+    return H;
+  };
+  const csr_matrix spd = matrix(3, {4, 1, 0, 1, 3, 1, 0, 1, 2});
+  const std::vector<double> g = {1, 2, 3};
+  std::vector<double> p, Hp;
+
+  SECTION("Infinite Radius Solves") {
+    const steihaug_result result =
+        steihaug_cg(spd, g, std::numeric_limits<double>::infinity(), 1e-12,
+                    10, p);
+    REQUIRE(!result.on_boundary);
+    REQUIRE(!result.negative_curvature);
+    // CG is exact after n steps
+    REQUIRE(result.iterations <= 3);
+    spd.multiply(p, Hp);
+    for (int i = 0; i < 3; i++) {
+      REQUIRE(std::abs(Hp[i] + g[i]) <= 1e-10);
+    }
+  }
+
+  SECTION("Small Radius Stops On The Boundary") {
+    constexpr const double radius = 1e-3;
+    const steihaug_result result = steihaug_cg(spd, g, radius, 1e-12, 10, p);
+    REQUIRE(result.on_boundary);
+    REQUIRE(!result.negative_curvature);
+    // the Jacobi scaling, diag / mean(diag) with mean 3
+    const double m[3] = {4.0 / 3, 1.0, 2.0 / 3};
+    double norm2 = 0.0;
+    for (int i = 0; i < 3; i++) {
+      norm2 += m[i] * p[i] * p[i];
+    }
+    REQUIRE(std::sqrt(norm2) == Approx(radius));
+    REQUIRE(sparse_dot(g, p) < 0);
+  }
+
+  SECTION("Negative Curvature") {
+    // The preconditioned gradient points along the negative eigenvector
+    const csr_matrix indefinite = matrix(2, {1, 0, 0, -2});
+    const std::vector<double> g2 = {0.1, 1};
+    const steihaug_result result = steihaug_cg(indefinite, g2, 1.0, 1e-12, 10, p);
+    REQUIRE(result.negative_curvature);
+    REQUIRE(result.on_boundary);
+    REQUIRE(sparse_dot(g2, p) < 0);
+  }
+}
+
+TEST_CASE("Weighted Optimize", "[HOT]") {
+  // A jittered 5x5 grid with zero weights, plus a point in the middle of a
+  // cell whose weight is low enough that it starts hidden
+  RNG rng(7);
+  std::uniform_real_distribution<double> jitter(-0.15, 0.15);
+  RegT rt;
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 5; j++) {
+      const bool boundary = i == 0 || i == 4 || j == 0 || j == 4;
+      rt.insert(Wpt(Point(i + (boundary ? 0.0 : jitter(rng)),
+                          j + (boundary ? 0.0 : jitter(rng))),
+                    0.0));
+    }
+  }
+  rt.insert(Wpt(Point(1.5, 2.5), -1.0));
+  REQUIRE(rt.number_of_hidden_vertices() == 1);
+
+  const weighted_hot_kernel kernel(2);
+  const double initial =
+      KernelOptimizedMesh<RegT, weighted_hot_kernel>(rt, kernel).energy();
+  const weighted_optimize_result result = weighted_optimize(rt, kernel);
+  REQUIRE(result.energy < initial);
+  REQUIRE(result.energy ==
+          Approx(KernelOptimizedMesh<RegT, weighted_hot_kernel>(rt, kernel)
+                     .energy()));
+  REQUIRE(result.hidden_vertices > 0);
+  REQUIRE(result.hidden_vertices == rt.number_of_hidden_vertices());
+  REQUIRE(rt.is_valid());
+
+  // The neighbours of the hidden vertex were removed and re-inserted as
+  // they moved; its handle must still be a hidden vertex in the face which
+  // contains it
+  for (auto h_itr = rt.hidden_vertices_begin();
+       h_itr != rt.hidden_vertices_end(); h_itr++) {
+    const RegT::Vertex_handle hidden = h_itr;
+    REQUIRE(hidden->is_hidden());
+    const RegT::Face_handle face = hidden->face();
+    REQUIRE(!rt.is_infinite(face));
+    const Triangle tri(face->vertex(0)->point().point(),
+                       face->vertex(1)->point().point(),
+                       face->vertex(2)->point().point());
+    REQUIRE(!tri.has_on_unbounded_side(hidden->point().point()));
+  }
+}
+
+TEST_CASE("Indexed Triangulation", "[HOT]") {
+  // Every vertex and finite face index is in range and names its element
+  auto check_indices = [](const Indexed_DT &dt) {
+    REQUIRE(dt.number_of_indexed_vertices() ==
+            static_cast<int>(dt.number_of_vertices()));
+    for (int i = 0; i < dt.number_of_indexed_vertices(); i++) {
+      REQUIRE(dt.indexed_vertex(i)->index() == i);
+    }
+    REQUIRE(dt.number_of_indexed_faces() ==
+            static_cast<int>(dt.number_of_faces()));
+    for (int f = 0; f < dt.number_of_indexed_faces(); f++) {
+      REQUIRE(dt.face_index(dt.indexed_face(f)) == f);
+    }
+  };
+
+  RNG rng(11);
+  std::uniform_real_distribution<double> coord(0.0, 1.0);
+  std::vector<Indexed_DT::Point> points;
+  for (int i = 0; i < 64; i++) {
+    points.push_back(Indexed_DT::Point(coord(rng), coord(rng)));
+  }
+  Indexed_DT dt(points.begin(), points.begin() + 32);
+  for (auto p_itr = points.begin() + 32; p_itr != points.end(); p_itr++) {
+    dt.insert(*p_itr);
+  }
+  check_indices(dt);
+
+  SECTION("Remove") {
+    Indexed_DT::Vertex_handle last = dt.indexed_vertex(63);
+    dt.remove(dt.indexed_vertex(5));
+    REQUIRE(last->index() == 5);
+    check_indices(dt);
+  }
+
+  SECTION("Move") {
+    Indexed_DT::Vertex_handle v = dt.indexed_vertex(7);
+    dt.move_if_no_collision(v, Indexed_DT::Point(0.5, 0.5));
+    REQUIRE(v->index() == 7);
+    check_indices(dt);
+  }
+
+  SECTION("Flip") {
+    // Find an interior edge whose quadrilateral is convex
+    Indexed_DT::Face_handle f, n;
+    int i = 0;
+    for (auto e_itr = dt.finite_edges_begin(); e_itr != dt.finite_edges_end();
+         e_itr++) {
+      f = e_itr->first;
+      i = e_itr->second;
+      n = f->neighbor(i);
+      if (dt.is_infinite(f) || dt.is_infinite(n)) {
+        continue;
+      }
+      const Point &a = f->vertex(i)->point();
+      const Point &b = dt.mirror_vertex(f, i)->point();
+      const CGAL::Orientation c =
+          CGAL::orientation(a, b, f->vertex(dt.ccw(i))->point());
+      const CGAL::Orientation d =
+          CGAL::orientation(a, b, f->vertex(dt.cw(i))->point());
+      if (c != CGAL::COLLINEAR && d != CGAL::COLLINEAR && c != d) {
+        break;
+      }
+    }
+    const int f_index = dt.face_index(f), n_index = dt.face_index(n);
+    dt.flip(f, i);
+    REQUIRE(dt.face_index(f) == f_index);
+    REQUIRE(dt.face_index(n) == n_index);
+    check_indices(dt);
+  }
+
+  SECTION("Copy") {
+    Indexed_DT copy(dt);
+    check_indices(copy);
+    REQUIRE(copy.indexed_vertex(3)->point() == dt.indexed_vertex(3)->point());
+  }
+
+  SECTION("Regular") {
+    Indexed_RegT rt;
+    for (const Indexed_DT::Point &p : points) {
+      rt.insert(Wpt(p, 0.0));
+    }
+    Indexed_RegT::Vertex_handle v = rt.indexed_vertex(9);
+    v = rt.reinsert(v, Wpt(Point(0.5, 0.5), 1e-3));
+    REQUIRE(v->index() == 9);
+    REQUIRE(rt.number_of_indexed_vertices() == 64);
+  }
+}
+
+TEST_CASE("Bulk Build", "[HOT]") {
+  RNG rng(5);
+  std::uniform_real_distribution<double> coord(0.0, 1.0);
+  point_set points;
+  for (int i = 0; i < 4000; i++) {
+    points.coords.push_back(coord(rng));
+    points.coords.push_back(coord(rng));
+  }
+  std::vector<Point> serial_points;
+  for (std::size_t i = 0; i < points.size(); i++) {
+    serial_points.push_back(Point(points.x(i), points.y(i)));
+  }
+  DT serial(serial_points.begin(), serial_points.end());
+
+  // The faces as sorted vertex coordinates, to compare triangulations
+  auto face_set = [](const DT &dt) {
+    std::set<std::array<double, 6>> faces;
+    for (auto f_itr = dt.finite_faces_begin(); f_itr != dt.finite_faces_end();
+         f_itr++) {
+      std::array<std::pair<double, double>, 3> v;
+      for (int i = 0; i < 3; i++) {
+        v[i] = std::make_pair(f_itr->vertex(i)->point().x(),
+                              f_itr->vertex(i)->point().y());
+      }
+      std::sort(v.begin(), v.end());
+      faces.insert({{v[0].first, v[0].second, v[1].first, v[1].second,
+                     v[2].first, v[2].second}});
+    }
+    return faces;
+  };
+
+  SECTION("Hilbert Order") {
+    DT dt;
+    bulk_build(dt, points);
+    REQUIRE(dt.is_valid());
+    REQUIRE(face_set(dt) == face_set(serial));
+  }
+
+  SECTION("Strips") {
+    bulk_build_params params;
+    params.strip_min_points = 0;
+    params.strips = 6;
+    DT dt;
+    bulk_build(dt, points, params);
+    REQUIRE(dt.is_valid());
+    REQUIRE(dt.number_of_vertices() == serial.number_of_vertices());
+    REQUIRE(face_set(dt) == face_set(serial));
+
+    Indexed_DT indexed;
+    bulk_build(indexed, points, params);
+    REQUIRE(indexed.number_of_indexed_vertices() == 4000);
+    REQUIRE(indexed.number_of_indexed_faces() ==
+            static_cast<int>(serial.number_of_faces()));
+  }
+
+  SECTION("Weighted") {
+    point_set weighted;
+    weighted.stride = 3;
+    for (std::size_t i = 0; i < points.size(); i++) {
+      weighted.coords.push_back(points.x(i));
+      weighted.coords.push_back(points.y(i));
+      weighted.coords.push_back(1e-4 * coord(rng));
+    }
+    REQUIRE(write_points_binary("bulk_build_test.bin", weighted));
+    point_set read;
+    REQUIRE(read_points("bulk_build_test.bin", read));
+    REQUIRE(read.coords == weighted.coords);
+    std::remove("bulk_build_test.bin");
+
+    std::vector<Wpt> serial_wpoints;
+    for (std::size_t i = 0; i < read.size(); i++) {
+      serial_wpoints.push_back(
+          Wpt(Point(read.x(i), read.y(i)), read.weight(i)));
+    }
+    RegT serial_rt(serial_wpoints.begin(), serial_wpoints.end());
+    RegT rt;
+    bulk_build(rt, read);
+    REQUIRE(rt.is_valid());
+    REQUIRE(rt.number_of_faces() == serial_rt.number_of_faces());
+  }
+}
+
+TEST_CASE("Experiment Spec", "[HOT]") {
+  const std::string text =
+      "# a unit square with the free vertex on a 3 by 2 grid\n"
+      "{\"name\": \"square\",\n"
+      " \"polygon\": [[0, 0], [1, 0], [1, 1], [0, 1]],\n"
+      " \"free_vertices\": [[0.5, 0.5]],\n"
+      " \"sweep\": [{\"x\": [0.25, 1.25, 0.25]}, {\"y\": [0.5, 0.9, 0.25]},],\n"
+      " \"energies\": [\"star1\", \"Sb\"]}\n";
+  spec_value spec;
+  std::string error;
+  REQUIRE(parse_spec(text, spec, error));
+  experiment e;
+  REQUIRE(experiment_from_spec(spec, e));
+  REQUIRE(e.num_rows() == 8);
+  REQUIRE(e.column_names() == std::vector<std::string>({"x0", "y0", "star1", "Sb"}));
+  REQUIRE(e.output == "square.txt");
+
+  // the grid points with x = 1 are on the boundary, not inside
+  memory_result_sink memory(experiment_columns(e));
+  REQUIRE(run_experiment(e, memory));
+  const result_block &table = memory.rows();
+  REQUIRE(table.rows() == 6);
+  const Point free_vertex(table.value(3, 0), table.value(3, 1));
+  REQUIRE(free_vertex == Point(0.5, 0.75));
+  double star1 = 0;
+  for (int i = 0; i < 4; i++) {
+    star1 += tri_energy<2, 1>(Triangle(e.polygon[i], e.polygon[(i + 1) % 4], free_vertex));
+  }
+  REQUIRE(table.value(3, 2) == Approx(star1));
+
+  // the columnar file has the same rows, and a second run appends to it
+  e.output = "experiment_spec_test.bin";
+  e.format = "columnar";
+  std::remove(e.output.c_str());
+  REQUIRE(run_experiment(e));
+  REQUIRE(run_experiment(e));
+  std::unique_ptr<result_block> results;
+  REQUIRE(read_columnar_results(e.output, results));
+  std::remove(e.output.c_str());
+  REQUIRE(results->rows() == 2 * 6);
+  for (std::size_t r = 0; r < results->rows(); r++) {
+    for (std::size_t c = 0; c < 4; c++) {
+      REQUIRE(results->value(r, c) == table.value(r % 6, c));
+    }
+  }
+
+  REQUIRE_FALSE(parse_spec("{\"polygon\": [[0, 0] [1, 0]]}", spec, error));
+  REQUIRE(parse_spec("{\"energies\": [\"star3\"]}", spec, error));
+  REQUIRE_FALSE(experiment_from_spec(spec, e));
+}
+
+TEST_CASE("Result Sinks", "[HOT]") {
+  const std::vector<result_column> columns = {
+      {"x", column_type::float64}, {"n", column_type::int64}};
+  const double values[] = {0.1, 1.0 / 3, -2.5, 1e-300, 123456789, 0.1 + 0.2};
+  result_block block(columns);
+  for (int i = 0; i < 6; i++) {
+    const double row[2] = {values[i], double(i - 3)};
+    block.add_row(row);
+  }
+
+  // Every digit needed to read back the same double, where setprecision(5)
+  // would have lost most of them
+  const std::string path = "result_sink_test.txt";
+  std::unique_ptr<result_sink> text = open_result_sink(path, "text", columns);
+  REQUIRE(text.get() != nullptr);
+  REQUIRE(text->write(block));
+  REQUIRE(text->close());
+  std::ifstream in(path);
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(in, line);) {
+    lines.push_back(line);
+  }
+  in.close();
+  std::remove(path.c_str());
+  REQUIRE(lines.size() == 7);
+  REQUIRE(lines[0] == "# x n");
+  for (int i = 0; i < 6; i++) {
+    std::istringstream line(lines[i + 1]);
+    double x;
+    long n;
+    REQUIRE(line >> x >> n);
+    REQUIRE(x == values[i]);
+    REQUIRE(n == i - 3);
+  }
+  REQUIRE(lines[3] == "-2.5 -1");
+
+  // A columnar file whose last block was cut short is appended to after
+  // the whole blocks
+  const std::string columnar_path = "result_sink_test.bin";
+  std::remove(columnar_path.c_str());
+  for (int run = 0; run < 2; run++) {
+    std::unique_ptr<result_sink> columnar =
+        open_result_sink(columnar_path, "columnar", columns);
+    REQUIRE(columnar.get() != nullptr);
+    REQUIRE(columnar->write(block));
+    REQUIRE(columnar->close());
+    // a row count and half a column
+    std::ofstream partial(columnar_path, std::ios::binary | std::ios::app);
+    const std::uint64_t rows = block.rows();
+    partial.write(reinterpret_cast<const char *>(&rows), sizeof(rows));
+    partial.write(reinterpret_cast<const char *>(values), 3 * sizeof(double));
+  }
+  std::unique_ptr<result_block> results;
+  REQUIRE(!read_columnar_results(columnar_path, results));
+  REQUIRE(open_result_sink(columnar_path, "columnar", columns)->close());
+  REQUIRE(read_columnar_results(columnar_path, results));
+  std::remove(columnar_path.c_str());
+  REQUIRE(results->rows() == 2 * block.rows());
+  for (std::size_t r = 0; r < results->rows(); r++) {
+    REQUIRE(results->value(r, 0) == values[r % 6]);
+  }
+
+  // A sink which can't be opened is refused rather than written to
+  REQUIRE(!open_result_sink("no_such_directory/results.txt", "text", columns));
+  REQUIRE(!open_result_sink("no_such_directory/results.bin", "columnar",
+                            columns));
+  REQUIRE(!open_result_sink(path, "csv", columns));
+}
+
+TEST_CASE("Constrained HOT", "[HOT]") {
+  using Tds = CGAL::Triangulation_data_structure_2<
+      CGAL::Delaunay_mesh_vertex_base_2<K>, CGAL::Delaunay_mesh_face_base_2<K>>;
+  using CDT = CGAL::Constrained_Delaunay_triangulation_2<K, Tds>;
+
+  // A non-convex L, with a vertex partway along the bottom edge
+  const Point corners[] = {Point(0, 0), Point(2, 0), Point(2, 1),
+                           Point(1, 1), Point(1, 2), Point(0, 2)};
+  CDT cdt;
+  std::vector<CDT::Vertex_handle> boundary;
+  for (const Point &p : corners) {
+    boundary.push_back(cdt.insert(p));
+  }
+  CDT::Vertex_handle slider = cdt.insert(Point(1.5, 0));
+  boundary.insert(boundary.begin() + 1, slider);
+  for (size_t i = 0; i < boundary.size(); i++) {
+    cdt.insert_constraint(boundary[i], boundary[(i + 1) % boundary.size()]);
+  }
+  const Point interior[] = {Point(0.4, 0.3), Point(1.2, 0.6), Point(0.5, 1.1),
+                            Point(0.3, 1.6), Point(1.7, 0.4)};
+  for (const Point &p : interior) {
+    cdt.insert(p);
+  }
+  auto count_constraints = [&]() {
+    int constraints = 0;
+    for (auto ei = cdt.finite_edges_begin(); ei != cdt.finite_edges_end();
+         ei++) {
+      constraints += cdt.is_constrained(*ei);
+    }
+    return constraints;
+  };
+  const int num_constraints = count_constraints();
+
+  mark_domain(cdt);
+  int domain_faces = 0;
+  for (auto face_itr = cdt.finite_faces_begin();
+       face_itr != cdt.finite_faces_end(); face_itr++) {
+    domain_faces += face_itr->is_in_domain();
+  }
+  // The notch of the L is outside the domain
+  REQUIRE(domain_faces < cdt.number_of_faces());
+
+  CDT::Vertex_handle ends[2];
+  REQUIRE(classify_cdt_vertex(cdt, slider, ends) == cdt_vertex_kind::sliding);
+  REQUIRE(classify_cdt_vertex(cdt, boundary[4], ends) ==
+          cdt_vertex_kind::fixed);
+
+  const double initial = cdt_hot_energy<1>(cdt);
+  const mesh_optimize_result result = cdt_hot_optimize<1>(cdt);
+  REQUIRE(result.energy < initial);
+  REQUIRE(count_constraints() == num_constraints);
+  REQUIRE(cdt.number_of_vertices() == 12);
+  std::vector<CDT::Vertex_handle> bottom;
+  for (auto v_itr = cdt.finite_vertices_begin();
+       v_itr != cdt.finite_vertices_end(); v_itr++) {
+    const double x = v_itr->point().x(), y = v_itr->point().y();
+    // Everything stays in the L
+    REQUIRE((x >= 0 && x <= 2 && y >= 0 && y <= 2));
+    REQUIRE(!(x > 1 && y > 1));
+    if (y == 0 && x != 0 && x != 2) {
+      bottom.push_back(v_itr);
+    }
+  }
+  // The slider was projected onto the bottom edge, so it is exactly on it,
+  // still splits its constraint, and kept the margin from the corners
+  REQUIRE(bottom.size() == 1);
+  slider = bottom[0];
+  REQUIRE(classify_cdt_vertex(cdt, slider, ends) == cdt_vertex_kind::sliding);
+  REQUIRE(std::min(ends[0]->point().x(), ends[1]->point().x()) == 0);
+  REQUIRE(std::max(ends[0]->point().x(), ends[1]->point().x()) == 2);
+  const double margin = cdt_hot_params().slide_margin * 2;
+  REQUIRE(slider->point().x() >= margin - 1e-12);
+  REQUIRE(slider->point().x() <= 2 - margin + 1e-12);
+
+  // Constrained vertices are never removed to be moved
+  const CDT::Vertex_handle corner = boundary[0];
+  REQUIRE(mesh_traits<CDT>::move(cdt, corner, 0.5, 0.5, 0.0) == corner);
+  REQUIRE(corner->point() == Point(0, 0));
+  REQUIRE(count_constraints() == num_constraints);
+
+  // Nor merged into another vertex: a free vertex moved, or the slider
+  // slid, onto a vertex stays where it was
+  CDT::Vertex_handle free_vertex;
+  for (auto v_itr = cdt.finite_vertices_begin();
+       v_itr != cdt.finite_vertices_end(); v_itr++) {
+    if (!cdt.are_there_incident_constraints(v_itr)) {
+      free_vertex = v_itr;
+    }
+  }
+  REQUIRE(free_vertex != CDT::Vertex_handle());
+  const Point free_point = free_vertex->point();
+  REQUIRE(mesh_traits<CDT>::move(cdt, free_vertex, 0.0, 0.0, 0.0) ==
+          free_vertex);
+  REQUIRE(free_vertex->point() == free_point);
+  const Point slider_point = slider->point();
+  REQUIRE(classify_cdt_vertex(cdt, slider, ends) == cdt_vertex_kind::sliding);
+  REQUIRE(slide_cdt_vertex(cdt, slider, ends[0], ends[1], ends[1]->point()) ==
+          slider);
+  REQUIRE(slider->point() == slider_point);
+  REQUIRE(cdt.number_of_vertices() == 12);
+  REQUIRE(count_constraints() == num_constraints);
+}
+
+TEST_CASE("Lloyd CVT", "[CVT]") {
+  const cvt_domain unit_box = cvt_domain::box(0.0, 1.0, 0.0, 1.0);
+
+  SECTION("Clipped Cell Moments") {
+    // The bisector with (0.75, 0.5) cuts the box in half
+    cvt_polygon cell, scratch;
+    clipped_voronoi_cell(0.25, 0.5, {0.75}, {0.5}, unit_box, cell, scratch);
+    const cvt_cell_moments moments = polygon_moments(cell, 0.25, 0.5);
+    REQUIRE(moments.area == Approx(0.5));
+    REQUIRE(moments.centroid[0] == Approx(0.25));
+    REQUIRE(moments.centroid[1] == Approx(0.5));
+    REQUIRE(moments.energy == Approx(0.125 / 12.0 + 0.5 / 12.0));
+  }
+
+  SECTION("Density Weighted Cell Moments") {
+    // The left half of the unit box
+    cvt_polygon cell, scratch;
+    clipped_voronoi_cell(0.25, 0.5, {0.75}, {0.5}, unit_box, cell, scratch);
+
+    // rho = 1 + 2x has mass 0.75 and center of mass x = 5 / 18 here
+    polynomial_density linear(1);
+    linear.coefficient(0, 0) = 1;
+    linear.coefficient(1, 0) = 2;
+    const cvt_cell_moments poly = linear.moments(cell, 0.25, 0.5);
+    REQUIRE(poly.area == Approx(0.75));
+    REQUIRE(poly.centroid[0] == Approx(5.0 / 18.0));
+    REQUIRE(poly.centroid[1] == Approx(0.5));
+
+    // The same density sampled at pixel centers is exact on each column,
+    // and the integral images must reproduce the column sums
+    const int n = 8;
+    std::vector<double> pixels(n * n);
+    for (int j = 0; j < n; j++) {
+      for (int i = 0; i < n; i++) {
+        pixels[j * n + i] = 1 + 2 * (i + 0.5) / n;
+      }
+    }
+    const raster_density raster(0.0, 0.0, 1.0 / n, 1.0 / n, n, n, pixels);
+    const cvt_cell_moments raster_moments = raster.moments(cell, 0.25, 0.5);
+    REQUIRE(raster_moments.area == Approx(0.75));
+    // the column centers weighted by the sampled values
+    REQUIRE(raster_moments.centroid[0] == Approx(53.0 / 192.0));
+    REQUIRE(raster_moments.centroid[1] == Approx(0.5));
+
+    // Uniform densities agree with the shoelace moments
+    const raster_density ones(0.0, 0.0, 0.125, 0.125, n, n,
+                              std::vector<double>(n * n, 1.0));
+    const cvt_cell_moments uniform = polygon_moments(cell, 0.25, 0.5);
+    const cvt_cell_moments from_raster = ones.moments(cell, 0.25, 0.5);
+    REQUIRE(from_raster.area == Approx(uniform.area));
+    REQUIRE(from_raster.centroid[0] == Approx(uniform.centroid[0]));
+    REQUIRE(from_raster.energy == Approx(uniform.energy));
+
+    // A grid over the left half only. The unit box has three edges on the
+    // grid's boundary and the right half off it, and a huge box reaches far
+    // past the grid; either way only the pixels count
+    const raster_density strip(0.0, 0.0, 0.125, 0.125, n / 2, n,
+                               std::vector<double>(n * n / 2, 1.0));
+    for (double half_width : {0.5, 1e6}) {
+      cvt_polygon box;
+      box.push_back(0.5 - half_width, 0.5 - half_width);
+      box.push_back(0.5 + half_width, 0.5 - half_width);
+      box.push_back(0.5 + half_width, 0.5 + half_width);
+      box.push_back(0.5 - half_width, 0.5 + half_width);
+      const cvt_cell_moments clipped = strip.moments(box, 0.25, 0.5);
+      REQUIRE(clipped.area == Approx(uniform.area));
+      REQUIRE(clipped.centroid[0] == Approx(uniform.centroid[0]));
+      REQUIRE(clipped.centroid[1] == Approx(uniform.centroid[1]));
+      REQUIRE(clipped.energy == Approx(uniform.energy));
+    }
+  }
+
+  SECTION("Four Sites Converge To Quadrants") {
+    DT dt;
+    dt.insert(DT::Point(0.2, 0.3));
+    dt.insert(DT::Point(0.7, 0.2));
+    dt.insert(DT::Point(0.8, 0.8));
+    dt.insert(DT::Point(0.3, 0.7));
+
+    cvt_params params;
+    params.max_iterations = 200;
+    params.energy_tolerance = -std::numeric_limits<double>::infinity();
+    params.displacement_tolerance = 1e-9;
+    auto require_quadrants = [&](const DT &relaxed, const cvt_result &result) {
+      REQUIRE(result.iterations < params.max_iterations);
+      REQUIRE(result.energy == Approx(1.0 / 24.0));
+      for (auto v_itr = relaxed.finite_vertices_begin();
+           v_itr != relaxed.finite_vertices_end(); v_itr++) {
+        const double x = v_itr->point().x(), y = v_itr->point().y();
+        REQUIRE(std::abs(std::abs(x - 0.5) - 0.25) <= 1e-6);
+        REQUIRE(std::abs(std::abs(y - 0.5) - 0.25) <= 1e-6);
+      }
+    };
+
+    DT lloyd_dt(dt), anderson_dt(dt), lbfgs_dt(dt);
+    const cvt_result lloyd = lloyd_iterate(lloyd_dt, unit_box, params);
+    const cvt_result anderson = anderson_cvt(anderson_dt, unit_box, params);
+    const cvt_result lbfgs = lbfgs_cvt(lbfgs_dt, unit_box, params);
+    require_quadrants(lloyd_dt, lloyd);
+    require_quadrants(anderson_dt, anderson);
+    require_quadrants(lbfgs_dt, lbfgs);
+    // Lloyd converges linearly; the accelerated solvers have to beat it on
+    // the same problem and tolerance
+    REQUIRE(anderson.iterations < lloyd.iterations);
+    REQUIRE(lbfgs.iterations * 3 < lloyd.iterations);
+  }
+
+  SECTION("L-BFGS Resumes From A Checkpoint") {
+    RNG rng(5);
+    std::uniform_real_distribution<double> position(0.0, 1.0);
+    std::vector<Point> sites;
+    for (int i = 0; i < 30; i++) {
+      sites.push_back(Point(position(rng), position(rng)));
+    }
+    cvt_params params;
+    params.max_iterations = 12;
+    params.energy_tolerance = -std::numeric_limits<double>::infinity();
+    params.displacement_tolerance = -1;
+    DT straight(sites.begin(), sites.end());
+    const cvt_result expected = lbfgs_cvt(straight, unit_box, params);
+
+    // Interrupted after 6 iterations, with a checkpoint on every one
+    const std::string path = "lbfgs_resume_test.ckpt";
+    {
+      checkpoint_writer checkpoints(path, 0);
+      DT interrupted(sites.begin(), sites.end());
+      cvt_params first = params;
+      first.max_iterations = 6;
+      first.checkpoints = &checkpoints;
+      lbfgs_cvt(interrupted, unit_box, first);
+      REQUIRE(checkpoints.flush());
+    }
+    checkpoint saved;
+    REQUIRE(read_checkpoint(path, saved));
+    REQUIRE(saved.solver == "lbfgs");
+    REQUIRE(saved.iteration == 5);
+    REQUIRE(saved.points.size() == sites.size());
+    REQUIRE(saved.history_s.size() == saved.history_rho.size());
+
+    DT resumed;
+    restore_triangulation(resumed, saved);
+    cvt_params second = params;
+    second.resume = &saved;
+    const cvt_result result = lbfgs_cvt(resumed, unit_box, second);
+    REQUIRE(result.iterations == expected.iterations);
+    REQUIRE(result.energy == Approx(expected.energy));
+    std::remove(path.c_str());
+  }
 }
 
 TEST_CASE("Two Point Mesh Gradient Descent", "[HOT]") {
@@ -287,7 +1410,7 @@ TEST_CASE("Two Point Mesh Gradient Descent", "[HOT]") {
     dt.insert(DT::Point(initial_internal_x[i], initial_internal_y[i]));
   }
 
-  std::list<DT::Vertex_handle> internal_verts = internal_vertices(dt);
+  std::vector<DT::Vertex_handle> internal_verts = internal_vertices(dt);
 
   SECTION("Internal Vertices") {
     // Verify there's only 1 internal vertex
@@ -436,21 +1559,53 @@ void copy_patch_star( const WDT::Vertex_handle &v, WDT &wdt, WDT::Vertex_handle
 }
 
 
+/* energy_gradient and energy_and_gradient_EMethod of the *star-HOT_2 energy
+ * with corrected formulas, against central differences of
+ * energy_density_EMethod. indexed_mesh has the same vertices and faces as
+ * mesh */
+template <int star>
+void check_EMethod_gradients(Mesh_T &mesh, const Indexed_mesh_T &indexed_mesh) {
+  const double energy = energy_density_EMethod<2, star>(mesh, true);
+  std::vector<double> fused_gradient;
+  REQUIRE(std::abs(energy_and_gradient_EMethod<2, star>(indexed_mesh, fused_gradient, true) - energy) <=
+          1e-12 * std::abs(energy));
+  std::map<std::pair<double, double>, int> index;
+  for (int i = 0; i < indexed_mesh.number_of_indexed_vertices(); i++) {
+    const Point p = indexed_mesh.indexed_vertex(i)->point();
+    index[std::make_pair(p.x(), p.y())] = i;
+  }
+  constexpr const double step = 1e-6;
+  for (auto v = mesh.finite_vertices_begin(); v != mesh.finite_vertices_end(); ++v) {
+    const Point p = v->point();
+    const int i = index.at(std::make_pair(p.x(), p.y()));
+    double mesh_gradient[2];
+    energy_gradient<2, star>(mesh, v, mesh_gradient, true);
+    for (int c = 0; c < 2; c++) {
+      // the connectivity is fixed, so only the point moves
+      v->set_point(Point(p.x() + (c == 0 ? step : 0), p.y() + (c == 1 ? step : 0)));
+      const double forward = energy_density_EMethod<2, star>(mesh, true);
+      v->set_point(Point(p.x() - (c == 0 ? step : 0), p.y() - (c == 1 ? step : 0)));
+      const double backward = energy_density_EMethod<2, star>(mesh, true);
+      v->set_point(p);
+      const double fd = (forward - backward) / (2 * step);
+      REQUIRE(std::abs(mesh_gradient[c] - fd) <= 1e-5 * std::max(1.0, std::abs(fd)));
+      REQUIRE(std::abs(fused_gradient[2 * i + c] - fd) <= 1e-5 * std::max(1.0, std::abs(fd)));
+    }
+  }
+}
+
 TEST_CASE("HOT_fig1", "[HOT]")
 {
   
   // read file
   
-  // directory path?
-  std::string epath;
+  // directory path: the clone of the HOT_Energy repository, from the
+  // environment if it is set, else the source tree this test was built from
+  std::string epath = HOT_SOURCE_DIR;
   auto energy_dir_p = getenv("HOT_Energy");
   // expect something like
   //   /Users/samitch/Documents/repos/PrimalDual/HOT_Energy
-  if (energy_dir_p==nullptr)
-  {
-    std::cout << "Warning, environment variable 'HOT_Energy' should be the file location of your clone of the HOT_Energy github repository, but is undefined" << std::endl;
-  }
-  else
+  if (energy_dir_p!=nullptr)
   {
     epath = energy_dir_p;
   }
@@ -459,30 +1614,16 @@ TEST_CASE("HOT_fig1", "[HOT]")
   std::string example_name = "HOT_fig1";
   std::string fpath = epath + "/examples/" + example_name + "/" + example_name;
 
-  // points
+  // points, weights and triangles (numbered from 0 in triangles)
+  point_set mesh_points;
+  std::vector<std::array<int, 3>> triangles;
+  REQUIRE(read_mesh_files(fpath, mesh_points, triangles));
   std::vector<Point_2> points;
-  {
-    std::ifstream p_in(fpath + "_points.txt");
-    std::istream_iterator<Point> p_begin(p_in), p_end;
-    points.assign(p_begin, p_end);
-  }
-  
-  // weights
   std::vector<double> weights;
+  for (std::size_t i = 0; i < mesh_points.size(); ++i)
   {
-    std::ifstream w_in(fpath + "_weights.txt");
-    std::istream_iterator<double> w_begin(w_in), w_end;
-    weights.assign(w_begin, w_end);
-  }
-  
-  // triangles
-  std::vector< int > triangle_points;
-  // point 0,1,2 define the first triangle, etc.
-  // In the file, indices start at 1, so subtract 1 here
-  {
-    std::ifstream t_in(fpath + "_triangles.txt");
-    std::istream_iterator< int > t_begin(t_in), t_end;
-    triangle_points.assign(t_begin, t_end);
+    points.push_back(Point_2(mesh_points.x(i), mesh_points.y(i)));
+    weights.push_back(mesh_points.weight(i));
   }
   
   std::cout << points.size() << " points= ";
@@ -495,8 +1636,7 @@ TEST_CASE("HOT_fig1", "[HOT]")
   using K = CGAL::Cartesian<double>;
   // using K_real = K::RT;
 
-  if (points.empty())
-    return;
+  REQUIRE(!points.empty());
   
   // find bounding box of points
   double x_bounds[2], y_bounds[2];
@@ -575,47 +1715,63 @@ TEST_CASE("HOT_fig1", "[HOT]")
   } while (v++ != v_end);
   
   
-  /*
-  
-  // make triangulation of exactly the specified triangles
-  // see https://doc.cgal.org/latest/Triangulation_2/classCGAL_1_1Triangulation__2.html
-  // https://doc.cgal.org/latest/Triangulation_2/index.html#Section_2D_Triangulations_Basic
-
-  // the relevant methods are somewhat "hidden" because these are "advanced" uses which do not guarantee the validity of the triangulation
-  // https://doc.cgal.org/latest/TDS_2/classTriangulationDataStructure__2.html
-  // see the "create_face" methods
-  
-  // CGAL::Triangulation_2<K> t; // not this, it does flips and such automagically
-  CGAL::Triangulation_data_structure_2<> td;
-  dump_TD(td);
-  
-  td.set_dimension(2);
-  
-  // create vertices corresponding to each of the points
-  std::vector<CGAL::Triangulation_data_structure_2<>::Vertex_handle> verts;
-  for (auto p : points)
+  // make triangulation of exactly the specified triangles, which need not be Delaunay
+  Mesh_T mesh;
+  REQUIRE(convex_boundary(mesh_points, triangles));
+  REQUIRE(load_mesh(fpath, mesh));
   {
-    CGAL::Triangulation_data_structure_2<>::Vertex_handle v = td.create_vertex();
-    // v->point();  // doesn't compile
-    // v->set_point(p); // doesn't compile
-    verts.push_back(v);
+    // a dart, whose boundary turns right at its second point
+    point_set dart;
+    dart.coords = {0, 0, 1, 0.5, 2, 0, 1, 2};
+    REQUIRE(!convex_boundary(dart, {{{0, 1, 3}}, {{1, 2, 3}}}));
+    dart.coords[3] = -0.5;
+    REQUIRE(convex_boundary(dart, {{{0, 1, 3}}, {{1, 2, 3}}}));
   }
-  for (auto tpi = triangle_points.begin(); tpi < triangle_points.end(); tpi += 3)
+  REQUIRE(mesh.number_of_vertices() == points.size());
+  REQUIRE(mesh.number_of_faces() == triangles.size());
+  for (auto f = mesh.finite_faces_begin(); f != mesh.finite_faces_end(); ++f)
   {
-    // points are indexed starting at 1
-    auto i0 = *tpi -1, i1 = *(tpi+1) -1, i2 = *(tpi+2) -1;
-    
-    auto f = td.create_face( verts[i0], verts[i1], verts[i2] );
-    std::cout << " new face " << *f << " v(" << i0 << "," << i1 << "," << i2 << ") ";
-    // do we need to tell the faces who their face neighbors are? Or is this sufficient?
-    //   Face_handle   create_face (Vertex_handle v1, Vertex_handle v2, Vertex_handle v3, Face_handle f1, Face_handle f2, Face_handle f3)
-    //   adds a face with vertices v1, v2 and v3, and neighbors f1, f2, f3.
+    REQUIRE(mesh.orientation(f->vertex(0)->point(), f->vertex(1)->point(), f->vertex(2)->point()) == CGAL::LEFT_TURN);
   }
-  
-  dump_TD(td, &verts);
-  
-  // we're on our own for deciding if a triangle is inside out, and calling the corresponding flip functions, etc.
-   
-   */
+  // every edge is shared by two faces, with the boundary edges next to infinite faces
+  REQUIRE(std::distance(mesh.finite_edges_begin(), mesh.finite_edges_end()) == static_cast<std::ptrdiff_t>(points.size() + triangles.size() - 1));
+  const double mesh_energy = energy_density_EMethod<2, 1>(mesh, true);
+  REQUIRE(std::isfinite(mesh_energy));
+  HOT_INFO("HOT_fig1 mesh *1-HOT_2 (EMethod) " << mesh_energy << ", Delaunay " << energy_density_EMethod<2, 1>(dt, true));
+
+  // the same energy and gradient straight from the triangles
+  soup_adjacency adjacency;
+  REQUIRE(soup_build_adjacency(mesh_points.size(), triangles, adjacency));
+  REQUIRE(adjacency.edges.size() == points.size() + triangles.size() - 1);
+  REQUIRE(std::abs(soup_energy_EMethod<2, 1>(mesh_points, triangles, adjacency, true) - mesh_energy) <= 1e-12 * std::abs(mesh_energy));
+  std::vector<double> soup_gradient;
+  soup_energy_gradient_EMethod<2, 1>(mesh_points, triangles, adjacency, true, soup_gradient);
+  // against central differences, which keep the edge signs for a small step
+  for (std::size_t i = 0; i < mesh_points.size(); ++i)
+  {
+    for (int c = 0; c < 2; c++)
+    {
+      const double step = 1e-6;
+      point_set moved = mesh_points;
+      moved.coords[moved.stride * i + c] += step;
+      const double forward = soup_energy_EMethod<2, 1>(moved, triangles, adjacency, true);
+      moved.coords[moved.stride * i + c] -= 2 * step;
+      const double backward = soup_energy_EMethod<2, 1>(moved, triangles, adjacency, true);
+      const double fd = (forward - backward) / (2 * step);
+      REQUIRE(std::abs(soup_gradient[2 * i + c] - fd) <= 1e-5 * std::max(1.0, std::abs(fd)));
+    }
+  }
+
+  // and in one fused sweep over the faces, with the per-vertex gradient,
+  // both against central differences of the energy for every star
+  Indexed_mesh_T indexed_mesh;
+  REQUIRE(load_mesh(fpath, indexed_mesh));
+  check_EMethod_gradients<0>(mesh, indexed_mesh);
+  check_EMethod_gradients<1>(mesh, indexed_mesh);
+  check_EMethod_gradients<2>(mesh, indexed_mesh);
+
+  Weighted_mesh_T wmesh;
+  REQUIRE(load_mesh(fpath, wmesh));
+  REQUIRE(std::isfinite(energy_weights(wmesh, 2, 1)));
   
 }